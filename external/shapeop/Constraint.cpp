@@ -919,12 +919,12 @@ SHAPEOP_INLINE void AngleConstraint::addConstraint(std::vector<Triplet> &triplet
 SHAPEOP_INLINE void AngleConstraint::setMinAngle(Scalar minAngle) {
   // Ensure the angle limits are between 0 and PI
   // Use parentheses to avoid conflicts with the min/max macros from windows.h
-  minAngle_ = (std::max)(minAngle, 0.0);
+  minAngle_ = (std::max)(minAngle, Scalar(0.0));
   minAngleCos_ = clamp(std::cos(minAngle_), -1.0, 1.0);
 }
 ///////////////////////////////////////////////////////////////////////////////
 SHAPEOP_INLINE void AngleConstraint::setMaxAngle(Scalar maxAngle) {
-  maxAngle_ = (std::min)(maxAngle, M_PI);
+  maxAngle_ = (std::min)(maxAngle, Scalar(M_PI));
   maxAngleCos_ = clamp(std::cos(maxAngle_), -1.0, 1.0);
 }
 ///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,220 @@
+///////////////////////////////////////////////////////////////////////////////
+// This file is part of ShapeOp, a lightweight C++ library
+// for static and dynamic geometry processing.
+//
+// This Source Code Form is subject to the terms of the Mozilla
+// Public License v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+///////////////////////////////////////////////////////////////////////////////
+#include "ConstraintSet.h"
+#include <algorithm>
+#include <cmath>
+///////////////////////////////////////////////////////////////////////////////
+#ifdef SHAPEOP_MSVC
+#define SHAPEOP_OMP_FOR_SIMD __pragma(omp for simd schedule(static))
+#else
+#define SHAPEOP_OMP_FOR_SIMD _Pragma("omp for simd schedule(static)")
+#endif
+///////////////////////////////////////////////////////////////////////////////
+namespace ShapeOp {
+///////////////////////////////////////////////////////////////////////////////
+SHAPEOP_INLINE void ClosenessConstraintSet::reserve(int n) {
+  ids_.reserve(n);
+  weights_.reserve(n);
+  rest_.reserve(3 * n);
+}
+///////////////////////////////////////////////////////////////////////////////
+SHAPEOP_INLINE int ClosenessConstraintSet::add(int id, Scalar weight, const Vector3 &rest) {
+  ids_.push_back(id);
+  weights_.push_back(std::sqrt(weight));
+  rest_.insert(rest_.end(), rest.data(), rest.data() + 3);
+  return size() - 1;
+}
+///////////////////////////////////////////////////////////////////////////////
+SHAPEOP_INLINE void ClosenessConstraintSet::setPosition(int i, const Vector3 &rest) {
+  std::copy(rest.data(), rest.data() + 3, rest_.begin() + 3 * i);
+}
+///////////////////////////////////////////////////////////////////////////////
+SHAPEOP_INLINE void ClosenessConstraintSet::clear() {
+  ids_.clear();
+  weights_.clear();
+  rest_.clear();
+}
+///////////////////////////////////////////////////////////////////////////////
+SHAPEOP_INLINE void ClosenessConstraintSet::project(const Matrix3X & /*positions*/, Matrix3X &projections) const {
+  const int n = size();
+  if (n == 0) return;
+  const Scalar *weights = weights_.data();
+  const Scalar *rest = rest_.data();
+  Scalar *out = projections.col(idO_).data();
+  SHAPEOP_OMP_FOR_SIMD for (int i = 0; i < n; ++i) {
+    out[3 * i + 0] = weights[i] * rest[3 * i + 0];
+    out[3 * i + 1] = weights[i] * rest[3 * i + 1];
+    out[3 * i + 2] = weights[i] * rest[3 * i + 2];
+  }
+}
+///////////////////////////////////////////////////////////////////////////////
+SHAPEOP_INLINE void ClosenessConstraintSet::addConstraints(std::vector<Triplet> &triplets, int &idO) const {
+  idO_ = idO;
+  for (int i = 0; i < size(); ++i)
+    triplets.push_back(Triplet(idO_ + i, ids_[i], weights_[i]));
+  idO += size();
+}
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+SHAPEOP_INLINE void PlaneCollisionConstraintSet::reserve(int n) {
+  ids_.reserve(n);
+  weights_.reserve(n);
+  planePoints_.reserve(3 * n);
+  planeNormals_.reserve(3 * n);
+  dists_.reserve(n);
+}
+///////////////////////////////////////////////////////////////////////////////
+SHAPEOP_INLINE int PlaneCollisionConstraintSet::add(int id, Scalar weight, const Vector3 &ppos, const Vector3 &pnor, Scalar dist) {
+  ids_.push_back(id);
+  weights_.push_back(std::sqrt(weight));
+  planePoints_.insert(planePoints_.end(), ppos.data(), ppos.data() + 3);
+  planeNormals_.insert(planeNormals_.end(), pnor.data(), pnor.data() + 3);
+  dists_.push_back(dist);
+  return size() - 1;
+}
+///////////////////////////////////////////////////////////////////////////////
+SHAPEOP_INLINE void PlaneCollisionConstraintSet::setPlane(int i, const Vector3 &ppos, const Vector3 &pnor, Scalar dist) {
+  std::copy(ppos.data(), ppos.data() + 3, planePoints_.begin() + 3 * i);
+  std::copy(pnor.data(), pnor.data() + 3, planeNormals_.begin() + 3 * i);
+  dists_[i] = dist;
+}
+///////////////////////////////////////////////////////////////////////////////
+SHAPEOP_INLINE void PlaneCollisionConstraintSet::clear() {
+  ids_.clear();
+  weights_.clear();
+  planePoints_.clear();
+  planeNormals_.clear();
+  dists_.clear();
+}
+///////////////////////////////////////////////////////////////////////////////
+SHAPEOP_INLINE void PlaneCollisionConstraintSet::project(const Matrix3X &positions, Matrix3X &projections) const {
+  const int n = size();
+  if (n == 0) return;
+  const int *ids = ids_.data();
+  const Scalar *weights = weights_.data();
+  const Scalar *pp = planePoints_.data();
+  const Scalar *pn = planeNormals_.data();
+  const Scalar *dists = dists_.data();
+  const Scalar *x = positions.data();
+  Scalar *out = projections.col(idO_).data();
+  SHAPEOP_OMP_FOR_SIMD for (int i = 0; i < n; ++i) {
+    const Scalar *p = x + 3 * ids[i];
+    Scalar dist = (p[0] - pp[3 * i + 0]) * pn[3 * i + 0] +
+                  (p[1] - pp[3 * i + 1]) * pn[3 * i + 1] +
+                  (p[2] - pp[3 * i + 2]) * pn[3 * i + 2];
+    //move below the plane if closer than dist, otherwise keep the position
+    Scalar offset = dist > -dists[i] ? dist + dists[i] : Scalar(0);
+    out[3 * i + 0] = weights[i] * (p[0] - offset * pn[3 * i + 0]);
+    out[3 * i + 1] = weights[i] * (p[1] - offset * pn[3 * i + 1]);
+    out[3 * i + 2] = weights[i] * (p[2] - offset * pn[3 * i + 2]);
+  }
+}
+///////////////////////////////////////////////////////////////////////////////
+SHAPEOP_INLINE void PlaneCollisionConstraintSet::addConstraints(std::vector<Triplet> &triplets, int &idO) const {
+  idO_ = idO;
+  for (int i = 0; i < size(); ++i)
+    triplets.push_back(Triplet(idO_ + i, ids_[i], weights_[i]));
+  idO += size();
+}
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+SHAPEOP_INLINE void BendingConstraintSet::reserve(int n) {
+  ids_.reserve(4 * n);
+  w_.reserve(4 * n);
+  weights_.reserve(n);
+  n_.reserve(n);
+  rangeMin_.reserve(n);
+  rangeMax_.reserve(n);
+}
+///////////////////////////////////////////////////////////////////////////////
+SHAPEOP_INLINE int BendingConstraintSet::add(const int ids[4], Scalar weight, const Matrix3X &positions, Scalar rangeMin, Scalar rangeMax) {
+  Matrix34 p;
+  for (int i = 0; i < 4; ++i) p.col(i) = positions.col(ids[i]);
+  Scalar l01 = (p.col(0) - p.col(1)).norm();
+  Scalar l02 = (p.col(0) - p.col(2)).norm();
+  Scalar l12 = (p.col(1) - p.col(2)).norm();
+  Scalar r0 = 0.5 * (l01 + l02 + l12);
+  Scalar A0 = std::sqrt(r0 * (r0 - l01) * (r0 - l02) * (r0 - l12));
+  Scalar l03 = (p.col(0) - p.col(3)).norm();
+  Scalar l13 = (p.col(1) - p.col(3)).norm();
+  Scalar r1 = 0.5 * (l01 + l03 + l13);
+  Scalar A1 = std::sqrt(r1 * (r1 - l01) * (r1 - l03) * (r1 - l13));
+  Scalar cot02 = ((l01 * l01) - (l02 * l02) + (l12 * l12)) / (4.0 * A0);
+  Scalar cot12 = ((l01 * l01) + (l02 * l02) - (l12 * l12)) / (4.0 * A0);
+  Scalar cot03 = ((l01 * l01) - (l03 * l03) + (l13 * l13)) / (4.0 * A1);
+  Scalar cot13 = ((l01 * l01) + (l03 * l03) - (l13 * l13)) / (4.0 * A1);
+  Vector4 w;
+  w(0) = cot02 + cot03;
+  w(1) = cot12 + cot13;
+  w(2) = -(cot02 + cot12);
+  w(3) = -(cot03 + cot13);
+  ids_.insert(ids_.end(), ids, ids + 4);
+  w_.insert(w_.end(), w.data(), w.data() + 4);
+  weights_.push_back(std::sqrt(weight) * std::sqrt(3.0 / (A0 + A1)));
+  n_.push_back((p * w).norm());
+  rangeMin_.push_back(rangeMin);
+  rangeMax_.push_back(rangeMax);
+  return size() - 1;
+}
+///////////////////////////////////////////////////////////////////////////////
+SHAPEOP_INLINE void BendingConstraintSet::clear() {
+  ids_.clear();
+  w_.clear();
+  weights_.clear();
+  n_.clear();
+  rangeMin_.clear();
+  rangeMax_.clear();
+}
+///////////////////////////////////////////////////////////////////////////////
+SHAPEOP_INLINE void BendingConstraintSet::project(const Matrix3X &positions, Matrix3X &projections) const {
+  const int n = size();
+  if (n == 0) return;
+  const int *ids = ids_.data();
+  const Scalar *w = w_.data();
+  const Scalar *weights = weights_.data();
+  const Scalar *rest = n_.data();
+  const Scalar *x = positions.data();
+  Scalar *out = projections.col(idO_).data();
+  SHAPEOP_OMP_FOR_SIMD for (int i = 0; i < n; ++i) {
+    Scalar e[3] = {0, 0, 0};
+    if (rest[i] > 1e-6) {
+      for (int j = 0; j < 4; ++j) {
+        const Scalar *p = x + 3 * ids[4 * i + j];
+        e[0] += w[4 * i + j] * p[0];
+        e[1] += w[4 * i + j] * p[1];
+        e[2] += w[4 * i + j] * p[2];
+      }
+      Scalar l = std::sqrt(e[0] * e[0] + e[1] * e[1] + e[2] * e[2]);
+      if (l > 1e-6) {
+        //clamp the bend to [rangeMin * rest, rangeMax * rest]
+        e[0] /= l;
+        e[1] /= l;
+        e[2] /= l;
+        l = rest[i] * std::min(std::max(l / rest[i], rangeMin_[i]), rangeMax_[i]);
+        e[0] *= l;
+        e[1] *= l;
+        e[2] *= l;
+      }
+    }
+    out[3 * i + 0] = weights[i] * e[0];
+    out[3 * i + 1] = weights[i] * e[1];
+    out[3 * i + 2] = weights[i] * e[2];
+  }
+}
+///////////////////////////////////////////////////////////////////////////////
+SHAPEOP_INLINE void BendingConstraintSet::addConstraints(std::vector<Triplet> &triplets, int &idO) const {
+  idO_ = idO;
+  for (int i = 0; i < size(); ++i)
+    for (int j = 0; j < 4; ++j)
+      triplets.push_back(Triplet(idO_ + i, ids_[4 * i + j], weights_[i] * w_[4 * i + j]));
+  idO += size();
+}
+///////////////////////////////////////////////////////////////////////////////
+} // namespace ShapeOp
+///////////////////////////////////////////////////////////////////////////////
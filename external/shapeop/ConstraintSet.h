@@ -0,0 +1,125 @@
+///////////////////////////////////////////////////////////////////////////////
+// This file is part of ShapeOp, a lightweight C++ library
+// for static and dynamic geometry processing.
+//
+// This Source Code Form is subject to the terms of the Mozilla
+// Public License v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+///////////////////////////////////////////////////////////////////////////////
+#ifndef CONSTRAINTSET_H
+#define CONSTRAINTSET_H
+///////////////////////////////////////////////////////////////////////////////
+#include "Types.h"
+#include <cmath>
+#include <vector>
+///////////////////////////////////////////////////////////////////////////////
+/** \file
+This file contains batched constraint containers. A set stores many constraints of one type
+as contiguous arrays (structure of arrays) and projects all of them in one data parallel kernel,
+instead of one heap allocated #ShapeOp::Constraint and one virtual call per constraint.
+The projections are identical to the corresponding single constraints.*/
+///////////////////////////////////////////////////////////////////////////////
+namespace ShapeOp {
+///////////////////////////////////////////////////////////////////////////////
+/** \brief Base class of any constraint set. The rows of a set in the linear system are consecutive.
+As for single constraints, the square root of the given weights is applied to the rows.*/
+class SHAPEOP_API ConstraintSet {
+ public:
+  virtual ~ConstraintSet() {}
+  /** \brief Project all constraints of the set. Uses orphaned OpenMP worksharing, so inside a parallel region it has to be called by all threads.
+      \param positions The positions of all the n vertices stacked in a 3 by n matrix.
+      \param projections The projections of the vertices involved in the constraints.
+  */
+  virtual void project(const Matrix3X &positions, Matrix3X &projections) const = 0;
+  /** \brief Add all constraints of the set to the linear system.
+      \param[out] triplets A vector of triplets each representing an entry in a sparse matrix.
+      \param[in,out] idO In: The first row index of the set in the sparse matrix. Out: The last row index plus one.
+  */
+  virtual void addConstraints(std::vector<Triplet> &triplets, int &idO) const = 0;
+  /** \brief Number of constraints in the set.*/
+  virtual int size() const = 0;
+  /** \brief Remove all constraints (the storage is kept).*/
+  virtual void clear() = 0;
+ protected:
+  /** \brief location of the first constraint of this set in the linear system.*/
+  mutable int idO_ = 0;
+};
+///////////////////////////////////////////////////////////////////////////////
+/** \brief Set of closeness constraints (see #ShapeOp::ClosenessConstraint).*/
+class SHAPEOP_API ClosenessConstraintSet : public ConstraintSet {
+ public:
+  virtual ~ClosenessConstraintSet() {}
+  /** \brief Reserve storage for n constraints.*/
+  void reserve(int n);
+  /** \brief Add a constraint pulling vertex id to the rest position and get back its index in the set.*/
+  int add(int id, Scalar weight, const Vector3 &rest);
+  /** \brief Set the weight of a constraint (changes the linear system).*/
+  void setWeight(int i, Scalar weight) { weights_[i] = std::sqrt(weight); }
+  /** \brief Set the rest position of a constraint.*/
+  void setPosition(int i, const Vector3 &rest);
+  virtual void project(const Matrix3X &positions, Matrix3X &projections) const override final;
+  virtual void addConstraints(std::vector<Triplet> &triplets, int &idO) const override final;
+  virtual int size() const override final { return static_cast<int>(ids_.size()); }
+  virtual void clear() override final;
+ private:
+  std::vector<int> ids_;
+  std::vector<Scalar> weights_;
+  /** \brief rest positions, 3 per constraint.*/
+  std::vector<Scalar> rest_;
+};
+///////////////////////////////////////////////////////////////////////////////
+/** \brief Set of plane collision constraints (see #ShapeOp::PlaneCollisionConstraint).*/
+class SHAPEOP_API PlaneCollisionConstraintSet : public ConstraintSet {
+ public:
+  virtual ~PlaneCollisionConstraintSet() {}
+  /** \brief Reserve storage for n constraints.*/
+  void reserve(int n);
+  /** \brief Add a constraint keeping vertex id at least dist below the plane (ppos, pnor) and get back its index in the set.*/
+  int add(int id, Scalar weight, const Vector3 &ppos, const Vector3 &pnor, Scalar dist);
+  /** \brief Set the weight of a constraint (changes the linear system).*/
+  void setWeight(int i, Scalar weight) { weights_[i] = std::sqrt(weight); }
+  /** \brief Set the plane and distance of a constraint (does not change the linear system). A zero normal keeps the vertex where it is.*/
+  void setPlane(int i, const Vector3 &ppos, const Vector3 &pnor, Scalar dist);
+  virtual void project(const Matrix3X &positions, Matrix3X &projections) const override final;
+  virtual void addConstraints(std::vector<Triplet> &triplets, int &idO) const override final;
+  virtual int size() const override final { return static_cast<int>(ids_.size()); }
+  virtual void clear() override final;
+ private:
+  std::vector<int> ids_;
+  std::vector<Scalar> weights_;
+  /** \brief plane points and normals, 3 per constraint.*/
+  std::vector<Scalar> planePoints_;
+  std::vector<Scalar> planeNormals_;
+  std::vector<Scalar> dists_;
+};
+///////////////////////////////////////////////////////////////////////////////
+/** \brief Set of bending constraints (see #ShapeOp::BendingConstraint).*/
+class SHAPEOP_API BendingConstraintSet : public ConstraintSet {
+ public:
+  virtual ~BendingConstraintSet() {}
+  /** \brief Reserve storage for n constraints.*/
+  void reserve(int n);
+  /** \brief Add a bending constraint for the four vertices ids (same order as #ShapeOp::BendingConstraint), the target bend is taken from positions. Returns the index in the set.*/
+  int add(const int ids[4], Scalar weight, const Matrix3X &positions, Scalar rangeMin = 1.0, Scalar rangeMax = 1.0);
+  virtual void project(const Matrix3X &positions, Matrix3X &projections) const override final;
+  virtual void addConstraints(std::vector<Triplet> &triplets, int &idO) const override final;
+  virtual int size() const override final { return static_cast<int>(weights_.size()); }
+  virtual void clear() override final;
+ private:
+  /** \brief vertex ids and cotangent weights, 4 per constraint.*/
+  std::vector<int> ids_;
+  std::vector<Scalar> w_;
+  std::vector<Scalar> weights_;
+  std::vector<Scalar> n_;
+  std::vector<Scalar> rangeMin_;
+  std::vector<Scalar> rangeMax_;
+};
+///////////////////////////////////////////////////////////////////////////////
+} // namespace ShapeOp
+///////////////////////////////////////////////////////////////////////////////
+#ifdef SHAPEOP_HEADER_ONLY
+#include "ConstraintSet.cpp"
+#endif
+///////////////////////////////////////////////////////////////////////////////
+#endif // CONSTRAINTSET_H
+///////////////////////////////////////////////////////////////////////////////
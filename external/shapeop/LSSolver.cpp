@@ -14,14 +14,49 @@
 ///////////////////////////////////////////////////////////////////////////////
 namespace ShapeOp {
 ///////////////////////////////////////////////////////////////////////////////
+SHAPEOP_INLINE Matrix3X LSSolver::solveMultiple(const Matrix3X &b, const Matrix3X &x0) const {
+  Matrix3X x(3, b.cols());
+  for (int i = 0; i < 3; ++i) x.row(i) = solve(b.row(i).transpose(), x0.row(i).transpose()).transpose();
+  return x;
+}
+///////////////////////////////////////////////////////////////////////////////
 SHAPEOP_INLINE void SimplicialLDLTSolver::initialize(const SparseMatrix &A, unsigned int iteration) {
   solver_.compute(A);
 }
 ///////////////////////////////////////////////////////////////////////////////
+SHAPEOP_INLINE void SimplicialLDLTSolver::refactorize(const SparseMatrix &A) {
+  solver_.factorize(A);
+}
+///////////////////////////////////////////////////////////////////////////////
 SHAPEOP_INLINE VectorX SimplicialLDLTSolver::solve(const VectorX &b, const VectorX &x0) const {
   return solver_.solve(b);
 }
 ///////////////////////////////////////////////////////////////////////////////
+SHAPEOP_INLINE Matrix3X SimplicialLDLTSolver::solveMultiple(const Matrix3X &b, const Matrix3X & /*x0*/) const {
+  //same steps as SimplicialLDLT::solve: x = P^-1 L^-T D^-1 L^-1 P b, with the coordinates of an unknown stored next to each other
+  const SparseMatrix &L = solver_.matrixL().nestedExpression();
+  const VectorX &D = solver_.vectorD();
+  const int n = static_cast<int>(L.cols());
+  const int *perm = solver_.permutationP().indices().data();
+  Matrix3X x(3, n);
+  for (int i = 0; i < n; ++i) x.col(perm[i]) = b.col(i);
+  for (int j = 0; j < n; ++j) {
+    const Vector3 xj = x.col(j);
+    for (SparseMatrix::InnerIterator it(L, j); it; ++it)
+      if (it.index() > j) x.col(it.index()) -= it.value() * xj;
+  }
+  for (int j = 0; j < n; ++j) x.col(j) /= D(j);
+  for (int j = n - 1; j >= 0; --j) {
+    Vector3 xj = x.col(j);
+    for (SparseMatrix::InnerIterator it(L, j); it; ++it)
+      if (it.index() > j) xj -= it.value() * x.col(it.index());
+    x.col(j) = xj;
+  }
+  Matrix3X result(3, n);
+  for (int i = 0; i < n; ++i) result.col(i) = x.col(perm[i]);
+  return result;
+}
+///////////////////////////////////////////////////////////////////////////////
 SHAPEOP_INLINE Eigen::ComputationInfo SimplicialLDLTSolver::info() const {
   return solver_.info();
 }
@@ -31,6 +66,10 @@ SHAPEOP_INLINE void CGSolver::initialize(const SparseMatrix &A, unsigned int ite
   solver_.setMaxIterations(iteration);
 }
 ///////////////////////////////////////////////////////////////////////////////
+SHAPEOP_INLINE void CGSolver::refactorize(const SparseMatrix &A) {
+  solver_.compute(A);
+}
+///////////////////////////////////////////////////////////////////////////////
 SHAPEOP_INLINE VectorX CGSolver::solve(const VectorX &b, const VectorX &x0) const {
   return solver_.solveWithGuess(b, x0);
 }
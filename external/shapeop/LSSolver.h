@@ -28,8 +28,14 @@ class SHAPEOP_API LSSolver {
   virtual ~LSSolver() {};
   /** \brief Initialize the linear system solver using the sparse matrix A.*/
   virtual void initialize(const SparseMatrix &A, unsigned int iteration = 1) = 0;
+  /** \brief Update the solver to new values of A, which has the same sparsity pattern as in #initialize. By default the solver is initialized again.*/
+  virtual void refactorize(const SparseMatrix &A) { initialize(A); }
   /** \brief Solve the linear system Ax = b.*/
   virtual VectorX solve(const VectorX &b, const VectorX &x0) const = 0;
+  /** \brief Solve the linear system for three right hand sides at once, A X^T = B^T.
+  The right hand sides and the initial guesses are the rows of b and x0 (3 by n, like the points).
+  By default each row is solved separately.*/
+  virtual Matrix3X solveMultiple(const Matrix3X &b, const Matrix3X &x0) const;
   /** \brief Reports whether previous computation was successful.*/
   virtual Eigen::ComputationInfo info() const = 0;
 };
@@ -40,8 +46,12 @@ class SHAPEOP_API SimplicialLDLTSolver : public LSSolver {
   virtual ~SimplicialLDLTSolver() {};
   /** \brief Prefactorize the sparse matrix (A = LDL^T).*/
   virtual void initialize(const SparseMatrix &A, unsigned int iteration) override final;
+  /** \brief Numeric factorization only, the symbolic analysis (ordering, elimination tree) of #initialize is reused.*/
+  virtual void refactorize(const SparseMatrix &A) override final;
   /** \brief Solve the linear system by applying twice backsubstitution.*/
   virtual VectorX solve(const VectorX &b, const VectorX &x0) const override final;
+  /** \brief Backsubstitution of all three right hand sides in one pass over the factor, every entry of L is loaded once.*/
+  virtual Matrix3X solveMultiple(const Matrix3X &b, const Matrix3X &x0) const override final;
   /** \brief Reports whether previous computation was successful.*/
   virtual Eigen::ComputationInfo info() const override final;
  private:
@@ -54,6 +64,8 @@ class SHAPEOP_API CGSolver : public LSSolver {
   virtual ~CGSolver() {};
   /** \brief Initialize PCG.*/
   virtual void initialize(const SparseMatrix &A, unsigned int iteration) override final;
+  /** \brief Recompute the preconditioner for new values of A, the maximum number of iterations is kept.*/
+  virtual void refactorize(const SparseMatrix &A) override final;
   /** \brief Solve the linear system by applying CG.*/
   virtual VectorX solve(const VectorX &b, const VectorX &x0) const override final;
   /** \brief Reports whether previous computation was successful.*/
@@ -12,24 +12,34 @@
 #include "Solver.h"
 #include "LSSolver.h"
 #include "Constraint.h"
+#include "ConstraintSet.h"
 #include "Force.h"
+#include <algorithm>
 ///////////////////////////////////////////////////////////////////////////////
 #define SHAPEOP_OPENMP
 #ifdef SHAPEOP_OPENMP
 #ifdef SHAPEOP_MSVC
 #define SHAPEOP_OMP_PARALLEL __pragma(omp parallel)
 #define SHAPEOP_OMP_FOR __pragma(omp for)
+#define SHAPEOP_OMP_SINGLE __pragma(omp single)
 #else
 #define SHAPEOP_OMP_PARALLEL _Pragma("omp parallel")
 #define SHAPEOP_OMP_FOR _Pragma("omp for")
+#define SHAPEOP_OMP_SINGLE _Pragma("omp single")
 #endif
 #else
 #define SHAPEOP_OMP_PARALLEL
 #define SHAPEOP_OMP_FOR
+#define SHAPEOP_OMP_SINGLE
 #endif
 ///////////////////////////////////////////////////////////////////////////////
 namespace ShapeOp {
 ///////////////////////////////////////////////////////////////////////////////
+SHAPEOP_INLINE void Solver::setGlobalSolver(GlobalSolver type, unsigned int cgIterations) {
+  globalSolver_ = type;
+  cgIterations_ = cgIterations;
+}
+///////////////////////////////////////////////////////////////////////////////
 SHAPEOP_INLINE int Solver::addConstraint(const std::shared_ptr<Constraint> &c) {
   constraints_.push_back(c);
   return static_cast<int>(constraints_.size() - 1);
@@ -39,6 +49,29 @@ SHAPEOP_INLINE std::shared_ptr<Constraint> &Solver::getConstraint(int id) {
   return constraints_[id];
 }
 ///////////////////////////////////////////////////////////////////////////////
+SHAPEOP_INLINE void Solver::clearConstraints() {
+  constraints_.clear();
+}
+///////////////////////////////////////////////////////////////////////////////
+SHAPEOP_INLINE int Solver::addConstraintSet(const std::shared_ptr<ConstraintSet> &s) {
+  constraintSets_.push_back(s);
+  return static_cast<int>(constraintSets_.size() - 1);
+}
+///////////////////////////////////////////////////////////////////////////////
+SHAPEOP_INLINE std::shared_ptr<ConstraintSet> &Solver::getConstraintSet(int id) {
+  return constraintSets_[id];
+}
+///////////////////////////////////////////////////////////////////////////////
+SHAPEOP_INLINE SparseMatrix Solver::assemble() const {
+  std::vector<Triplet> triplets;
+  int idO = 0;
+  for (int i = 0; i < static_cast<int>(constraints_.size()); ++i) constraints_[i]->addConstraint(triplets, idO);
+  for (int i = 0; i < static_cast<int>(constraintSets_.size()); ++i) constraintSets_[i]->addConstraints(triplets, idO);
+  SparseMatrix A = SparseMatrix(idO, points_.cols());
+  A.setFromTriplets(triplets.begin(), triplets.end());
+  return A;
+}
+///////////////////////////////////////////////////////////////////////////////
 SHAPEOP_INLINE int Solver::addForces(const std::shared_ptr<Force> &f) {
   forces_.push_back(f);
   return static_cast<int>(forces_.size() - 1);
@@ -66,15 +99,11 @@ SHAPEOP_INLINE const Matrix3X &Solver::getPoints() {
 ///////////////////////////////////////////////////////////////////////////////
 SHAPEOP_INLINE bool Solver::initialize(bool dynamic, Scalar masses, Scalar damping, Scalar timestep) {
   int n_points = static_cast<int>(points_.cols());
-  int n_constraints = static_cast<int>(constraints_.size());
   assert(n_points != 0);
-  assert(n_constraints != 0);
-  std::vector<Triplet> triplets;
-  int idO = 0;
-  for (int i = 0; i < n_constraints; ++i) constraints_[i]->addConstraint(triplets, idO);
-  projections_.setZero(3, idO);
-  SparseMatrix A = SparseMatrix(idO, n_points);
-  A.setFromTriplets(triplets.begin(), triplets.end());
+  SparseMatrix A = assemble();
+  assert(A.rows() != 0);
+  projections_.setZero(3, A.rows());
+  rhs_.setZero(3, n_points);
   At_ = A.transpose();
   oldPoints_ = Matrix3X(3, n_points);
   //Dynamic
@@ -88,15 +117,43 @@ SHAPEOP_INLINE bool Solver::initialize(bool dynamic, Scalar masses, Scalar dampi
   M_.setIdentity();
   M_ *= masses_; //TODO: fix this
   M_ /= delta_ * delta_;
-  N_ = At_ * A;
+  N_ = SparseMatrix(A.transpose()) * A;
   if (dynamic_) N_ += M_;
-  solver_ = std::make_shared<ShapeOp::SimplicialLDLTSolver>();
-  solver_->initialize(N_);
+  if (globalSolver_ == GlobalSolver::CG) {
+    solver_ = std::make_shared<ShapeOp::CGSolver>();
+    solver_->initialize(N_, cgIterations_);
+  } else {
+    solver_ = std::make_shared<ShapeOp::SimplicialLDLTSolver>();
+    solver_->initialize(N_);
+  }
 
   return solver_->info() == Eigen::Success;
 }
 ///////////////////////////////////////////////////////////////////////////////
+SHAPEOP_INLINE bool Solver::refactorize() {
+  if (!solver_) return initialize();
+  int n_points = static_cast<int>(points_.cols());
+  if (n_points != static_cast<int>(oldPoints_.cols())) return initialize(dynamic_, masses_, damping_, delta_);
+  SparseMatrix A = assemble();
+  assert(A.rows() != 0);
+  SparseMatrix At = A.transpose();
+  SparseMatrix N = At * A;
+  if (dynamic_) N += M_;
+  //the symbolic factorization only depends on the pattern of N
+  bool samePattern = N.nonZeros() == N_.nonZeros() && N.outerSize() == N_.outerSize() &&
+                     std::equal(N.outerIndexPtr(), N.outerIndexPtr() + N.outerSize() + 1, N_.outerIndexPtr()) &&
+                     std::equal(N.innerIndexPtr(), N.innerIndexPtr() + N.nonZeros(), N_.innerIndexPtr());
+  if (!samePattern) return initialize(dynamic_, masses_, damping_, delta_);
+  projections_.setZero(3, A.rows());
+  At_ = At;
+  N_ = N;
+  solver_->refactorize(N_);
+  return solver_->info() == Eigen::Success;
+}
+///////////////////////////////////////////////////////////////////////////////
 SHAPEOP_INLINE bool Solver::solve(unsigned int iteration) {
+  //without dynamics and forces the momentum is zero and the inertial term drops out of the right hand side
+  const bool inertia = dynamic_ || !forces_.empty();
   SHAPEOP_OMP_PARALLEL
   {
     //momentum
@@ -120,9 +177,29 @@ SHAPEOP_INLINE bool Solver::solve(unsigned int iteration) {
       //local solve: projection
       SHAPEOP_OMP_FOR for (int i = 0; i < static_cast<int>(constraints_.size()); ++i)
         constraints_[i]->project(points_, projections_);
+      //batched kernels, worksharing inside the sets
+      for (int i = 0; i < static_cast<int>(constraintSets_.size()); ++i)
+        constraintSets_[i]->project(points_, projections_);
       //global solve:  merging
-      SHAPEOP_OMP_FOR for (int i = 0; i < 3; ++i)
-        points_.row(i) = solver_->solve(At_ * projections_.row(i).transpose() + M_ * momentum_.row(i).transpose(), points_.row(i).transpose()).transpose(); //TODO: should At_ nd M_ be row major? Temporary variables?
+      if (globalSolver_ == GlobalSolver::LDLT) {
+        SHAPEOP_OMP_FOR for (int i = 0; i < 3; ++i) {
+          if (inertia)
+            points_.row(i) = solver_->solve(At_ * projections_.row(i).transpose() + M_ * momentum_.row(i).transpose(), points_.row(i).transpose()).transpose();
+          else
+            points_.row(i) = solver_->solve(At_ * projections_.row(i).transpose(), points_.row(i).transpose()).transpose();
+        }
+      } else {
+        //all three coordinates of an unknown at once, rows of At_ in parallel
+        SHAPEOP_OMP_FOR for (int i = 0; i < static_cast<int>(At_.rows()); ++i) {
+          Vector3 b = Vector3::Zero();
+          for (SparseMatrixT<Eigen::RowMajor>::InnerIterator it(At_, i); it; ++it) b += it.value() * projections_.col(it.index());
+          if (inertia)
+            for (SparseMatrix::InnerIterator it(M_, i); it; ++it) b += it.value() * momentum_.col(it.index()); //M_ is symmetric
+          rhs_.col(i) = b;
+        }
+        SHAPEOP_OMP_SINGLE
+        points_ = solver_->solveMultiple(rhs_, points_);
+      }
     }
   }
   if (dynamic_) {
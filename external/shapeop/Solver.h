@@ -25,15 +25,32 @@ namespace ShapeOp {
 // Forward Declarations
 class LSSolver;
 class Constraint;
+class ConstraintSet;
 class Force;
 ///////////////////////////////////////////////////////////////////////////////
 /** \brief ShapeOp Solver. This class implements the main ShapeOp solver based on \cite Bouaziz2012 and \cite Bouaziz2014.*/
 class SHAPEOP_API Solver {
  public:
+  /** \brief Linear solvers for the global step.*/
+  enum class GlobalSolver {
+    LDLT,          ///< Cholesky factorization, one backsubstitution per coordinate (default).
+    LDLTMultiRHS,  ///< Cholesky factorization, the three coordinates are solved in one pass over the factor.
+    CG             ///< Preconditioned conjugate gradient warm started at the current points, for very large systems.
+  };
+  /** \brief Select the linear solver of the global step. Has to be called before #initialize.
+  \param cgIterations Maximum number of CG iterations per global step (only used by GlobalSolver::CG).*/
+  void setGlobalSolver(GlobalSolver type, unsigned int cgIterations = 10);
   /** \brief Add a constraint to the solver and get back its id.*/
   int addConstraint(const std::shared_ptr<Constraint> &c);
   /** \brief Get a constraint using its id.*/
   std::shared_ptr<Constraint> &getConstraint(int id);
+  /** \brief Remove all constraints (e.g. to add updated ones before #refactorize). Constraint sets are kept.*/
+  void clearConstraints();
+  /** \brief Add a set of constraints of one type (see ConstraintSet.h) and get back its id.
+  Sets are owned by the caller and can be refilled before #refactorize, their rows follow the single constraints.*/
+  int addConstraintSet(const std::shared_ptr<ConstraintSet> &s);
+  /** \brief Get a constraint set using its id.*/
+  std::shared_ptr<ConstraintSet> &getConstraintSet(int id);
   /** \brief Add a force to the solver and get back its id.*/
   int addForces(const std::shared_ptr<Force> &f);
   /** \brief Get a force using its id.*/
@@ -49,20 +66,35 @@ class SHAPEOP_API Solver {
   /** \brief Initialize the ShapeOp linear system and the different parameters.
   \return true if successfull */
   bool initialize(bool dynamic = false, Scalar masses = 1.0, Scalar damping = 1.0, Scalar timestep = 1.0);
+  /** \brief Rebuild the linear system after constraint weights or targets changed, keeping the dynamic parameters.
+  If the sparsity pattern of the system is unchanged (same constraint types on the same vertices, in the same order),
+  the symbolic factorization is reused and only the numeric factorization is recomputed.
+  Otherwise (or if the solver was never initialized) this falls back to #initialize.
+  \return true if successfull */
+  bool refactorize();
   /** \brief Solve the constraint problem by projecting and merging.
     \return true if successfull */
   bool solve(unsigned int iteration);
  private:
   typedef std::vector<std::shared_ptr<Constraint> > Constraints;
   typedef std::vector<std::shared_ptr<Force> > Forces;
+  typedef std::vector<std::shared_ptr<ConstraintSet> > ConstraintSets;
+
+  /** \brief Assemble the rows of all constraints and constraint sets.*/
+  SparseMatrix assemble() const;
 
 //Static
   Matrix3X points_;
   Matrix3X projections_;
   Constraints constraints_;
+  ConstraintSets constraintSets_;
   std::shared_ptr<LSSolver> solver_;
-  SparseMatrix At_;
+  GlobalSolver globalSolver_ = GlobalSolver::LDLT;
+  unsigned int cgIterations_ = 10;
+  /** \brief row major, the right hand side of each unknown is one sparse row times the projections.*/
+  SparseMatrixT<Eigen::RowMajor> At_;
   SparseMatrix N_;
+  Matrix3X rhs_;
 
 //Dynamic
   bool dynamic_;
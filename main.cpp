@@ -1,6 +1,7 @@
 #include <argparse/argparse.hpp>
 #include <fmt/core.h>
 
+#include "src/BatchFitting.h"
 #include "src/Constants.h"
 #include "src/Globals.h"
 #include "src/TailorMeViewer.h"
@@ -26,6 +27,26 @@ auto main(int argc, const char* argv[]) -> int {
             )
         );
 
+    // headless batch fitting
+    program.add_argument("--batch-fit")
+        .help("Fit all targets of a gender (male or female) without window and exit.");
+    program.add_argument("--batch-input")
+        .help("Directory of targets. Defaults to <data>/caesar_fits/<gender>.");
+    program.add_argument("--batch-results")
+        .help("Results file (one json line per subject), existing results are skipped. Defaults to batch_fit_<gender>.jsonl.");
+    program.add_argument("--workers")
+        .default_value(0)
+        .scan<'i', int>()
+        .help("Number of worker threads, 0 = one per core.");
+    program.add_argument("--shard-index")
+        .default_value(0)
+        .scan<'i', int>()
+        .help("Index of this process if several processes share the targets.");
+    program.add_argument("--shard-count")
+        .default_value(1)
+        .scan<'i', int>()
+        .help("Number of processes sharing the targets.");
+
     try {
         program.parse_args(argc, argv);
     } catch (const std::runtime_error& err) {
@@ -38,6 +59,35 @@ auto main(int argc, const char* argv[]) -> int {
     globals::data_dir = program.get("data");
     std::cout << "Model directory: " << globals::model_dir << '\n';
 
+    if (program.present("--batch-fit")) {
+        std::string gender = program.get("--batch-fit");
+        if (gender != "male" && gender != "female") {
+            std::cerr << "--batch-fit expects male or female.\n";
+            std::exit(1);
+        }
+
+        BatchFittingSettings settings;
+        settings.mesh_type = gender == "male" ? MESH_MALE : MESH_FEMALE;
+        settings.input_dir = (std::filesystem::path(globals::data_dir) / "caesar_fits" / gender).string();
+        if (auto input_dir = program.present("--batch-input")) {
+            settings.input_dir = *input_dir;
+        }
+        settings.results_file = fmt::format("batch_fit_{}.jsonl", gender);
+        if (auto results_file = program.present("--batch-results")) {
+            settings.results_file = *results_file;
+        }
+        settings.workers = program.get<int>("--workers");
+        settings.shard_index = program.get<int>("--shard-index");
+        settings.shard_count = program.get<int>("--shard-count");
+        if (settings.shard_count < 1 || settings.shard_index < 0 || settings.shard_index >= settings.shard_count) {
+            std::cerr << "--shard-index must be in [0, --shard-count).\n";
+            std::exit(1);
+        }
+
+        BatchFitting batch_fitting(settings);
+        return batch_fitting.run();
+    }
+
 
     // create main window
     TailorMeViewer window("TailorMe Viewer", 1400, 900);
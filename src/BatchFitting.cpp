@@ -0,0 +1,291 @@
+//======================================================================================================================
+// Copyright (c) the Authors 2024
+//
+// This work is licensed under a
+// Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+//
+// You should have received a copy of the license along with this
+// work. If not, see <http://creativecommons.org/licenses/by-nc-sa/4.0/>.
+//
+//======================================================================================================================
+
+// torch has to be the first include, to prevent namespace clash with pmp::Scalar
+#include <torch/torch.h>
+
+#include "BatchFitting.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include <utility>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+#endif
+
+#include <nlohmann/json.hpp>
+#include <pmp/io/io.h>
+
+#include "models/SpiralNetAEModel.h"
+#include "utils/name_utils.h"
+
+// =====================================================================================================================
+
+using json = nlohmann::json;
+
+// =====================================================================================================================
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+BatchFitting::BatchFitting(BatchFittingSettings settings)
+    : _settings(std::move(settings))
+{
+    _settings.shard_count = std::max(1, _settings.shard_count);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto BatchFitting::subject_name(const std::string& filename) -> std::string
+{
+    std::string name = std::filesystem::path(filename).stem().string();
+    const std::string suffix = "_skin";
+    if (name.size() > suffix.size() && name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0) {
+        name.resize(name.size() - suffix.size());
+    }
+    return name;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto BatchFitting::_enumerate_targets() -> std::vector<std::string>
+{
+    std::vector<std::string> targets;
+    if (!std::filesystem::is_directory(_settings.input_dir)) {
+        std::cerr << "[Error] Batch fitting: " << _settings.input_dir << " is not a directory.\n";
+        return targets;
+    }
+
+    for (const auto& entry : std::filesystem::directory_iterator(_settings.input_dir)) {
+        auto extension = entry.path().extension().string();
+        if (entry.is_regular_file() && (extension == ".off" || extension == ".obj")) {
+            targets.push_back(entry.path().string());
+        }
+    }
+
+    // same order in every process, then take every shard_count-th subject
+    std::sort(targets.begin(), targets.end());
+    std::vector<std::string> shard;
+    for (size_t i = 0; i < targets.size(); ++i) {
+        if (static_cast<int>(i % _settings.shard_count) == _settings.shard_index) {
+            shard.push_back(targets[i]);
+        }
+    }
+    return shard;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto BatchFitting::_read_finished() -> std::set<std::string>
+{
+    std::set<std::string> finished;
+    if (!std::filesystem::exists(_settings.results_file)) {
+        return finished;
+    }
+
+    std::string content;
+#ifndef _WIN32
+    // lock against other shards, a crash may have left a partial last line, which is cut off
+    int fd = ::open(_settings.results_file.c_str(), O_RDWR);
+    if (fd < 0) {
+        std::cerr << "[Error] Batch fitting: Cannot open " << _settings.results_file << '\n';
+        return finished;
+    }
+    ::flock(fd, LOCK_EX);
+    {
+        std::ifstream in(_settings.results_file, std::ios::binary);
+        content.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+    if (!content.empty() && content.back() != '\n') {
+        size_t end = content.rfind('\n');
+        content.resize(end == std::string::npos ? 0 : end + 1);
+        if (::ftruncate(fd, static_cast<off_t>(content.size())) != 0) {
+            std::cerr << "[Error] Batch fitting: Cannot remove partial line of " << _settings.results_file << '\n';
+        }
+    }
+    ::flock(fd, LOCK_UN);
+    ::close(fd);
+#else
+    std::ifstream in(_settings.results_file, std::ios::binary);
+    content.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+#endif
+
+    std::stringstream lines(content);
+    std::string line;
+    while (std::getline(lines, line)) {
+        json result = json::parse(line, nullptr, false);
+        if (!result.is_discarded() && result.contains("subject")) {
+            finished.insert(result["subject"].get<std::string>());
+        }
+    }
+    return finished;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto BatchFitting::_append_result(const std::string& line) -> bool
+{
+    std::lock_guard<std::mutex> lock(_results_mutex);
+
+#ifndef _WIN32
+    // one write to a file opened with O_APPEND, locked for other processes
+    int fd = ::open(_settings.results_file.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    ::flock(fd, LOCK_EX);
+    ssize_t written = ::write(fd, line.data(), line.size());
+    ::fsync(fd);
+    ::flock(fd, LOCK_UN);
+    ::close(fd);
+    return written == static_cast<ssize_t>(line.size());
+#else
+    std::ofstream out(_settings.results_file, std::ios::app | std::ios::binary);
+    out << line;
+    out.flush();
+    return out.good();
+#endif
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto BatchFitting::_fit_subject(BaseModel& model, const std::string& filename) -> std::string
+{
+    auto start_time = std::chrono::steady_clock::now();
+
+    pmp::SurfaceMesh mesh;
+    try {
+        pmp::read(mesh, filename);
+    } catch (std::exception& exception) {
+        std::cerr << "[Error] Cannot read " << filename << ": " << exception.what() << '\n';
+        return {};
+    }
+
+    ArrayXf target(static_cast<long>(mesh.n_vertices()) * 3);
+    std::memcpy(target.data(), mesh.positions().data()->data(), target.size() * sizeof(float));
+
+    // template topology or raw scan
+    ArrayXf target_skin = target;
+    ArrayXf latent{};
+    if (mesh.n_vertices() == model.get_mean_skin().n_vertices()) {
+        latent = model.fit_latent(target, nullptr);
+    } else {
+        latent = model.fit_scan_latent(target, target_skin, nullptr);
+    }
+    if (latent.size() != model.latent_channels_sum() || target_skin.size() == 0) {
+        std::cerr << "[Error] Fitting failed for " << filename << '\n';
+        return {};
+    }
+
+    // mean vertex distance of the fitted skin
+    model.set_inference_mode(InferenceMode::NORMAL);
+    ArrayXf points = model.inference(latent);
+    long skel_size = static_cast<long>(model.get_mean_skel().n_vertices()) * 3;
+    if (points.size() != skel_size + target_skin.size()) {
+        std::cerr << "[Error] Unexpected model output for " << filename << '\n';
+        return {};
+    }
+    Eigen::Map<const Eigen::MatrixXf> fit(points.data() + skel_size, 3, target_skin.size() / 3);
+    Eigen::Map<const Eigen::MatrixXf> goal(target_skin.data(), 3, target_skin.size() / 3);
+    double error_mm = (fit - goal).colwise().norm().mean() * 1000.0;
+
+    double time_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count();
+
+    json result;
+    result["subject"] = subject_name(filename);
+    result["file"] = filename;
+    result["gender"] = NameUtils::mesh_type_str(_settings.mesh_type);
+    result["error_mm"] = error_mm;
+    result["time_ms"] = time_ms;
+    result["latent"] = std::vector<float>(latent.data(), latent.data() + latent.size());
+    return result.dump() + '\n';
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto BatchFitting::run() -> int
+{
+    std::vector<std::string> targets = _enumerate_targets();
+    std::set<std::string> finished = _read_finished();
+
+    std::vector<std::string> queue;
+    for (const auto& target : targets) {
+        if (finished.count(subject_name(target)) == 0) {
+            queue.push_back(target);
+        }
+    }
+    std::cout << "Batch fitting shard " << _settings.shard_index << "/" << _settings.shard_count << ": "
+              << targets.size() << " targets, " << targets.size() - queue.size() << " already fitted.\n";
+    if (queue.empty()) {
+        return 0;
+    }
+
+    // one worker per core, torch gets the remaining cores
+    int cores = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    int workers = _settings.workers > 0 ? _settings.workers : cores;
+    workers = std::min(workers, static_cast<int>(queue.size()));
+    torch::set_num_threads(std::max(1, cores / workers));
+
+    // load models sequentially, every worker fits with its own model
+    std::vector<std::unique_ptr<BaseModel>> models;
+    for (int worker = 0; worker < workers; ++worker) {
+        models.emplace_back(new SpiralNetAEModel());
+        models.back()->set_mesh_type(_settings.mesh_type);
+        if (!models.back()->inference_available()) {
+            std::cerr << "[Error] Batch fitting: Model not available.\n";
+            return 1;
+        }
+    }
+
+    std::atomic<size_t> next_target{0};
+    std::atomic<int> fitted{0};
+    std::atomic<int> failed{0};
+    std::mutex print_mutex;
+
+    std::vector<std::thread> threads;
+    for (int worker = 0; worker < workers; ++worker) {
+        threads.emplace_back([&, worker]() {
+            for (size_t index = next_target++; index < queue.size(); index = next_target++) {
+                std::string line = _fit_subject(*models[worker], queue[index]);
+                bool success = !line.empty() && _append_result(line);
+                if (success) {
+                    fitted++;
+                } else {
+                    failed++;
+                }
+
+                std::lock_guard<std::mutex> lock(print_mutex);
+                std::cout << "[" << fitted + failed << "/" << queue.size() << "] " << subject_name(queue[index])
+                          << (success ? " done\n" : " failed\n");
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    std::cout << "Batch fitting finished: " << fitted << " fitted, " << failed << " failed.\n";
+    return failed > 0 ? 1 : 0;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+// =====================================================================================================================
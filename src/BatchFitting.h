@@ -0,0 +1,70 @@
+//======================================================================================================================
+// Copyright (c) the Authors 2024
+//
+// This work is licensed under a
+// Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+//
+// You should have received a copy of the license along with this
+// work. If not, see <http://creativecommons.org/licenses/by-nc-sa/4.0/>.
+//
+//======================================================================================================================
+
+#ifndef TAILORME_VIEWER_BATCHFITTING_H
+#define TAILORME_VIEWER_BATCHFITTING_H
+
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "meshes/BaseMesh.h"
+#include "models/BaseModel.h"
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+struct BatchFittingSettings {
+    MeshType mesh_type = MESH_MALE;
+    // directory with <subject>_skin.off targets
+    std::string input_dir{};
+    // one json line per fitted subject, appended
+    std::string results_file{};
+    // 0 = one per core
+    int workers = 0;
+    // split the sorted subject list over several processes (every shard_count-th subject)
+    int shard_index = 0;
+    int shard_count = 1;
+};
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+// Headless fitting of many targets (e.g. data/caesar_fits/<gender>) without the viewer.
+// Workers pull subjects from a shared queue, every worker owns its model.
+// Each result is appended as a single line (locked, one write), so a crash never loses finished subjects.
+// Subjects already in the results file are skipped (resume).
+class BatchFitting {
+  protected:
+    BatchFittingSettings _settings{};
+    std::mutex _results_mutex{};
+
+    // sorted target files of this shard
+    auto _enumerate_targets() -> std::vector<std::string>;
+    // subjects already in the results file, removes a partially written last line
+    auto _read_finished() -> std::set<std::string>;
+    // append one result line (atomic)
+    auto _append_result(const std::string& line) -> bool;
+    // fit one target, returns result line (empty on failure)
+    auto _fit_subject(BaseModel& model, const std::string& filename) -> std::string;
+
+  public:
+    explicit BatchFitting(BatchFittingSettings settings);
+
+    // returns process exit code
+    auto run() -> int;
+
+    // subject name from filename, e.g. /a/b/4000_skin.off -> 4000
+    static auto subject_name(const std::string& filename) -> std::string;
+};
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+#endif // TAILORME_VIEWER_BATCHFITTING_H
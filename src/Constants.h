@@ -27,5 +27,17 @@ const std::string MATCAP_SKIN = "matcap-skin.jpg";
 #define SKEL_PARTIAL_WRAP_VERTICES 13391
 #define SKIN_VERTICES 23752
 
+// rays for the tissue thickness map end here (in m)
+#define TISSUE_THICKNESS_MAX 0.3F
+
+// rbf warp of the bones: centers besides the head ones, entry tolerance of the bone operator
+#define RBF_ADDITIONAL_CENTERS 4800
+#define RBF_OPERATOR_TOLERANCE 1e-5F
+
+// sparse bone warp: centers besides the head ones, centers of the coarsest level, support in center spacings
+#define RBF_SPARSE_ADDITIONAL_CENTERS 14400
+#define RBF_SPARSE_COARSE_CENTERS 64
+#define RBF_SPARSE_SUPPORT_FACTOR 5.0
+
 
 #endif //TAILORME_VIEWER_CONSTANTS_H
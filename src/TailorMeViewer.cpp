@@ -18,6 +18,7 @@
 #include "TailorMeViewer.h"
 
 #include "algorithms/MeshIntersection.h"
+#include "algorithms/MeshMeasurements.h"
 #include "models/SpiralNetAEModel.h"
 
 #include "mesh_massage/post_proc_face_mirror.h"
@@ -51,6 +52,9 @@ TailorMeViewer::TailorMeViewer(const char *title, int width, int height, bool sh
     // create bounding box for humans
     update_bb();
 
+    // fitted latents are memoized next to the models
+    _fit_cache.set_directory((std::filesystem::path(globals::model_dir) / "fit_cache").string());
+
     // load default model & mesh
     set_model(ModelType::MODEL_SPIRAL_AE);
     set_mesh(MeshType::MESH_MALE);
@@ -84,6 +88,8 @@ void TailorMeViewer::update_meshes()
 
 void TailorMeViewer::do_processing()
 {
+    update_fitting_job();
+
     _optimization_suitable = _frames_without_user_interaction > 10;
 
     if (_optimization_required && _optimization_suitable)
@@ -116,6 +122,7 @@ void TailorMeViewer::process_imgui()
     process_imgui_model();
     process_imgui_weights();
     process_imgui_fitting();
+    process_imgui_measurements();
 }
 
 
@@ -430,7 +437,7 @@ auto TailorMeViewer::process_imgui_fitting() -> void
         }
 
         if (ImGui::Button("Load target")) {
-            ImGuiFileDialog::Instance()->OpenDialog("ChooseFileDlgKey", "Choose target file", ".off,.obj", ".", 1, nullptr, ImGuiFileDialogFlags_Modal);
+            ImGuiFileDialog::Instance()->OpenDialog("ChooseFileDlgKey", "Choose target file", ".off,.obj,.xyz", ".", 1, nullptr, ImGuiFileDialogFlags_Modal);
         }
 
         // display open file dialog
@@ -455,6 +462,15 @@ auto TailorMeViewer::process_imgui_fitting() -> void
             _show_target_mesh = false;
         }
 
+        // running fit
+        if (_fitting_job.active() && _fitting_job.monitor() != nullptr) {
+            ImGui::ProgressBar(_fitting_job.monitor()->progress(), ImVec2(ImGui::GetWindowWidth() * SLIDER_WIDTH * 0.68F, 0.0F));
+            ImGui::SameLine();
+            if (ImGui::Button("Cancel##Fitting")) {
+                _fitting_job.cancel();
+            }
+        }
+
         ImGui::Spacing();
         ImGui::Checkbox("Show Target", &_show_target_mesh);
         if (ImGui::Checkbox("Delta inference", &_inference_mode_delta)) {
@@ -482,6 +498,71 @@ auto TailorMeViewer::process_imgui_fitting() -> void
                 update_meshes();
             }
         }
+
+        ImGui::Spacing();
+        bool thickness_changed = ImGui::Checkbox("Tissue thickness", &_show_tissue_thickness);
+        ImGui::SameLine();
+        thickness_changed |= ImGui::Checkbox("to bones##TissueThickness", &_tissue_thickness_to_bones);
+        if (thickness_changed && _mesh != nullptr) {
+            _mesh->show_tissue_thickness(_show_tissue_thickness, _tissue_thickness_to_bones ? LayerBone : LayerSkel);
+        }
+        if (_show_tissue_thickness) {
+            ImGui::SameLine();
+            if (ImGui::Button("Save##TissueThickness") && _mesh != nullptr) {
+                _mesh->save_tissue_thickness("tissue_thickness.vw");
+            }
+        }
+
+        if (ImGui::Checkbox("Sparse bone warp", &_sparse_bone_warp) && _mesh != nullptr) {
+            _mesh->set_sparse_bone_warp(_sparse_bone_warp);
+            _mesh->optimize_meshes();
+            update_meshes();
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Compare##BoneWarp") && _mesh != nullptr) {
+            _mesh->compare_bone_warps();
+        }
+        ImGui::Spacing();
+    }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+auto TailorMeViewer::process_imgui_measurements() -> void
+{
+    if (ImGui::CollapsingHeader("Measurements")) {
+        if (_target_measurements.size() != MEASUREMENT_COUNT) {
+            _target_measurements.assign(MEASUREMENT_COUNT, 0.0F);
+        }
+
+        ImGui::Text("Target measurements in cm (0 = ignore)");
+        ImGui::PushItemWidth(ImGui::GetWindowWidth() * SLIDER_WIDTH * 0.68F);
+        for (int measurement = 0; measurement < MEASUREMENT_COUNT; ++measurement) {
+            std::string label = get_measurement_name(measurement) + "##Measurement" + std::to_string(measurement);
+            ImGui::InputFloat(label.c_str(), &_target_measurements[measurement], 0.0F, 0.0F, "%.1f");
+        }
+        ImGui::PopItemWidth();
+
+        if (ImGui::Button("Measure current") && _mesh != nullptr && _mesh->get_skin() != nullptr) {
+            VectorXf measurements = get_body_measurements(*_mesh->get_skin());
+            for (int measurement = 0; measurement < MEASUREMENT_COUNT; ++measurement) {
+                _target_measurements[measurement] = measurements[measurement] * 100.0F;
+            }
+        }
+
+        ImGui::SameLine();
+        if (ImGui::Button("Solve##Measurements") && _model != nullptr) {
+            fit_measurements();
+        }
+
+        // achieved measurements
+        const VectorXf& solved = _measurement_solver.get_solved_measurements();
+        if (solved.size() == MEASUREMENT_COUNT) {
+            ImGui::Spacing();
+            for (int measurement = 0; measurement < MEASUREMENT_COUNT; ++measurement) {
+                ImGui::Text("%s: %.1f cm", get_measurement_name(measurement).c_str(), solved[measurement] * 100.0F);
+            }
+        }
         ImGui::Spacing();
     }
 }
@@ -491,8 +572,14 @@ auto TailorMeViewer::process_imgui_fitting() -> void
 auto TailorMeViewer::set_mesh(MeshType mesh_type) -> void
 {
     if (_mesh_type != mesh_type) {
+        // running fit belongs to the old model
+        _fitting_job.cancel();
+
         _mesh_type = mesh_type;
 
+        // regressor belongs to the model of the mesh type
+        _measurement_solver.reset();
+
         // free old mesh (if not nullptr)
         delete _mesh;
 
@@ -509,6 +596,12 @@ auto TailorMeViewer::set_mesh(MeshType mesh_type) -> void
         }
 
         if (_mesh != nullptr) {
+            // keep the thickness map of the previous mesh
+            if (_show_tissue_thickness) {
+                _mesh->show_tissue_thickness(true, _tissue_thickness_to_bones ? LayerBone : LayerSkel);
+            }
+            _mesh->set_sparse_bone_warp(_sparse_bone_warp);
+
             // update postprocessing filter
             for (auto& filter : _post_processing_filters) {
                 filter->update_meshes(
@@ -547,6 +640,8 @@ auto TailorMeViewer::set_mesh(MeshType mesh_type) -> void
 void TailorMeViewer::set_model(ModelType model_type)
 {
     if (_model_type != model_type) {
+        _fitting_job.cancel();
+
         _model_type = model_type;
         // free old model (null pointers get not deleted)
         delete _model;
@@ -587,6 +682,7 @@ auto TailorMeViewer::rescale_weight_magnitude(float weight_magnitude) -> void
 auto TailorMeViewer::load_target(const std::string& filename) -> void
 {
     std::cout << "Open target " << filename << '\n';
+    _fitting_job.cancel();
     _target_skin.open_file(filename);
     init_head_stitcher();
 }
@@ -600,22 +696,161 @@ auto TailorMeViewer::fit_target() -> void
         return;
     }
 
+    // previous fit is cancelled by start
     VectorXf target = _target_skin.get_mesh_points();
-    if (static_cast<unsigned long> (target.size()) == _model->get_mean_skin().n_vertices() * 3) {
-        _weight_magnitude = 0.0F; // reset weight magnitude
-        _model->fit_target();
-        _latent_variables = _model->get_latent_fit();
+    _weight_magnitude = 0.0F; // reset weight magnitude
+    _fitting_preview_version = 0;
+
+    // intermediate results are shown by normal inference
+    _model->set_inference_mode(InferenceMode::NORMAL);
+    _inference_mode_delta = false;
+
+    // fitted before?
+    _fitting_scan = static_cast<unsigned long> (target.size()) != _model->get_mean_skin().n_vertices() * 3;
+    _fitting_cache_key = _fit_cache.key(target, _model->get_model_filename(), _model->fit_settings(_fitting_scan));
+    FitCacheEntry entry;
+    if (_fit_cache.lookup(_fitting_cache_key, entry) && entry.latent.size() == _model->latent_channels_sum()) {
+        std::cout << "Fit cache hit, error " << entry.error_mm << " mm\n";
+        _fitting_job.cancel();
+        ArrayXf target_skin = _fitting_scan ? entry.registered_skin : ArrayXf(target);
+        commit_fit(entry.latent, target_skin, entry.target_skin_fit);
+        return;
+    }
 
-        // enable delta mode
-        _model->set_inference_mode(InferenceMode::FITTING_DELTA);
-        _inference_mode_delta = true;
+    BaseModel* model = _model;
+    if (!_fitting_scan) {
+        _fitting_target = target;
 
-        generate_meshes();
+        ArrayXf target_skin = target;
+        _fitting_job.start([model, target_skin](FitMonitor& monitor) {
+            return model->fit_latent(target_skin, &monitor);
+        }, FIT_PREVIEW_INTERVAL);
     } else {
-        std::cerr << "Cannot fit! target_vertices=" << target.size() / 3 << " skin_vertices=" << _model->get_mean_skin().n_vertices() << '\n';
+        // raw scan without template correspondences (icp + latent optimization)
+        std::cout << "Target is not in template topology, fitting as raw scan. target_vertices=" << target.size() / 3
+                  << " skin_vertices=" << _model->get_mean_skin().n_vertices() << '\n';
+        _fitting_registered_skin = std::make_shared<ArrayXf>();
+
+        ArrayXf scan_points = target;
+        std::shared_ptr<ArrayXf> registered_skin = _fitting_registered_skin;
+        _fitting_job.start([model, scan_points, registered_skin](FitMonitor& monitor) {
+            return model->fit_scan_latent(scan_points, *registered_skin, &monitor);
+        }, FIT_PREVIEW_INTERVAL);
+    }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+auto TailorMeViewer::update_fitting_job() -> void
+{
+    if (!_fitting_job.active() || _model == nullptr) {
+        return;
+    }
+
+    // progressive preview
+    if (!_fitting_job.finished()) {
+        ArrayXf latent{};
+        if (_fitting_job.monitor()->latest_latent(latent, _fitting_preview_version)
+            && latent.size() == _model->latent_channels_sum())
+        {
+            _latent_variables = latent;
+            generate_meshes();
+        }
+        return;
+    }
+
+    ArrayXf latent = _fitting_job.take_result();
+    if (latent.size() != _model->latent_channels_sum()) {
+        std::cerr << "[Error] Fitting failed.\n";
+        return;
+    }
+
+    ArrayXf target_skin = _fitting_target;
+    if (_fitting_scan) {
+        target_skin = *_fitting_registered_skin;
+    }
+    if (!commit_fit(latent, target_skin, ArrayXf{})) {
+        return;
+    }
+
+    // memoize fit
+    FitCacheEntry entry;
+    entry.latent = latent;
+    entry.target_skin_fit = _model->get_target_skin_fit();
+    if (_fitting_scan) {
+        entry.registered_skin = target_skin;
+    }
+    if (entry.target_skin_fit.size() == target_skin.size()) {
+        Eigen::Map<const Eigen::MatrixXf> fit(entry.target_skin_fit.data(), 3, target_skin.size() / 3);
+        Eigen::Map<const Eigen::MatrixXf> goal(target_skin.data(), 3, target_skin.size() / 3);
+        entry.error_mm = static_cast<float>((fit - goal).colwise().norm().mean() * 1000.0);
+        _fit_cache.store(_fitting_cache_key, entry);
     }
 }
 
+//----------------------------------------------------------------------------------------------------------------------
+
+auto TailorMeViewer::commit_fit(const ArrayXf& latent, ArrayXf& target_skin, const ArrayXf& target_skin_fit) -> bool
+{
+    if (target_skin.size() != static_cast<long>(_model->get_mean_skin().n_vertices() * 3)) {
+        std::cerr << "[Error] Fitting failed, target skin does not match the model.\n";
+        return false;
+    }
+
+    // commit fit (x and z)
+    _model->set_target_skin(target_skin);
+    _model->set_latent_fit(latent, target_skin_fit);
+    _latent_variables = _model->get_latent_fit();
+
+    // registered scan replaces the target head for stitching
+    if (_fitting_scan) {
+        stitch_target_head(target_skin);
+    }
+
+    // enable delta mode
+    _model->set_inference_mode(InferenceMode::FITTING_DELTA);
+    _inference_mode_delta = true;
+
+    generate_meshes();
+    return true;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+auto TailorMeViewer::fit_measurements() -> void
+{
+    if (_model == nullptr || !_model->inference_available()) {
+        std::cerr << "[ERROR] Cannot fit measurements. No model loaded." << std::endl;
+        return;
+    }
+
+    // first use learns the regressor (or loads it from disk)
+    if (!_measurement_solver.initialized() && !_measurement_solver.init(*_model)) {
+        std::cerr << "[Error] Measurement solver could not be initialized.\n";
+        return;
+    }
+
+    VectorXf measurements(MEASUREMENT_COUNT);
+    VectorXf weights(MEASUREMENT_COUNT);
+    for (int measurement = 0; measurement < MEASUREMENT_COUNT; ++measurement) {
+        measurements[measurement] = _target_measurements[measurement] / 100.0F;
+        weights[measurement] = _target_measurements[measurement] > 0.0F ? 1.0F : 0.0F;
+    }
+
+    ArrayXf latent = _measurement_solver.solve(*_model, measurements, weights);
+    if (latent.size() != _model->latent_channels_sum()) {
+        return;
+    }
+
+    _weight_magnitude = 0.0F;
+    _latent_variables = latent;
+
+    // measurements describe the whole body, no target delta
+    _model->set_inference_mode(InferenceMode::NORMAL);
+    _inference_mode_delta = false;
+
+    generate_meshes();
+}
 
 // ---------------------------------------------------------------------------------------------------------------------
 
@@ -650,14 +885,21 @@ auto TailorMeViewer::init_head_stitcher() -> void
     ArrayXf points = _target_skin.get_mesh_points();
     _model->set_target_skin(points);
 
+    stitch_target_head(points);
+    generate_meshes();
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+auto TailorMeViewer::stitch_target_head(ArrayXf& points) -> void
+{
     if (_mesh != nullptr && _mesh->get_skin() != nullptr && (_mesh_type == MESH_FEMALE || _mesh_type == MESH_MALE)
-            && _target_skin.get_mesh().n_vertices() == _mesh->get_skin()->n_vertices())
+            && static_cast<long>(_mesh->get_skin()->n_vertices() * 3) == points.size())
     {
         std::cout << "Loaded new head \n";
         _mesh->update_layer_points(points, MeshLayer::LayerSkin);
         _mesh_stitcher.init(*_mesh->get_skin(), RESOURCE_DATA_DIR + "/head_inverse.sel");
     }
-    generate_meshes();
 }
 
 //----------------------------------------------------------------------------------------------------------------------
@@ -19,6 +19,9 @@
 #include "algorithms/MeshStitching.h"
 
 #include "models/BaseModel.h"
+#include "models/FitCache.h"
+#include "models/FittingJob.h"
+#include "models/MeasurementSolver.h"
 
 #include "meshes/BodyMesh.h"
 #include "meshes/TargetSkinMesh.h"
@@ -30,6 +33,9 @@
 
 #define WEIGHT_MAGNITUDE_BASE 10.0F
 
+// show intermediate fitting result every n optimizer steps
+#define FIT_PREVIEW_INTERVAL 5
+
 
 // ---------------------------------------------------------------------------------------------------------------------
 
@@ -62,9 +68,22 @@ protected:
 
     Mesh_stitcher _mesh_stitcher;
 
+    // measurement driven fitting, target values in cm (0 = ignored)
+    MeasurementSolver _measurement_solver{};
+    std::vector<float> _target_measurements{};
+
     // input variables
     ArrayXf _latent_variables{};
 
+    // background fitting (target in template topology or raw scan)
+    FittingJob _fitting_job{};
+    int _fitting_preview_version = 0;
+    bool _fitting_scan = false;
+    ArrayXf _fitting_target{};
+    std::shared_ptr<ArrayXf> _fitting_registered_skin{};
+    std::string _fitting_cache_key{};
+    FitCache _fit_cache{};
+
     // scale of latent variables - exponential
     float _weight_magnitude = 0.0;
 
@@ -86,6 +105,13 @@ protected:
     bool _show_target_mesh = false;
     bool _inference_mode_delta = false;
 
+    //! soft tissue thickness of the skin (to the skel wrap or the bones) as texture
+    bool _show_tissue_thickness = false;
+    bool _tissue_thickness_to_bones = false;
+
+    //! bones warped by the sparse instead of the dense rbf
+    bool _sparse_bone_warp = false;
+
     //! post processing
     bool _post_processing_enabled = true;
 
@@ -108,6 +134,7 @@ protected:
     auto process_imgui_model() -> void;
     auto process_imgui_weights() -> void;
     auto process_imgui_fitting() -> void;
+    auto process_imgui_measurements() -> void;
 
     // create initial bouding box and view angle
     void update_bb();
@@ -120,9 +147,15 @@ protected:
     // -- load target
     auto load_target(const std::string& filename) -> void;
     auto fit_target() -> void;
+    // preview running fit, commit finished fit
+    auto update_fitting_job() -> void;
+    // set target skin and latent fit, switch to delta inference
+    auto commit_fit(const ArrayXf& latent, ArrayXf& target_skin, const ArrayXf& target_skin_fit) -> bool;
+    auto fit_measurements() -> void;
 
     auto perform_post_processing() -> void;
     auto init_head_stitcher() -> void;
+    auto stitch_target_head(ArrayXf& points) -> void;
 };
 
 
@@ -0,0 +1,265 @@
+//-----------------------------------------------------------------------------
+
+#include "BoneCollisionResolve.h"
+
+#include <chrono>
+
+#include <pmp/algorithms/normals.h>
+
+#include <shapeop/Solver.h>
+#include <shapeop/ConstraintSet.h>
+
+//-----------------------------------------------------------------------------
+
+// weights of the projection system, relative to closeness 1 (the bending weights of ShapeOp grow with
+// the inverse edge length, bone triangles are small)
+#define BONE_PLANE_WEIGHT 1000.0
+#define BONE_BENDING_WEIGHT 0.01
+// local/global iterations per projection step
+#define BONE_SOLVE_ITERATIONS 5
+// detection / projection rounds per resolve
+#define BONE_MAX_ROUNDS 20
+
+//-----------------------------------------------------------------------------
+
+bool init_bone_collision_context(const pmp::SurfaceMesh& bones,
+                                 BoneCollisionContext& out_context)
+{
+    if (!bones.is_triangle_mesh())
+    {
+        printf("[ERROR] init_bone_collision_context(): Only triangle meshes are supported\n");
+        return false;
+    }
+
+    BoneCollisionContext& ctx = out_context;
+    ctx = BoneCollisionContext();
+    ctx.n_vertices = bones.vertices_size();
+
+    int n = (int)ctx.n_vertices;
+    ShapeOp::Matrix3X points(3, n);
+    for (auto v : bones.vertices())
+    {
+        points.col(v.idx()) = (ShapeOp::Vector3)bones.position(v);
+    }
+
+    // One closeness and one plane constraint per vertex, planes without normal keep the vertex in place
+    ctx.closeness = std::make_shared<ShapeOp::ClosenessConstraintSet>();
+    ctx.planes = std::make_shared<ShapeOp::PlaneCollisionConstraintSet>();
+    ctx.closeness->reserve(n);
+    ctx.planes->reserve(n);
+    for (int i = 0; i < n; ++i)
+    {
+        ctx.closeness->add(i, 1.0, points.col(i));
+        ctx.planes->add(i, BONE_PLANE_WEIGHT, points.col(i), ShapeOp::Vector3::Zero(), 0.0);
+    }
+
+    // Bending keeps the shape of the bones (triangle pairs without degenerate triangles)
+    auto bending = std::make_shared<ShapeOp::BendingConstraintSet>();
+    for (pmp::Edge e : bones.edges())
+    {
+        if (bones.is_boundary(e))
+        {
+            continue;
+        }
+
+        pmp::Halfedge h0 = bones.halfedge(e, 0);
+        pmp::Halfedge h1 = bones.halfedge(e, 1);
+
+        int ids[4] = {(int)bones.to_vertex(h0).idx(), (int)bones.to_vertex(h1).idx(),
+                      (int)bones.to_vertex(bones.next_halfedge(h0)).idx(),
+                      (int)bones.to_vertex(bones.next_halfedge(h1)).idx()};
+
+        ShapeOp::Vector3 edge = points.col(ids[1]) - points.col(ids[0]);
+        if (edge.cross(points.col(ids[2]) - points.col(ids[0])).norm() < 1e-12 ||
+            edge.cross(points.col(ids[3]) - points.col(ids[0])).norm() < 1e-12)
+        {
+            continue;
+        }
+
+        bending->add(ids, BONE_BENDING_WEIGHT, points, 1.0, 1.0);
+    }
+
+    ctx.solver = std::make_shared<ShapeOp::Solver>();
+    ctx.solver->setGlobalSolver(ShapeOp::Solver::GlobalSolver::LDLTMultiRHS);
+    ctx.solver->addConstraintSet(ctx.closeness);
+    ctx.solver->addConstraintSet(ctx.planes);
+    ctx.solver->addConstraintSet(bending);
+    ctx.solver->setPoints(points);
+
+    if (!ctx.solver->initialize())
+    {
+        printf("[ERROR] init_bone_collision_context(): Cannot initialize shape op solver\n");
+        ctx.solver.reset();
+        return false;
+    }
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+int resolve_bones_outside_wrap(pmp::SurfaceMesh& bones,
+                               const pmp::SurfaceMesh& wrap,
+                               BoneCollisionContext& context,
+                               double time_budget,
+                               float margin,
+                               float search_radius)
+{
+    if (!context.solver || context.n_vertices != bones.vertices_size())
+    {
+        printf("[ERROR] resolve_bones_outside_wrap(): Bone collision context does not match the bones\n");
+        return -1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    auto elapsed = [&start]() {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    // Wrap hierarchy and pseudo normals (angle weighted at vertices, face pairs at edges) for inside tests
+    if (context.wrap_bvh.matches(wrap))
+    {
+        context.wrap_bvh.refit(wrap);
+    }
+    else
+    {
+        context.wrap_bvh.build(wrap);
+    }
+
+    const std::vector<pmp::Point>& wrap_points = wrap.get_vertex_property<pmp::Point>("v:point").vector();
+    std::vector<pmp::dvec3> face_normals(wrap.faces_size());
+    std::vector<pmp::dvec3> vertex_normals(wrap.vertices_size());
+    std::vector<pmp::dvec3> edge_normals(3 * wrap.faces_size());
+
+    #pragma omp parallel for schedule(static)
+    for (int f = 0; f < (int)wrap.faces_size(); ++f)
+    {
+        face_normals[f] = pmp::dvec3(pmp::face_normal(wrap, pmp::Face(f)));
+    }
+
+    #pragma omp parallel for schedule(static)
+    for (int v = 0; v < (int)wrap.vertices_size(); ++v)
+    {
+        vertex_normals[v] = pmp::dvec3(pmp::vertex_normal(wrap, pmp::Vertex(v)));
+    }
+
+    // edge k of a face runs from its vertex k to k + 1 (order of TriangleBVH::face_vertices)
+    #pragma omp parallel for schedule(static)
+    for (int f = 0; f < (int)wrap.faces_size(); ++f)
+    {
+        const std::array<int, 3>& fv = context.wrap_bvh.face_vertices(f);
+        for (int k = 0; k < 3; ++k)
+        {
+            pmp::Halfedge h = wrap.find_halfedge(pmp::Vertex(fv[k]), pmp::Vertex(fv[(k + 1) % 3]));
+            pmp::Halfedge o = wrap.opposite_halfedge(h);
+            edge_normals[3 * f + k] = face_normals[f];
+            if (!wrap.is_boundary(o))
+            {
+                edge_normals[3 * f + k] += face_normals[wrap.face(o).idx()];
+            }
+        }
+    }
+
+    int n = (int)context.n_vertices;
+    ShapeOp::Matrix3X points(3, n);
+    for (int i = 0; i < n; ++i)
+    {
+        points.col(i) = (ShapeOp::Vector3)bones.position(pmp::Vertex(i));
+        context.closeness->setPosition(i, points.col(i));
+    }
+
+    // Lower bound of the distance to the wrap of vertices inside (clear of the margin), vertices only need
+    // a new query once they moved by more than their clearance
+    std::vector<double> clearance(n, 0.0);
+    ShapeOp::Matrix3X queried = points;
+
+    int n_outside = 0;
+    for (int round = 0;; ++round)
+    {
+        // Detection, every vertex gets a plane (without normal if it is fine)
+        n_outside = 0;
+
+        #pragma omp parallel for schedule(dynamic, 256) reduction(+ : n_outside)
+        for (int i = 0; i < n; ++i)
+        {
+            if (clearance[i] - (points.col(i) - queried.col(i)).norm() > margin)
+            {
+                continue;
+            }
+            queried.col(i) = points.col(i);
+            clearance[i] = search_radius;
+
+            pmp::Point p(points(0, i), points(1, i), points(2, i));
+            pmp::dvec3 closest;
+            TriangleRegion region;
+            int f = context.wrap_bvh.closest_point(wrap_points, p, closest, region, search_radius);
+
+            bool active = false;
+            pmp::dvec3 normal(0.0);
+            if (f != -1)
+            {
+                pmp::dvec3 pseudo_normal = face_normals[f];
+                if (region >= REGION_VERTEX_A && region <= REGION_VERTEX_C)
+                {
+                    pseudo_normal = vertex_normals[context.wrap_bvh.face_vertices(f)[region - REGION_VERTEX_A]];
+                }
+                else if (region >= REGION_EDGE_AB)
+                {
+                    pseudo_normal = edge_normals[3 * f + (region - REGION_EDGE_AB)];
+                }
+
+                pmp::dvec3 d = pmp::dvec3(p) - closest;
+                double distance = pmp::norm(d);
+                bool outside = pmp::dot(d, pseudo_normal) > 0.0;
+                if (outside)
+                {
+                    n_outside++;
+                }
+
+                if (outside || distance < margin)
+                {
+                    active = true;
+                    normal = distance > 1e-9 ? (outside ? d : -d) / distance : pmp::normalize(pseudo_normal);
+                }
+                clearance[i] = active ? 0.0 : distance;
+            }
+
+            if (active)
+            {
+                context.planes->setPlane(i, (ShapeOp::Vector3)closest, (ShapeOp::Vector3)normal, margin);
+            }
+            else
+            {
+                context.planes->setPlane(i, points.col(i), ShapeOp::Vector3::Zero(), 0.0);
+            }
+        }
+
+        if (n_outside == 0 || round == BONE_MAX_ROUNDS || elapsed() > time_budget)
+        {
+            break;
+        }
+
+        // Projection with the cached factorization
+        context.solver->setPoints(points);
+        if (!context.solver->solve(BONE_SOLVE_ITERATIONS))
+        {
+            printf("[ERROR] Cannot solve with shape op solver\n");
+            break;
+        }
+        points = context.solver->getPoints();
+
+        for (int i = 0; i < n; ++i)
+        {
+            bones.position(pmp::Vertex(i)) = (pmp::vec3)points.col(i);
+        }
+
+        if (elapsed() > time_budget)
+        {
+            break;
+        }
+    }
+
+    return n_outside;
+}
+
+//-----------------------------------------------------------------------------
@@ -0,0 +1,59 @@
+//-----------------------------------------------------------------------------
+
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include <pmp/surface_mesh.h>
+
+#include "algorithms/TriangleBVH.h"
+
+//-----------------------------------------------------------------------------
+
+namespace ShapeOp
+{
+class Solver;
+class ClosenessConstraintSet;
+class PlaneCollisionConstraintSet;
+} // namespace ShapeOp
+
+//-----------------------------------------------------------------------------
+
+// Keeps the warped bones inside the full skeleton wrap. The projection system
+// (closeness to the warped positions, one plane constraint and the bending of
+// the bone surface per vertex) never changes, so it is factorized once per
+// bone template. A resolve only updates targets and planes.
+struct BoneCollisionContext
+{
+    size_t n_vertices = 0;
+
+    std::shared_ptr<ShapeOp::Solver> solver;
+    std::shared_ptr<ShapeOp::ClosenessConstraintSet> closeness;
+    std::shared_ptr<ShapeOp::PlaneCollisionConstraintSet> planes;
+
+    // hierarchy over the wrap, refitted for every resolve
+    TriangleBVH wrap_bvh;
+};
+
+//-----------------------------------------------------------------------------
+
+// bones: the bone template (rest shape of the bending constraints)
+bool init_bone_collision_context(const pmp::SurfaceMesh& bones,
+                                 BoneCollisionContext& out_context);
+
+//-----------------------------------------------------------------------------
+
+// Moves bone vertices that are outside of the wrap, or inside but closer than
+// margin, back inside. Only vertices within search_radius of the wrap are
+// tested, bones are warped into the wrap and never end up far outside.
+// Detection and projection alternate until no vertex is outside or the time
+// budget (in ms) is used up. Returns the number of vertices left outside.
+int resolve_bones_outside_wrap(pmp::SurfaceMesh& bones,
+                               const pmp::SurfaceMesh& wrap,
+                               BoneCollisionContext& context,
+                               double time_budget = 50.0,
+                               float margin = 0.001f,
+                               float search_radius = 0.03f);
+
+//-----------------------------------------------------------------------------
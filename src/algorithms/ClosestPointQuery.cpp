@@ -0,0 +1,177 @@
+//======================================================================================================================
+// Copyright (c) the Authors 2024
+//
+// This work is licensed under a
+// Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+//
+// You should have received a copy of the license along with this
+// work. If not, see <http://creativecommons.org/licenses/by-nc-sa/4.0/>.
+//
+//======================================================================================================================
+
+#include "ClosestPointQuery.h"
+
+#include <algorithm>
+#include <cmath>
+
+// =====================================================================================================================
+
+// barycentric coordinates of p (on the triangle) with respect to a, b, c
+static auto barycentric_coordinates(const pmp::dvec3& p, const pmp::dvec3& a, const pmp::dvec3& b,
+                                    const pmp::dvec3& c) -> pmp::Point
+{
+    pmp::dvec3 e1 = b - a;
+    pmp::dvec3 e2 = c - a;
+    pmp::dvec3 d = p - a;
+    double d11 = pmp::dot(e1, e1);
+    double d12 = pmp::dot(e1, e2);
+    double d22 = pmp::dot(e2, e2);
+    double denominator = d11 * d22 - d12 * d12;
+    if (denominator <= 1e-20) {
+        // degenerate triangle
+        return pmp::Point(1.0F / 3.0F, 1.0F / 3.0F, 1.0F / 3.0F);
+    }
+    double w1 = (d22 * pmp::dot(d, e1) - d12 * pmp::dot(d, e2)) / denominator;
+    double w2 = (d11 * pmp::dot(d, e2) - d12 * pmp::dot(d, e1)) / denominator;
+    return pmp::Point(static_cast<float>(1.0 - w1 - w2), static_cast<float>(w1), static_cast<float>(w2));
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto ClosestPointQuery::update(const pmp::SurfaceMesh& mesh, const std::vector<bool>& ignored_faces) -> void
+{
+    _point_cloud = false;
+    _tree = KdTree();
+    _positions = mesh.get_vertex_property<pmp::Point>("v:point").vector();
+    if (_bvh.matches(mesh)) {
+        _bvh.refit(mesh);
+    } else {
+        _bvh.build(mesh, ignored_faces);
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto ClosestPointQuery::build(const std::vector<pmp::Point>& points) -> void
+{
+    _point_cloud = true;
+    _bvh = TriangleBVH();
+    _positions.clear();
+    _tree.build(points);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto ClosestPointQuery::closest_point(const pmp::Point& query, float max_distance, int hint) const -> ClosestPoint
+{
+    ClosestPoint result;
+    if (empty()) {
+        return result;
+    }
+
+    float max_sqr_distance = max_distance < FLT_MAX ? max_distance * max_distance : FLT_MAX;
+
+    if (_point_cloud) {
+        float sqr_distance = FLT_MAX;
+        result.index = _tree.nearest(query, sqr_distance, max_sqr_distance);
+        if (result.index != -1) {
+            result.point = _tree.point(result.index);
+            result.distance = std::sqrt(sqr_distance);
+        }
+        return result;
+    }
+
+    pmp::dvec3 closest;
+    TriangleRegion region;
+    result.index = _bvh.closest_point(_positions, query, closest, region, max_distance, hint);
+    if (result.index != -1) {
+        const auto& fv = _bvh.face_vertices(result.index);
+        result.barycentric = barycentric_coordinates(closest, pmp::dvec3(_positions[fv[0]]),
+                                                     pmp::dvec3(_positions[fv[1]]), pmp::dvec3(_positions[fv[2]]));
+        result.point = pmp::Point(closest);
+        result.distance = static_cast<float>(pmp::norm(closest - pmp::dvec3(query)));
+    }
+    return result;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto ClosestPointQuery::closest_points(const std::vector<pmp::Point>& queries, std::vector<ClosestPoint>& results,
+                                       float max_distance) const -> void
+{
+    bool warm_start = results.size() == queries.size();
+    if (!warm_start) {
+        results.assign(queries.size(), ClosestPoint());
+    }
+
+    if (_point_cloud) {
+        // the kd-tree has its own batched warm start
+        std::vector<int> indices;
+        std::vector<float> sqr_distances;
+        if (warm_start) {
+            indices.resize(results.size());
+            std::transform(results.begin(), results.end(), indices.begin(),
+                           [](const ClosestPoint& r) { return r.index; });
+        }
+        float max_sqr_distance = max_distance < FLT_MAX ? max_distance * max_distance : FLT_MAX;
+        _tree.nearest(queries, indices, sqr_distances, max_sqr_distance);
+
+        #pragma omp parallel for schedule(static)
+        for (int i = 0; i < static_cast<int>(queries.size()); ++i) {
+            ClosestPoint& result = results[i];
+            result = ClosestPoint();
+            result.index = indices[i];
+            if (result.index != -1) {
+                result.point = _tree.point(result.index);
+                result.distance = std::sqrt(sqr_distances[i]);
+            }
+        }
+        return;
+    }
+
+    #pragma omp parallel for schedule(dynamic, 256)
+    for (int i = 0; i < static_cast<int>(queries.size()); ++i) {
+        int hint = warm_start ? results[i].index : -1;
+        results[i] = closest_point(queries[i], max_distance, hint);
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto ClosestPointQuery::distances(const pmp::SurfaceMesh& mesh, std::vector<float>& distances,
+                                  float max_distance) const -> void
+{
+    const std::vector<pmp::Point>& points = mesh.get_vertex_property<pmp::Point>("v:point").vector();
+    distances.resize(points.size());
+
+    #pragma omp parallel for schedule(dynamic, 256)
+    for (int i = 0; i < static_cast<int>(points.size()); ++i) {
+        distances[i] = closest_point(points[i], max_distance).distance;
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto hausdorff_distance(const pmp::SurfaceMesh& mesh_a, const pmp::SurfaceMesh& mesh_b) -> float
+{
+    ClosestPointQuery query_a;
+    ClosestPointQuery query_b;
+    query_a.update(mesh_a);
+    query_b.update(mesh_b);
+
+    std::vector<float> a_to_b;
+    std::vector<float> b_to_a;
+    query_b.distances(mesh_a, a_to_b);
+    query_a.distances(mesh_b, b_to_a);
+
+    float hausdorff = 0.0F;
+    for (float d : a_to_b) {
+        hausdorff = std::max(hausdorff, d);
+    }
+    for (float d : b_to_a) {
+        hausdorff = std::max(hausdorff, d);
+    }
+    return hausdorff;
+}
+
+// =====================================================================================================================
@@ -0,0 +1,87 @@
+//======================================================================================================================
+// Copyright (c) the Authors 2024
+//
+// This work is licensed under a
+// Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+//
+// You should have received a copy of the license along with this
+// work. If not, see <http://creativecommons.org/licenses/by-nc-sa/4.0/>.
+//
+//======================================================================================================================
+
+#ifndef TAILORME_VIEWER_CLOSESTPOINTQUERY_H
+#define TAILORME_VIEWER_CLOSESTPOINTQUERY_H
+
+#include <cfloat>
+#include <vector>
+
+#include <pmp/surface_mesh.h>
+
+#include "algorithms/KdTree.h"
+#include "algorithms/TriangleBVH.h"
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+// Nearest point of one query
+struct ClosestPoint {
+    // face (mesh mode) or point index (point cloud mode), -1 if nothing is within the cutoff
+    int index = -1;
+    // weights of the face vertices (order of TriangleBVH::face_vertices), (1, 0, 0) for point clouds
+    pmp::Point barycentric{1.0F, 0.0F, 0.0F};
+    pmp::Point point{0.0F, 0.0F, 0.0F};
+    float distance = FLT_MAX;
+};
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+// Batched point to surface queries, either against a triangle mesh (BVH, refitted when only the vertices moved) or
+// against a point cloud (kd-tree, e.g. raw scans). Queries run in parallel. Results of a previous query with the same
+// number of queries are used as a warm start, the old nearest face / point bounds the search. Re-queries after small
+// motions (fitting iterations, one frame to the next) therefore only visit a few nodes.
+class ClosestPointQuery {
+  protected:
+    // mesh mode
+    TriangleBVH _bvh{};
+    std::vector<pmp::Point> _positions{};
+
+    // point cloud mode
+    KdTree _tree{};
+    bool _point_cloud = false;
+
+  public:
+    ClosestPointQuery() = default;
+
+    // mesh mode, the hierarchy is rebuilt if the topology changed and refitted otherwise.
+    // ignored_faces: optional mask (per face) for a rebuild, masked faces are never reported
+    auto update(const pmp::SurfaceMesh& mesh, const std::vector<bool>& ignored_faces = {}) -> void;
+    // point cloud mode
+    auto build(const std::vector<pmp::Point>& points) -> void;
+
+    [[nodiscard]]
+    auto empty() const -> bool { return _point_cloud ? _tree.empty() : _bvh.empty(); }
+    [[nodiscard]]
+    auto point_cloud() const -> bool { return _point_cloud; }
+    [[nodiscard]]
+    auto bvh() const -> const TriangleBVH& { return _bvh; }
+
+    // single query, hint: index of a previous result
+    [[nodiscard]]
+    auto closest_point(const pmp::Point& query, float max_distance = FLT_MAX, int hint = -1) const -> ClosestPoint;
+
+    // batched queries, results of a previous call (same size) are the warm start
+    auto closest_points(const std::vector<pmp::Point>& queries, std::vector<ClosestPoint>& results,
+                        float max_distance = FLT_MAX) const -> void;
+
+    // distance of every vertex of mesh to the surface (FLT_MAX beyond max_distance), e.g. per vertex fitting errors
+    auto distances(const pmp::SurfaceMesh& mesh, std::vector<float>& distances,
+                   float max_distance = FLT_MAX) const -> void;
+};
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+// Symmetric Hausdorff distance between the surfaces, sampled at the vertices of both meshes
+auto hausdorff_distance(const pmp::SurfaceMesh& mesh_a, const pmp::SurfaceMesh& mesh_b) -> float;
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+#endif // TAILORME_VIEWER_CLOSESTPOINTQUERY_H
@@ -0,0 +1,233 @@
+//======================================================================================================================
+// Copyright (c) the Authors 2024
+//
+// This work is licensed under a
+// Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+//
+// You should have received a copy of the license along with this
+// work. If not, see <http://creativecommons.org/licenses/by-nc-sa/4.0/>.
+//
+//======================================================================================================================
+
+#include "FarthestPointSampling.h"
+#include "algorithms/SimdFloat.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <numeric>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// =====================================================================================================================
+
+using S = SimdFloat;
+using Vec = S::type;
+using Mask = S::mask;
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+// Candidates of one block in structure of arrays layout, distance is the squared distance to the nearest sample.
+// Samples and unused lanes have distance -1 and are never selected.
+struct CandidateBlock {
+    alignas(64) float x[S::width]{};
+    alignas(64) float y[S::width]{};
+    alignas(64) float z[S::width]{};
+    alignas(64) float distance[S::width]{};
+};
+
+// Farthest candidate of a range of blocks, -1 if all are samples
+struct FarthestCandidate {
+    float distance = -1.0F;
+    int candidate = -1;
+};
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+static auto farther(const FarthestCandidate& a, const FarthestCandidate& b) -> bool
+{
+    return a.distance > b.distance || (a.distance == b.distance && a.candidate >= 0 && a.candidate < b.candidate);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+// farthest candidate of the blocks [begin, end), the distances are updated with the new sample p first
+template <bool update>
+static auto scan_blocks(std::vector<CandidateBlock>& blocks, int begin, int end, const pmp::Point& p)
+    -> FarthestCandidate
+{
+    alignas(64) float lanes[S::width];
+    for (int lane = 0; lane < S::width; ++lane) {
+        lanes[lane] = static_cast<float>(lane);
+    }
+    Vec lane = S::load(lanes);
+    Vec px = S::set1(p[0]);
+    Vec py = S::set1(p[1]);
+    Vec pz = S::set1(p[2]);
+
+    // per lane, candidate indices as floats (exact below 2^24 candidates)
+    Vec best = S::set1(-1.0F);
+    Vec best_candidate = S::set1(-1.0F);
+    for (int b = begin; b < end; ++b) {
+        CandidateBlock& block = blocks[b];
+        Vec distance = S::load(block.distance);
+        if constexpr (update) {
+            Vec dx = S::sub(S::load(block.x), px);
+            Vec dy = S::sub(S::load(block.y), py);
+            Vec dz = S::sub(S::load(block.z), pz);
+            Vec d = S::add(S::add(S::mul(dx, dx), S::mul(dy, dy)), S::mul(dz, dz));
+            distance = S::min(d, distance);
+            S::store(block.distance, distance);
+        }
+        // strictly farther, ties keep the earlier block
+        Mask is_farther = S::less(best, distance);
+        best = S::select(is_farther, distance, best);
+        best_candidate = S::select(is_farther, S::add(lane, S::set1(static_cast<float>(b * S::width))), best_candidate);
+    }
+
+    alignas(64) float distances[S::width];
+    alignas(64) float candidates[S::width];
+    S::store(distances, best);
+    S::store(candidates, best_candidate);
+    FarthestCandidate result;
+    for (int l = 0; l < S::width; ++l) {
+        FarthestCandidate candidate{ distances[l], static_cast<int>(candidates[l]) };
+        if (farther(candidate, result)) {
+            result = candidate;
+        }
+    }
+    return result;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto FarthestPointSampling::build(const std::vector<pmp::Point>& points) -> void
+{
+    _points = points;
+    _samples.clear();
+    _spacing.clear();
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto FarthestPointSampling::add_sample(int index) -> void
+{
+    float spacing = FLT_MAX;
+    for (int sample : _samples) {
+        spacing = std::min(spacing, pmp::distance(_points[index], _points[sample]));
+    }
+    _samples.push_back(index);
+    _spacing.push_back(spacing);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto FarthestPointSampling::sample(size_t count, const std::vector<int>& candidates) -> size_t
+{
+    std::vector<int> all_points;
+    if (candidates.empty()) {
+        all_points.resize(_points.size());
+        std::iota(all_points.begin(), all_points.end(), 0);
+    }
+    const std::vector<int>& list = candidates.empty() ? all_points : candidates;
+    int n = static_cast<int>(list.size());
+    if (count == 0 || n == 0) {
+        return 0;
+    }
+
+    std::vector<bool> is_sample(_points.size(), false);
+    for (int sample : _samples) {
+        is_sample[sample] = true;
+    }
+
+    // candidate blocks with the distances to the samples of previous calls
+    int n_blocks = (n + S::width - 1) / S::width;
+    std::vector<CandidateBlock> blocks(n_blocks);
+    #pragma omp parallel for schedule(static)
+    for (int b = 0; b < n_blocks; ++b) {
+        CandidateBlock& block = blocks[b];
+        for (int l = 0; l < S::width; ++l) {
+            int i = b * S::width + l;
+            if (i >= n) {
+                block.distance[l] = -1.0F;
+                continue;
+            }
+            const pmp::Point& q = _points[list[i]];
+            block.x[l] = q[0];
+            block.y[l] = q[1];
+            block.z[l] = q[2];
+            block.distance[l] = is_sample[list[i]] ? -1.0F : FLT_MAX;
+        }
+
+        Vec x = S::load(block.x);
+        Vec y = S::load(block.y);
+        Vec z = S::load(block.z);
+        Vec distance = S::load(block.distance);
+        for (int sample : _samples) {
+            const pmp::Point& p = _points[sample];
+            Vec dx = S::sub(x, S::set1(p[0]));
+            Vec dy = S::sub(y, S::set1(p[1]));
+            Vec dz = S::sub(z, S::set1(p[2]));
+            distance = S::min(S::add(S::add(S::mul(dx, dx), S::mul(dy, dy)), S::mul(dz, dz)), distance);
+        }
+        S::store(block.distance, distance);
+    }
+
+    // threads keep their blocks for all samples, one barrier per sample
+    int threads = 1;
+#ifdef _OPENMP
+    threads = std::max(1, std::min(omp_get_max_threads(), n_blocks));
+#endif
+    // two sets of slots, a thread may write the next sample while others still reduce this one
+    std::vector<FarthestCandidate> farthest(2 * threads);
+    size_t added = 0;
+
+    #pragma omp parallel num_threads(threads)
+    {
+        int thread = 0;
+#ifdef _OPENMP
+        thread = omp_get_thread_num();
+#endif
+        int begin = n_blocks * thread / threads;
+        int end = n_blocks * (thread + 1) / threads;
+
+        pmp::Point p(0.0F);
+        for (size_t k = 0; k < count; ++k) {
+            FarthestCandidate* slots = &farthest[(k % 2) * threads];
+            slots[thread] = k == 0 ? scan_blocks<false>(blocks, begin, end, p) : scan_blocks<true>(blocks, begin, end, p);
+            #pragma omp barrier
+
+            // every thread reduces, same result everywhere
+            FarthestCandidate best;
+            for (int t = 0; t < threads; ++t) {
+                if (farther(slots[t], best)) {
+                    best = slots[t];
+                }
+            }
+            if (best.candidate < 0) {
+                break;
+            }
+
+            // the owner of the block removes the sample from the candidates
+            int b = best.candidate / S::width;
+            if (b >= begin && b < end) {
+                blocks[b].distance[best.candidate % S::width] = -1.0F;
+            }
+            int index = list[best.candidate];
+            p = _points[index];
+            if (thread == 0) {
+                _samples.push_back(index);
+                _spacing.push_back(best.distance == FLT_MAX ? FLT_MAX : std::sqrt(best.distance));
+                added++;
+            }
+        }
+    }
+
+    return added;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+// =====================================================================================================================
@@ -0,0 +1,56 @@
+//======================================================================================================================
+// Copyright (c) the Authors 2024
+//
+// This work is licensed under a
+// Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+//
+// You should have received a copy of the license along with this
+// work. If not, see <http://creativecommons.org/licenses/by-nc-sa/4.0/>.
+//
+//======================================================================================================================
+
+#ifndef TAILORME_VIEWER_FARTHESTPOINTSAMPLING_H
+#define TAILORME_VIEWER_FARTHESTPOINTSAMPLING_H
+
+#include <vector>
+
+#include <pmp/surface_mesh.h>
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+// Farthest point sampling: every new sample is the candidate farthest from all samples so far (rbf centers, evenly
+// spread subsets of a mesh for fitting or proxies). The candidates can be restricted per call, e.g. a region first and
+// the whole mesh after it, distances always refer to all samples of the previous calls. The candidates are copied into
+// float SIMD blocks (structure of arrays), threads own a range of blocks and only their farthest candidates are reduced
+// once per sample. Ties go to the candidate listed first, the result does not depend on the number of threads.
+class FarthestPointSampling {
+  protected:
+    std::vector<pmp::Point> _points{};
+    std::vector<int> _samples{};
+    // distance of every sample to the samples before it (FLT_MAX for the first one)
+    std::vector<float> _spacing{};
+
+  public:
+    FarthestPointSampling() = default;
+
+    // points to sample from, removes all samples
+    auto build(const std::vector<pmp::Point>& points) -> void;
+
+    // fixed sample, e.g. a seed
+    auto add_sample(int index) -> void;
+
+    // up to count samples from the candidates (point indices, all points if empty), fewer if every candidate is a
+    // sample already. Without samples the first candidate is the first sample. Returns the number of new samples.
+    auto sample(size_t count, const std::vector<int>& candidates = {}) -> size_t;
+
+    [[nodiscard]]
+    auto samples() const -> const std::vector<int>& { return _samples; }
+    [[nodiscard]]
+    auto spacing() const -> const std::vector<float>& { return _spacing; }
+    [[nodiscard]]
+    auto points() const -> const std::vector<pmp::Point>& { return _points; }
+};
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+#endif // TAILORME_VIEWER_FARTHESTPOINTSAMPLING_H
@@ -0,0 +1,203 @@
+//======================================================================================================================
+// Copyright (c) the Authors 2024
+//
+// This work is licensed under a
+// Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+//
+// You should have received a copy of the license along with this
+// work. If not, see <http://creativecommons.org/licenses/by-nc-sa/4.0/>.
+//
+//======================================================================================================================
+
+#include "KdTree.h"
+
+#include <algorithm>
+#include <numeric>
+
+// =====================================================================================================================
+
+// ranges up to this size are scanned linearly
+#define KDTREE_LEAF_SIZE 8
+// ranges larger than this are built in a separate task
+#define KDTREE_TASK_SIZE 16384
+
+// =====================================================================================================================
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+KdTree::KdTree(const std::vector<pmp::Point>& points)
+{
+    build(points);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto KdTree::build(const std::vector<pmp::Point>& points) -> void
+{
+    _points = points;
+    _indices.resize(points.size());
+    std::iota(_indices.begin(), _indices.end(), 0);
+    _axis.assign(points.size(), 0);
+
+    #pragma omp parallel
+    #pragma omp single nowait
+    _build(0, static_cast<int>(_points.size()), 0);
+
+    // reorder points to tree order
+    _inverse.resize(points.size());
+    for (size_t i = 0; i < _indices.size(); ++i) {
+        _points[i] = points[_indices[i]];
+        _inverse[_indices[i]] = static_cast<int>(i);
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto KdTree::_build(int lo, int hi, int depth) -> void
+{
+    if (hi - lo <= KDTREE_LEAF_SIZE) {
+        return;
+    }
+
+    // split along largest extent
+    pmp::Point min_p(FLT_MAX), max_p(-FLT_MAX);
+    for (int i = lo; i < hi; ++i) {
+        min_p = pmp::min(min_p, _points[_indices[i]]);
+        max_p = pmp::max(max_p, _points[_indices[i]]);
+    }
+    pmp::Point extent = max_p - min_p;
+    int axis = 0;
+    if (extent[1] > extent[axis]) axis = 1;
+    if (extent[2] > extent[axis]) axis = 2;
+
+    int mid = lo + (hi - lo) / 2;
+    std::nth_element(_indices.begin() + lo, _indices.begin() + mid, _indices.begin() + hi,
+                     [&](int a, int b) { return _points[a][axis] < _points[b][axis]; });
+    _axis[mid] = static_cast<unsigned char>(axis);
+
+    if (hi - lo > KDTREE_TASK_SIZE) {
+        #pragma omp task default(none) firstprivate(lo, mid, depth)
+        _build(lo, mid, depth + 1);
+        #pragma omp task default(none) firstprivate(mid, hi, depth)
+        _build(mid + 1, hi, depth + 1);
+        #pragma omp taskwait
+    } else {
+        _build(lo, mid, depth + 1);
+        _build(mid + 1, hi, depth + 1);
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto KdTree::_nearest(const pmp::Point& query, int& best_index, float& best_sqr_distance) const -> void
+{
+    struct Range {
+        int lo;
+        int hi;
+        float sqr_bound;
+    };
+
+    // depth of a balanced tree with 2^31 points is 31, one far child per level is pushed
+    Range stack[64];
+    int top = 0;
+    stack[top++] = {0, static_cast<int>(_points.size()), 0.0F};
+
+    while (top > 0) {
+        Range range = stack[--top];
+        if (range.sqr_bound >= best_sqr_distance) {
+            continue;
+        }
+
+        // linear scan at leaves
+        if (range.hi - range.lo <= KDTREE_LEAF_SIZE) {
+            for (int i = range.lo; i < range.hi; ++i) {
+                float d = pmp::sqrnorm(_points[i] - query);
+                if (d < best_sqr_distance) {
+                    best_sqr_distance = d;
+                    best_index = i;
+                }
+            }
+            continue;
+        }
+
+        int mid = range.lo + (range.hi - range.lo) / 2;
+        float d = pmp::sqrnorm(_points[mid] - query);
+        if (d < best_sqr_distance) {
+            best_sqr_distance = d;
+            best_index = mid;
+        }
+
+        int axis = _axis[mid];
+        float diff = query[axis] - _points[mid][axis];
+        float far_bound = std::max(range.sqr_bound, diff * diff);
+
+        // push far side first, near side is processed next
+        if (diff < 0.0F) {
+            stack[top++] = {mid + 1, range.hi, far_bound};
+            stack[top++] = {range.lo, mid, range.sqr_bound};
+        } else {
+            stack[top++] = {range.lo, mid, far_bound};
+            stack[top++] = {mid + 1, range.hi, range.sqr_bound};
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto KdTree::nearest(const pmp::Point& query, float& sqr_distance, float max_sqr_distance) const -> int
+{
+    int best_index = -1;
+    sqr_distance = max_sqr_distance;
+
+    if (!_points.empty()) {
+        _nearest(query, best_index, sqr_distance);
+    }
+
+    return best_index >= 0 ? _indices[best_index] : -1;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto KdTree::nearest(const std::vector<pmp::Point>& queries,
+                     std::vector<int>& indices,
+                     std::vector<float>& sqr_distances,
+                     float max_sqr_distance) const -> void
+{
+    // previous result available as warm start?
+    bool warm_start = indices.size() == queries.size();
+    if (!warm_start) {
+        indices.assign(queries.size(), -1);
+    }
+    sqr_distances.resize(queries.size());
+
+    if (_points.empty()) {
+        std::fill(indices.begin(), indices.end(), -1);
+        std::fill(sqr_distances.begin(), sqr_distances.end(), max_sqr_distance);
+        return;
+    }
+
+    #pragma omp parallel for schedule(dynamic, 256)
+    for (size_t i = 0; i < queries.size(); ++i) {
+        int best_index = -1;
+        float best_sqr_distance = max_sqr_distance;
+
+        // the old neighbour is an upper bound for the new one
+        int hint = indices[i];
+        if (warm_start && hint >= 0 && hint < static_cast<int>(_points.size())) {
+            float d = pmp::sqrnorm(_points[_inverse[hint]] - queries[i]);
+            if (d < best_sqr_distance) {
+                best_sqr_distance = d;
+                best_index = _inverse[hint];
+            }
+        }
+
+        _nearest(queries[i], best_index, best_sqr_distance);
+
+        indices[i] = best_index >= 0 ? _indices[best_index] : -1;
+        sqr_distances[i] = best_sqr_distance;
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+// =====================================================================================================================
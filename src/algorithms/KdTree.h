@@ -0,0 +1,65 @@
+//======================================================================================================================
+// Copyright (c) the Authors 2024
+//
+// This work is licensed under a
+// Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+//
+// You should have received a copy of the license along with this
+// work. If not, see <http://creativecommons.org/licenses/by-nc-sa/4.0/>.
+//
+//======================================================================================================================
+
+#ifndef TAILORME_VIEWER_KDTREE_H
+#define TAILORME_VIEWER_KDTREE_H
+
+#include <cfloat>
+#include <vector>
+
+#include <pmp/surface_mesh.h>
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+// Static 3d kd-tree over a point cloud (e.g. a raw scan). Built once, queried many times.
+class KdTree {
+  protected:
+    // points in tree order (implicit tree, median of range [lo, hi) is the node)
+    std::vector<pmp::Point> _points{};
+    // tree order -> original index and back
+    std::vector<int> _indices{};
+    std::vector<int> _inverse{};
+    // split axis per node
+    std::vector<unsigned char> _axis{};
+
+    auto _build(int lo, int hi, int depth) -> void;
+    auto _nearest(const pmp::Point& query, int& best_index, float& best_sqr_distance) const -> void;
+
+  public:
+    KdTree() = default;
+    explicit KdTree(const std::vector<pmp::Point>& points);
+
+    auto build(const std::vector<pmp::Point>& points) -> void;
+
+    [[nodiscard]]
+    auto size() const -> size_t { return _points.size(); }
+    [[nodiscard]]
+    auto empty() const -> bool { return _points.empty(); }
+
+    // position of a point by its original index
+    [[nodiscard]]
+    auto point(int index) const -> const pmp::Point& { return _points[_inverse[index]]; }
+
+    // nearest point (original index), -1 if nothing is closer than max_sqr_distance
+    auto nearest(const pmp::Point& query, float& sqr_distance, float max_sqr_distance = FLT_MAX) const -> int;
+
+    // batched nearest neighbours, runs in parallel.
+    // if indices already holds a result of a previous query (same size), it is used as a warm start:
+    // the old neighbour bounds the search radius, which makes re-queries after small motions cheap.
+    auto nearest(const std::vector<pmp::Point>& queries,
+                 std::vector<int>& indices,
+                 std::vector<float>& sqr_distances,
+                 float max_sqr_distance = FLT_MAX) const -> void;
+};
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+#endif // TAILORME_VIEWER_KDTREE_H
@@ -0,0 +1,449 @@
+//======================================================================================================================
+// Copyright (c) the Authors 2024
+//
+// This work is licensed under a
+// Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+//
+// You should have received a copy of the license along with this
+// work. If not, see <http://creativecommons.org/licenses/by-nc-sa/4.0/>.
+//
+//======================================================================================================================
+
+#include "LayerCCD.h"
+
+#include <algorithm>
+#include <cmath>
+
+// =====================================================================================================================
+
+// bisection steps per root (interval width 2^-48)
+#define CCD_BISECTION_STEPS 48
+// barycentric and edge parameter tolerance at the time of contact
+#define CCD_INSIDE_EPSILON 1e-6
+// corresponding vertices closer than this (squared) in both frames coincide (wrap shrinking of zero)
+#define CCD_COINCIDENT_SQUARED 1e-14
+
+// =====================================================================================================================
+
+using pmp::dvec3;
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+// Linear motion of a point within the time step, x(t) = x0 + t * d
+struct Motion {
+    dvec3 x0;
+    dvec3 d;
+
+    [[nodiscard]]
+    auto at(double t) const -> dvec3 { return x0 + t * d; }
+};
+
+static auto motion(const pmp::Point& previous, const pmp::Point& current) -> Motion
+{
+    return {dvec3(previous), dvec3(current) - dvec3(previous)};
+}
+
+// relative motion of a with respect to b
+static auto operator-(const Motion& a, const Motion& b) -> Motion
+{
+    return {a.x0 - b.x0, a.d - b.d};
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+// Coefficients c[0] + c[1] t + c[2] t^2 + c[3] t^3 of the triple product dot(cross(e1(t), e2(t)), w(t)),
+// zero when the four points spanning e1, e2 and w (all relative to the same point) are coplanar
+static auto coplanarity_cubic(const Motion& e1, const Motion& e2, const Motion& w, double c[4]) -> void
+{
+    dvec3 n0 = pmp::cross(e1.x0, e2.x0);
+    dvec3 n1 = pmp::cross(e1.x0, e2.d) + pmp::cross(e1.d, e2.x0);
+    dvec3 n2 = pmp::cross(e1.d, e2.d);
+    c[0] = pmp::dot(n0, w.x0);
+    c[1] = pmp::dot(n0, w.d) + pmp::dot(n1, w.x0);
+    c[2] = pmp::dot(n1, w.d) + pmp::dot(n2, w.x0);
+    c[3] = pmp::dot(n2, w.d);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+// Roots of the cubic in [0, 1] in ascending order, returns their number.
+// The interval is split at the extrema, every monotone piece has at most one root which is found by bisection.
+static auto cubic_roots(const double c[4], double roots[4]) -> int
+{
+    // no sign change of the Bernstein coefficients on [0, 1], no root (the common case)
+    double b0 = c[0];
+    double b1 = c[0] + c[1] / 3.0;
+    double b2 = c[0] + (2.0 * c[1] + c[2]) / 3.0;
+    double b3 = c[0] + c[1] + c[2] + c[3];
+    if ((b0 > 0.0 && b1 > 0.0 && b2 > 0.0 && b3 > 0.0) || (b0 < 0.0 && b1 < 0.0 && b2 < 0.0 && b3 < 0.0)) {
+        return 0;
+    }
+    // identically zero, the features stay coplanar (e.g. they share a point), nothing crosses
+    if (c[0] == 0.0 && c[1] == 0.0 && c[2] == 0.0 && c[3] == 0.0) {
+        return 0;
+    }
+
+    auto f = [c](double t) { return ((c[3] * t + c[2]) * t + c[1]) * t + c[0]; };
+
+    // extrema, roots of 3 c3 t^2 + 2 c2 t + c1
+    double split[4] = {0.0};
+    int n_split = 1;
+    double qa = 3.0 * c[3];
+    double qb = 2.0 * c[2];
+    double qc = c[1];
+    double extrema[2];
+    int n_extrema = 0;
+    if (qa == 0.0) {
+        if (qb != 0.0) {
+            extrema[n_extrema++] = -qc / qb;
+        }
+    } else {
+        double discriminant = qb * qb - 4.0 * qa * qc;
+        if (discriminant >= 0.0) {
+            double q = -0.5 * (qb + std::copysign(std::sqrt(discriminant), qb));
+            extrema[n_extrema++] = q / qa;
+            if (q != 0.0) {
+                extrema[n_extrema++] = qc / q;
+            }
+        }
+    }
+    if (n_extrema == 2 && extrema[1] < extrema[0]) {
+        std::swap(extrema[0], extrema[1]);
+    }
+    for (int i = 0; i < n_extrema; ++i) {
+        if (extrema[i] > 0.0 && extrema[i] < 1.0) {
+            split[n_split++] = extrema[i];
+        }
+    }
+
+    int n_roots = 0;
+    for (int i = 0; i < n_split; ++i) {
+        double lo = split[i];
+        double hi = i + 1 < n_split ? split[i + 1] : 1.0;
+        double f_lo = f(lo);
+        double f_hi = f(hi);
+
+        if (f_lo == 0.0) {
+            if (n_roots == 0 || roots[n_roots - 1] != lo) {
+                roots[n_roots++] = lo;
+            }
+            continue;
+        }
+        if (f_hi == 0.0) {
+            roots[n_roots++] = hi;
+            continue;
+        }
+        if ((f_lo < 0.0) == (f_hi < 0.0)) {
+            continue;
+        }
+
+        for (int step = 0; step < CCD_BISECTION_STEPS; ++step) {
+            double mid = 0.5 * (lo + hi);
+            double f_mid = f(mid);
+            if ((f_mid < 0.0) == (f_lo < 0.0)) {
+                lo = mid;
+                f_lo = f_mid;
+            } else {
+                hi = mid;
+            }
+        }
+        roots[n_roots++] = 0.5 * (lo + hi);
+    }
+
+    return n_roots;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+// p in the triangle (a, b, c), all in one plane
+static auto inside_triangle(const dvec3& p, const dvec3& a, const dvec3& b, const dvec3& c) -> bool
+{
+    dvec3 e0 = b - a;
+    dvec3 e1 = c - a;
+    dvec3 e2 = p - a;
+    double d00 = pmp::dot(e0, e0);
+    double d01 = pmp::dot(e0, e1);
+    double d11 = pmp::dot(e1, e1);
+    double d20 = pmp::dot(e2, e0);
+    double d21 = pmp::dot(e2, e1);
+    double denominator = d00 * d11 - d01 * d01;
+    if (denominator <= 0.0) {
+        return false;
+    }
+
+    double v = (d11 * d20 - d01 * d21) / denominator;
+    double w = (d00 * d21 - d01 * d20) / denominator;
+    return v >= -CCD_INSIDE_EPSILON && w >= -CCD_INSIDE_EPSILON && v + w <= 1.0 + CCD_INSIDE_EPSILON;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+// segments (p0, p1) and (q0, q1) in one plane touch
+static auto segments_touch(const dvec3& p0, const dvec3& p1, const dvec3& q0, const dvec3& q1) -> bool
+{
+    dvec3 d1 = p1 - p0;
+    dvec3 d2 = q1 - q0;
+    dvec3 r = p0 - q0;
+    double a = pmp::dot(d1, d1);
+    double e = pmp::dot(d2, d2);
+    double f = pmp::dot(d2, r);
+    if (a <= 0.0 || e <= 0.0) {
+        return false;
+    }
+
+    // closest points (clamped parameters s and t)
+    double c = pmp::dot(d1, r);
+    double b = pmp::dot(d1, d2);
+    double denominator = a * e - b * b;
+    double s = denominator > 0.0 ? std::clamp((b * f - c * e) / denominator, 0.0, 1.0) : 0.0;
+    double t = (b * s + f) / e;
+    if (t < 0.0) {
+        t = 0.0;
+        s = std::clamp(-c / a, 0.0, 1.0);
+    } else if (t > 1.0) {
+        t = 1.0;
+        s = std::clamp((b - c) / a, 0.0, 1.0);
+    }
+
+    double tolerance = CCD_INSIDE_EPSILON * (std::sqrt(a) + std::sqrt(e));
+    return pmp::sqrnorm(p0 + s * d1 - (q0 + t * d2)) <= tolerance * tolerance;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+// point p passes through the triangle (a, b, c) within the time step
+static auto vertex_face_crossing(const Motion& p, const Motion& a, const Motion& b, const Motion& c) -> bool
+{
+    double coefficients[4];
+    double roots[4];
+    coplanarity_cubic(b - a, c - a, p - a, coefficients);
+    int n_roots = cubic_roots(coefficients, roots);
+
+    for (int i = 0; i < n_roots; ++i) {
+        double t = roots[i];
+        if (inside_triangle(p.at(t), a.at(t), b.at(t), c.at(t))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+// edges (p, q) and (r, s) pass through each other within the time step
+static auto edge_edge_crossing(const Motion& p, const Motion& q, const Motion& r, const Motion& s) -> bool
+{
+    double coefficients[4];
+    double roots[4];
+    coplanarity_cubic(q - p, s - r, r - p, coefficients);
+    int n_roots = cubic_roots(coefficients, roots);
+
+    for (int i = 0; i < n_roots; ++i) {
+        double t = roots[i];
+        if (segments_touch(p.at(t), q.at(t), r.at(t), s.at(t))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// =====================================================================================================================
+
+auto LayerCCD::reset(const pmp::SurfaceMesh& top, const pmp::SurfaceMesh& bottom,
+                     const std::vector<bool>& ignored_top_faces) -> void
+{
+    if (top.vertices_size() != bottom.vertices_size() || top.faces_size() != bottom.faces_size()) {
+        throw std::runtime_error("Continuous collision detection needs layers with the same connectivity.");
+    }
+
+    auto ignored = [&ignored_top_faces](int f) { return !ignored_top_faces.empty() && ignored_top_faces[f]; };
+
+    _top_previous = top.get_vertex_property<pmp::Point>("v:point").vector();
+    _bottom_previous = bottom.get_vertex_property<pmp::Point>("v:point").vector();
+
+    _top_bvh.build_swept(top, _top_previous, ignored_top_faces);
+    _bottom_bvh.build_swept(bottom, _bottom_previous);
+
+    // connectivity and owners, both layers share the connectivity of the top layer
+    _face_edges.assign(3 * top.faces_size(), -1);
+    _edge_vertices.assign(2 * top.edges_size(), -1);
+    _edge_faces.assign(2 * top.edges_size(), -1);
+    _top_vertex_owner.assign(top.vertices_size(), -1);
+    _bottom_vertex_owner.assign(top.vertices_size(), -1);
+    _top_edge_owner.assign(top.edges_size(), -1);
+    _bottom_edge_owner.assign(top.edges_size(), -1);
+
+    for (auto e : top.edges()) {
+        _edge_vertices[2 * e.idx()] = static_cast<int>(top.vertex(e, 0).idx());
+        _edge_vertices[2 * e.idx() + 1] = static_cast<int>(top.vertex(e, 1).idx());
+    }
+
+    for (auto f : top.faces()) {
+        int fi = static_cast<int>(f.idx());
+        int i = 0;
+        for (auto h : top.halfedges(f)) {
+            auto e = top.edge(h);
+            _face_edges[3 * fi + i++] = static_cast<int>(e.idx());
+
+            if (_bottom_edge_owner[e.idx()] == -1) {
+                _bottom_edge_owner[e.idx()] = fi;
+            }
+            if (!ignored(fi)) {
+                int& slot = _edge_faces[2 * e.idx()] == -1 ? _edge_faces[2 * e.idx()] : _edge_faces[2 * e.idx() + 1];
+                slot = fi;
+                if (_top_edge_owner[e.idx()] == -1) {
+                    _top_edge_owner[e.idx()] = fi;
+                }
+            }
+        }
+        for (auto v : top.vertices(f)) {
+            if (_bottom_vertex_owner[v.idx()] == -1) {
+                _bottom_vertex_owner[v.idx()] = fi;
+            }
+            if (!ignored(fi) && _top_vertex_owner[v.idx()] == -1) {
+                _top_vertex_owner[v.idx()] = fi;
+            }
+        }
+    }
+
+    _vertex_face_offsets.assign(top.vertices_size() + 1, 0);
+    _vertex_faces.clear();
+    for (auto v : top.vertices()) {
+        for (auto f : top.faces(v)) {
+            if (!ignored(static_cast<int>(f.idx()))) {
+                _vertex_faces.push_back(static_cast<int>(f.idx()));
+            }
+        }
+        _vertex_face_offsets[v.idx() + 1] = static_cast<int>(_vertex_faces.size());
+    }
+
+    _crossed.assign(top.faces_size(), 0);
+    _tracking = true;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto LayerCCD::advance(const pmp::SurfaceMesh& top, const pmp::SurfaceMesh& bottom) -> int
+{
+    if (!_tracking) {
+        return -1;
+    }
+    if (!_top_bvh.matches(top) || !_bottom_bvh.matches(bottom)) {
+        _tracking = false;
+        return -1;
+    }
+
+    const std::vector<pmp::Point>& top_points = top.get_vertex_property<pmp::Point>("v:point").vector();
+    const std::vector<pmp::Point>& bottom_points = bottom.get_vertex_property<pmp::Point>("v:point").vector();
+
+    _top_bvh.refit_swept(top, _top_previous);
+    _bottom_bvh.refit_swept(bottom, _bottom_previous);
+    std::vector<std::pair<int, int>> candidates = _top_bvh.overlapping_faces(_bottom_bvh);
+
+    // corresponding vertices that coincide in both frames (cut off parts of the wrap) always touch, features
+    // sharing one of them are skipped
+    std::vector<unsigned char> coincident(top_points.size());
+    #pragma omp parallel for schedule(static)
+    for (size_t v = 0; v < top_points.size(); ++v) {
+        coincident[v] = pmp::sqrnorm(top_points[v] - bottom_points[v]) < CCD_COINCIDENT_SQUARED
+                        && pmp::sqrnorm(_top_previous[v] - _bottom_previous[v]) < CCD_COINCIDENT_SQUARED;
+    }
+
+    auto top_motion = [&](int v) { return motion(_top_previous[v], top_points[v]); };
+    auto bottom_motion = [&](int v) { return motion(_bottom_previous[v], bottom_points[v]); };
+    auto flag = [this](int f) {
+        #pragma omp atomic write
+        _crossed[f] = 1;
+    };
+
+    int n_crossings = 0;
+
+    #pragma omp parallel for schedule(dynamic, 1024) reduction(+ : n_crossings)
+    for (size_t i = 0; i < candidates.size(); ++i) {
+        int ft = candidates[i].first;
+        int fb = candidates[i].second;
+        const std::array<int, 3>& tv = _top_bvh.face_vertices(ft);
+        const std::array<int, 3>& bv = _bottom_bvh.face_vertices(fb);
+
+        auto shares_coincident = [&coincident](const int* a, int n_a, const int* b, int n_b) {
+            for (int j = 0; j < n_a; ++j) {
+                for (int k = 0; k < n_b; ++k) {
+                    if (a[j] == b[k] && coincident[a[j]]) {
+                        return true;
+                    }
+                }
+            }
+            return false;
+        };
+
+        // top vertices through the bottom face, the faces around the vertex now intersect
+        for (int v : tv) {
+            if (_top_vertex_owner[v] != ft || shares_coincident(&v, 1, bv.data(), 3)) {
+                continue;
+            }
+            if (vertex_face_crossing(top_motion(v), bottom_motion(bv[0]), bottom_motion(bv[1]), bottom_motion(bv[2]))) {
+                for (int k = _vertex_face_offsets[v]; k < _vertex_face_offsets[v + 1]; ++k) {
+                    flag(_vertex_faces[k]);
+                }
+                n_crossings++;
+            }
+        }
+
+        // bottom vertices through the top face
+        for (int v : bv) {
+            if (_bottom_vertex_owner[v] != fb || shares_coincident(&v, 1, tv.data(), 3)) {
+                continue;
+            }
+            if (vertex_face_crossing(bottom_motion(v), top_motion(tv[0]), top_motion(tv[1]), top_motion(tv[2]))) {
+                flag(ft);
+                n_crossings++;
+            }
+        }
+
+        // edges through each other, the faces of the top edge now intersect
+        for (int j = 0; j < 3; ++j) {
+            int et = _face_edges[3 * ft + j];
+            if (_top_edge_owner[et] != ft) {
+                continue;
+            }
+            const int* et_vertices = &_edge_vertices[2 * et];
+
+            for (int k = 0; k < 3; ++k) {
+                int eb = _face_edges[3 * fb + k];
+                const int* eb_vertices = &_edge_vertices[2 * eb];
+                if (_bottom_edge_owner[eb] != fb || shares_coincident(et_vertices, 2, eb_vertices, 2)) {
+                    continue;
+                }
+                if (edge_edge_crossing(top_motion(et_vertices[0]), top_motion(et_vertices[1]),
+                                       bottom_motion(eb_vertices[0]), bottom_motion(eb_vertices[1]))) {
+                    for (int side = 0; side < 2; ++side) {
+                        if (_edge_faces[2 * et + side] != -1) {
+                            flag(_edge_faces[2 * et + side]);
+                        }
+                    }
+                    n_crossings++;
+                }
+            }
+        }
+    }
+
+    _top_previous = top_points;
+    _bottom_previous = bottom_points;
+
+    return n_crossings;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto LayerCCD::crossed_faces() const -> std::vector<int>
+{
+    std::vector<int> faces;
+    for (size_t f = 0; f < _crossed.size(); ++f) {
+        if (_crossed[f]) {
+            faces.push_back(static_cast<int>(f));
+        }
+    }
+    return faces;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
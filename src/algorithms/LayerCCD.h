@@ -0,0 +1,81 @@
+//======================================================================================================================
+// Copyright (c) the Authors 2024
+//
+// This work is licensed under a
+// Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+//
+// You should have received a copy of the license along with this
+// work. If not, see <http://creativecommons.org/licenses/by-nc-sa/4.0/>.
+//
+//======================================================================================================================
+
+#ifndef TAILORME_VIEWER_LAYERCCD_H
+#define TAILORME_VIEWER_LAYERCCD_H
+
+#include <vector>
+
+#include <pmp/surface_mesh.h>
+
+#include "algorithms/TriangleBVH.h"
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+// Continuous collision detection between two layers with the same connectivity (skin over full skeleton wrap,
+// vertex i of one layer corresponds to vertex i of the other).
+// Starting from an intersection free state, every advance() tests the linear motion of both layers from the tracked
+// to the current positions (vertex-face and edge-edge), and flags the top layer faces around every crossing.
+// Only these faces can have become intersecting, so the resolve afterwards only needs to check them.
+class LayerCCD {
+  protected:
+    // swept boxes, built once per topology and refitted every frame
+    TriangleBVH _top_bvh{};
+    TriangleBVH _bottom_bvh{};
+
+    // positions at the last reset() / advance()
+    std::vector<pmp::Point> _top_previous{};
+    std::vector<pmp::Point> _bottom_previous{};
+
+    // connectivity (shared by both layers): 3 edges per face, 2 vertices and 2 faces per edge
+    std::vector<int> _face_edges{};
+    std::vector<int> _edge_vertices{};
+    std::vector<int> _edge_faces{};
+    // not ignored top faces around each vertex (CSR)
+    std::vector<int> _vertex_face_offsets{};
+    std::vector<int> _vertex_faces{};
+
+    // every vertex and edge is tested from one of its faces only (-1: never tested)
+    std::vector<int> _top_vertex_owner{};
+    std::vector<int> _bottom_vertex_owner{};
+    std::vector<int> _top_edge_owner{};
+    std::vector<int> _bottom_edge_owner{};
+
+    // crossed top faces since the last reset()
+    std::vector<unsigned char> _crossed{};
+    bool _tracking = false;
+
+  public:
+    LayerCCD() = default;
+
+    // start tracking from the current positions, which should be free of intersections.
+    // ignored_top_faces: optional mask (per face), masked top faces are neither tested nor reported
+    auto reset(const pmp::SurfaceMesh& top, const pmp::SurfaceMesh& bottom,
+               const std::vector<bool>& ignored_top_faces = {}) -> void;
+
+    // tests the motion from the tracked to the current positions and tracks the current positions afterwards.
+    // returns the number of crossings, or -1 if not tracking (then the layers have to be checked completely)
+    auto advance(const pmp::SurfaceMesh& top, const pmp::SurfaceMesh& bottom) -> int;
+
+    // positions changed without continuous test, everything has to be checked on the next resolve
+    auto invalidate() -> void { _tracking = false; }
+
+    [[nodiscard]]
+    auto tracking() const -> bool { return _tracking; }
+
+    // sorted top faces flagged since the last reset()
+    [[nodiscard]]
+    auto crossed_faces() const -> std::vector<int>;
+};
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+#endif // TAILORME_VIEWER_LAYERCCD_H
@@ -2,341 +2,692 @@
 
 #include "LayerCollisionResolve.h"
 
-#include <set>
+#include <algorithm>
 #include <fstream>
 #include <pmp/stop_watch.h>
 #include <pmp/io/io.h>
+#include <pmp/algorithms/decimation.h>
 
 #include <shapeop/Solver.h>
-#include <shapeop/Constraint.h>
+#include <shapeop/ConstraintSet.h>
 
-#include "algorithms/TriTriIntersect.h"
+#include "algorithms/TriangleBVH.h"
+#include "algorithms/TriTriBatch.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 //-----------------------------------------------------------------------------
 
-bool resolve_layer_intersections_by_bottom_layer(pmp::SurfaceMesh& top_layer,
-                                                 pmp::SurfaceMesh& bottom_layer,
-                                                 pmp::VertexProperty<bool> locked)
+bool init_collision_context(const pmp::SurfaceMesh& mesh,
+                            pmp::VertexProperty<bool> locked,
+                            CollisionContext& out_context)
 {
     if (!locked)
     {
-        printf("[ERROR] resolve_layer_intersections(): No locked vertices defined\n");
+        printf("[ERROR] init_collision_context(): No locked vertices defined\n");
         return false;
     }
-    int max_iter = 30;
-    int iter = 0;
+    if (!mesh.is_triangle_mesh())
+    {
+        printf("[ERROR] init_collision_context(): Only triangle meshes are supported\n");
+        return false;
+    }
+
+    CollisionContext& ctx = out_context;
+    ctx = CollisionContext();
+    ctx.n_vertices = mesh.vertices_size();
+    ctx.n_faces = mesh.faces_size();
 
-    // List of faces to check, we are only interested in faces, where all vertices are free
-    // TODO(swenninger): Speed - this could be done once up front
-    std::vector<pmp::Face> faces_to_check;
-    for (auto f : top_layer.faces())
+    ctx.face_vertices.assign(3 * ctx.n_faces, 0);
+    for (auto f : mesh.faces())
+    {
+        int j = 0;
+        for (auto v : mesh.vertices(f))
+        {
+            ctx.face_vertices[3 * f.idx() + j++] = (int)v.idx();
+        }
+    }
+
+    // List of faces to check, we are only interested in faces, where not all vertices are locked
+    for (auto f : mesh.faces())
     {
-        // bool any_locked = false;
         bool all_locked = true;
-        for (auto v : top_layer.vertices(f))
+        for (auto v : mesh.vertices(f))
         {
-            if (locked[v])
-            {
-                // any_locked = true;
-            }
-            else
+            if (!locked[v])
             {
                 all_locked = false;
             }
         }
 
         if (!all_locked)
-            faces_to_check.push_back(f);
+            ctx.faces_to_check.push_back((int)f.idx());
     }
-
-    std::vector<std::vector<pmp::Face>> neighbors_to_check(faces_to_check.size());
-
-    #pragma omp parallel for
-    for (size_t i = 0; i < faces_to_check.size(); ++i)
+    ctx.check_index.assign(ctx.n_faces, -1);
+    for (size_t i = 0; i < ctx.faces_to_check.size(); ++i)
     {
-        auto f = faces_to_check[i];
-
-        std::vector<pmp::Vertex> v_neighbors;
-        std::set<pmp::Face> f_neighbors;
-
-        // Seperating axes test
-        Eigen::RowVector3f p1, q1, r1;
-        Eigen::RowVector3f p2, q2, r2;
+        ctx.check_index[ctx.faces_to_check[i]] = (int)i;
+    }
 
-        auto viter = top_layer.vertices(f);
+    // Faces incident to the 2-ring of the first vertex of each face
+    std::vector<std::vector<int>> neighbors(ctx.faces_to_check.size());
 
-        //v_neighbors.insert(*viter);
-        v_neighbors.push_back(*viter);
+    #pragma omp parallel
+    {
+        std::vector<int> ring;
+        std::vector<int> visited(ctx.n_vertices, -1);
 
-        for (int j = 0; j < 2; ++j)
+        #pragma omp for schedule(dynamic, 256)
+        for (size_t i = 0; i < ctx.faces_to_check.size(); ++i)
         {
-            std::vector<pmp::Vertex> new_vs;
-            for (auto vi : v_neighbors)
+            int first_vertex = ctx.face_vertices[3 * ctx.faces_to_check[i]];
+
+            // breadth first, visited is tagged by the face to check
+            ring.assign(1, first_vertex);
+            visited[first_vertex] = (int)i;
+            size_t ring_begin = 0;
+            for (int j = 0; j < 2; ++j)
             {
-                for (auto vj : top_layer.vertices(vi))
+                size_t ring_end = ring.size();
+                for (size_t k = ring_begin; k < ring_end; ++k)
                 {
-                    new_vs.push_back(vj);
+                    for (auto vj : mesh.vertices(pmp::Vertex(ring[k])))
+                    {
+                        if (visited[vj.idx()] != (int)i)
+                        {
+                            visited[vj.idx()] = (int)i;
+                            ring.push_back((int)vj.idx());
+                        }
+                    }
                 }
+                ring_begin = ring_end;
             }
 
-            for (auto vi : new_vs)
+            for (int vi : ring)
             {
-                // v_neighbors.insert(vi);
-                v_neighbors.push_back(vi);
+                for (auto fi : mesh.faces(pmp::Vertex(vi)))
+                {
+                    neighbors[i].push_back((int)fi.idx());
+                }
             }
+            std::sort(neighbors[i].begin(), neighbors[i].end());
+            neighbors[i].erase(std::unique(neighbors[i].begin(), neighbors[i].end()), neighbors[i].end());
         }
+    }
 
-        for (auto vi : v_neighbors)
+    ctx.neighbor_offsets.resize(ctx.faces_to_check.size() + 1, 0);
+    for (size_t i = 0; i < neighbors.size(); ++i)
+    {
+        ctx.neighbor_offsets[i + 1] = ctx.neighbor_offsets[i] + (int)neighbors[i].size();
+    }
+    ctx.neighbor_faces.reserve(ctx.neighbor_offsets.back());
+    for (const auto& n : neighbors)
+    {
+        ctx.neighbor_faces.insert(ctx.neighbor_faces.end(), n.begin(), n.end());
+    }
+
+    // Build mapping from vertex index to index in shapeop simulation
+    // (free vertices and locked vertices with a free neighbor)
+    ctx.sim_idx.assign(ctx.n_vertices, -1);
+    for (auto v : mesh.vertices())
+    {
+        bool simulated = !locked[v];
+        for (auto vj : mesh.vertices(v))
         {
-            for (auto fi : top_layer.faces(vi))
+            if (!locked[vj])
             {
-                f_neighbors.insert(fi);
+                simulated = true;
+                break;
             }
         }
 
-        for (auto fi : f_neighbors)
+        if (simulated)
         {
-            neighbors_to_check[i].push_back(fi);
+            ctx.sim_idx[v.idx()] = (int)ctx.sim_vertices.size();
+            ctx.sim_vertices.push_back((int)v.idx());
+            ctx.sim_locked.push_back(locked[v]);
         }
     }
+    ctx.num_sim_vertices = (int)ctx.sim_vertices.size();
 
-    // Build mapping from vertex index to index in shapeop simulation
-    // TODO(swenninger): Speed - this could be done once up front
-    auto sim_idx = top_layer.vertex_property<int>("v:collision_sim_idx");
-
-    int num_sim_vertices = 0;
+    // Free neighbors, used to grow the set of moving vertices
+    ctx.free_neighbor_offsets.resize(ctx.num_sim_vertices + 1, 0);
+    for (int i = 0; i < ctx.num_sim_vertices; ++i)
     {
-        int idx = 0;
-        for (auto v : top_layer.vertices())
+        for (auto vj : mesh.vertices(pmp::Vertex(ctx.sim_vertices[i])))
         {
-            if (!locked[v])
+            if (!locked[vj])
             {
-                sim_idx[v] = idx++;
+                ctx.free_neighbors.push_back(ctx.sim_idx[vj.idx()]);
             }
-            else
-            {
-                // Check if we have a free neighbor
-                bool all_neighbors_locked = true;
+        }
+        ctx.free_neighbor_offsets[i + 1] = (int)ctx.free_neighbors.size();
+    }
 
-                for (auto vj : top_layer.vertices(v))
-                {
-                    if (!locked[vj])
-                    {
-                        all_neighbors_locked = false;
-                        break;
-                    }
-                }
+    // Triangle pairs of free vertices, regularized by bending constraints
+    for (pmp::Edge e : mesh.edges())
+    {
+        pmp::Halfedge h0 = mesh.halfedge(e, 0);
+        pmp::Halfedge h1 = mesh.halfedge(e, 1);
 
-                if (all_neighbors_locked)
-                {
-                    sim_idx[v] = -1;
-                }
-                else
+        pmp::Vertex v0 = mesh.to_vertex(h0);
+        pmp::Vertex v1 = mesh.to_vertex(h1);
+        pmp::Vertex v2 = mesh.to_vertex(mesh.next_halfedge(h0));
+        pmp::Vertex v3 = mesh.to_vertex(mesh.next_halfedge(h1));
+
+        if (locked[v0] || locked[v1] || locked[v2] || locked[v3])
+        {
+            continue;
+        }
+
+        ctx.bending_quads.push_back(ctx.sim_idx[v0.idx()]);
+        ctx.bending_quads.push_back(ctx.sim_idx[v1.idx()]);
+        ctx.bending_quads.push_back(ctx.sim_idx[v2.idx()]);
+        ctx.bending_quads.push_back(ctx.sim_idx[v3.idx()]);
+    }
+
+    // Quads per simulated vertex, to gather the bending constraints of a region
+    ctx.vertex_quad_offsets.assign(ctx.num_sim_vertices + 1, 0);
+    for (int i : ctx.bending_quads)
+    {
+        ctx.vertex_quad_offsets[i + 1]++;
+    }
+    for (int i = 0; i < ctx.num_sim_vertices; ++i)
+    {
+        ctx.vertex_quad_offsets[i + 1] += ctx.vertex_quad_offsets[i];
+    }
+    ctx.vertex_quads.resize(ctx.bending_quads.size());
+    std::vector<int> fill(ctx.vertex_quad_offsets.begin(), ctx.vertex_quad_offsets.end() - 1);
+    for (size_t k = 0; k < ctx.bending_quads.size(); ++k)
+    {
+        ctx.vertex_quads[fill[ctx.bending_quads[k]]++] = (int)(k / 4);
+    }
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+bool init_collision_proxy(const pmp::SurfaceMesh& mesh,
+                          pmp::VertexProperty<bool> locked,
+                          unsigned int n_vertices,
+                          CollisionProxy& out_proxy)
+{
+    if (!locked)
+    {
+        printf("[ERROR] init_collision_proxy(): No locked vertices defined\n");
+        return false;
+    }
+    if (!mesh.is_triangle_mesh())
+    {
+        printf("[ERROR] init_collision_proxy(): Only triangle meshes are supported\n");
+        return false;
+    }
+
+    CollisionProxy& proxy = out_proxy;
+    proxy = CollisionProxy();
+
+    // Copy of the connectivity only, decimation keeps the positions of the remaining vertices
+    pmp::SurfaceMesh& coarse = proxy.mesh;
+    auto full_index = coarse.add_vertex_property<int>("v:full_index", -1);
+    for (auto v : mesh.vertices())
+    {
+        full_index[coarse.add_vertex(mesh.position(v))] = (int)v.idx();
+    }
+    std::vector<pmp::Vertex> face;
+    for (auto f : mesh.faces())
+    {
+        face.clear();
+        for (auto v : mesh.vertices(f))
+        {
+            face.push_back(v);
+        }
+        coarse.add_face(face);
+    }
+
+    // Only vertices whose 2-ring is completely free or completely locked are removed. The faces around the
+    // border keep their resolution, long faces across it would intersect the locked part of the bottom layer.
+    auto selected = coarse.add_vertex_property<bool>("v:selected", true);
+    for (auto v : mesh.vertices())
+    {
+        for (auto vj : mesh.vertices(v))
+        {
+            if (locked[vj] != locked[v])
+            {
+                selected[pmp::Vertex(v.idx())] = false;
+                for (auto vk : mesh.vertices(v))
                 {
-                    sim_idx[v] = idx++;
+                    selected[pmp::Vertex(vk.idx())] = false;
                 }
+                break;
             }
         }
-
-        num_sim_vertices = idx;
     }
 
-    ShapeOp::Matrix3X points(3, num_sim_vertices);
-    std::vector<bool> non_colliding(num_sim_vertices, true);
-    auto collision_n = top_layer.vertex_property<pmp::dvec3>("v:collision_n");
+    try
+    {
+        pmp::decimate(coarse, n_vertices, 10.0);
+    }
+    catch (const std::exception& e)
+    {
+        printf("[ERROR] init_collision_proxy(): %s\n", e.what());
+        return false;
+    }
 
+    auto coarse_locked = coarse.vertex_property<bool>("v:collision_resolve_locked", false);
+    for (auto v : coarse.vertices())
+    {
+        proxy.vertices.push_back(full_index[v]);
+        coarse_locked[v] = locked[pmp::Vertex(full_index[v])];
+    }
+    coarse.remove_vertex_property(full_index);
+    coarse.remove_vertex_property(selected);
 
-    auto efeature = top_layer.edge_property<bool>("e:feature", false);
-    auto f_collides = top_layer.face_property<bool>("f:collides", false);
+    if (!init_collision_context(coarse, coarse_locked, proxy.context))
+    {
+        return false;
+    }
 
-    while (iter < max_iter)
+    // Barycentric coordinates in the closest proxy face, proxy vertices only depend on themselves
+    std::vector<int> proxy_index(mesh.vertices_size(), -1);
+    for (size_t i = 0; i < proxy.vertices.size(); ++i)
     {
-        int n_collisions = 0;
+        proxy_index[proxy.vertices[i]] = (int)i;
+    }
 
-        // Reset collision state
-        non_colliding.assign(num_sim_vertices, true);
-        efeature.vector().assign(top_layer.n_edges(), false);
-        f_collides.vector().assign(top_layer.n_faces(), false);
+    TriangleBVH bvh;
+    bvh.build(coarse);
+    const std::vector<pmp::Point>& coarse_points = coarse.get_vertex_property<pmp::Point>("v:point").vector();
 
-        std::vector<pmp::Face> colliding_faces = {};
+    proxy.prolongation_vertices.assign(3 * mesh.vertices_size(), 0);
+    proxy.prolongation_weights.assign(3 * mesh.vertices_size(), 0.0f);
 
-        Eigen::RowVector3f collision_start;
-        Eigen::RowVector3f collision_end;
+    #pragma omp parallel for schedule(dynamic, 256)
+    for (int v = 0; v < (int)mesh.vertices_size(); ++v)
+    {
+        if (locked[pmp::Vertex(v)])
+        {
+            continue;
+        }
+        if (proxy_index[v] != -1)
+        {
+            proxy.prolongation_vertices[3 * v] = proxy_index[v];
+            proxy.prolongation_weights[3 * v] = 1.0f;
+            continue;
+        }
 
-        #pragma omp parallel for
-        for (size_t i = 0; i < faces_to_check.size(); ++i)
+        pmp::dvec3 closest;
+        TriangleRegion region;
+        int f = bvh.closest_point(coarse_points, mesh.position(pmp::Vertex(v)), closest, region);
+        const std::array<int, 3>& ids = bvh.face_vertices(f);
+
+        pmp::dvec3 a(coarse_points[ids[0]]);
+        pmp::dvec3 e1 = pmp::dvec3(coarse_points[ids[1]]) - a;
+        pmp::dvec3 e2 = pmp::dvec3(coarse_points[ids[2]]) - a;
+        pmp::dvec3 d = closest - a;
+        double d11 = pmp::dot(e1, e1), d12 = pmp::dot(e1, e2), d22 = pmp::dot(e2, e2);
+        double denom = d11 * d22 - d12 * d12;
+        double w1 = 1.0 / 3.0, w2 = 1.0 / 3.0;
+        if (denom > 1e-20)
         {
-            auto f = faces_to_check[i];
+            w1 = (d22 * pmp::dot(d, e1) - d12 * pmp::dot(d, e2)) / denom;
+            w2 = (d11 * pmp::dot(d, e2) - d12 * pmp::dot(d, e1)) / denom;
+        }
 
-            // Seperating axes test
-            Eigen::RowVector3f p1, q1, r1;
-            Eigen::RowVector3f p2, q2, r2;
+        for (int j = 0; j < 3; ++j)
+        {
+            proxy.prolongation_vertices[3 * v + j] = ids[j];
+        }
+        proxy.prolongation_weights[3 * v] = (float)(1.0 - w1 - w2);
+        proxy.prolongation_weights[3 * v + 1] = (float)w1;
+        proxy.prolongation_weights[3 * v + 2] = (float)w2;
+    }
 
-            auto viter = top_layer.vertices(f);
+    return true;
+}
 
-            p1 = (Eigen::Vector3f)top_layer.position(*viter);
-            p2 = (Eigen::Vector3f)bottom_layer.position(*viter);
-            ++viter;
-            q1 = (Eigen::Vector3f)top_layer.position(*viter);
-            q2 = (Eigen::Vector3f)bottom_layer.position(*viter);
-            ++viter;
-            r1 = (Eigen::Vector3f)top_layer.position(*viter);
-            r2 = (Eigen::Vector3f)bottom_layer.position(*viter);
+//-----------------------------------------------------------------------------
 
-            // Eigen::RowVector3f n_top    = (p1 - r1).cross(q1 - r1).normalized();
-            Eigen::RowVector3f n_bottom = (p2 - r2).cross(q2 - r2).normalized();
+bool resolve_layer_intersections_by_bottom_layer(pmp::SurfaceMesh& top_layer,
+                                                 pmp::SurfaceMesh& bottom_layer,
+                                                 pmp::VertexProperty<bool> locked)
+{
+    CollisionContext context;
+    if (!init_collision_context(top_layer, locked, context))
+    {
+        printf("[ERROR] resolve_layer_intersections(): Cannot build collision context\n");
+        return false;
+    }
 
-            for (auto fi : neighbors_to_check[i])
-            {
-                viter = top_layer.vertices(fi);
-                p2 = (Eigen::Vector3f)bottom_layer.position(*viter);
-                ++viter;
-                q2 = (Eigen::Vector3f)bottom_layer.position(*viter);
-                ++viter;
-                r2 = (Eigen::Vector3f)bottom_layer.position(*viter);
-
-                bool coplanar;
-                if (igl::tri_tri_intersection_test_3d(p1, q1, r1, p2, q2, r2, coplanar, collision_start, collision_end))
-                {
-                    n_collisions++;
+    return resolve_layer_intersections_by_bottom_layer(top_layer, bottom_layer, context);
+}
 
-                    f_collides[f] = true;
+//-----------------------------------------------------------------------------
 
-                    for (auto v : top_layer.vertices(f))
-                    {
-                        non_colliding[sim_idx[v]] = false;
-                        collision_n[v] = (Eigen::Vector3f)n_bottom;
-                    }
+// A face of the top layer that intersects the bottom layer, with the normal of
+// the corresponding bottom layer face
+struct LayerCollision
+{
+    int face;
+    pmp::dvec3 normal;
+};
+
+//-----------------------------------------------------------------------------
+
+// Every thread collects the collisions of its static chunk of faces_to_check in
+// a local list. The chunks are concatenated in thread order, so the result is
+// sorted by position in faces_to_check and independent of the thread count.
+// checks: optional sorted positions in faces_to_check, only these are tested
+static void detect_layer_collisions(const pmp::SurfaceMesh& top_layer,
+                                    const pmp::SurfaceMesh& bottom_layer,
+                                    const CollisionContext& context,
+                                    const std::vector<int>* checks,
+                                    std::vector<LayerCollision>& out_collisions)
+{
+    size_t n_checks = checks ? checks->size() : context.faces_to_check.size();
+    const std::vector<int>& fv = context.face_vertices;
+    const std::vector<pmp::Point>& top_points = top_layer.get_vertex_property<pmp::Point>("v:point").vector();
+    const std::vector<pmp::Point>& bottom_points = bottom_layer.get_vertex_property<pmp::Point>("v:point").vector();
+    int n_threads = 1;
+#ifdef _OPENMP
+    n_threads = omp_get_max_threads();
+#endif
+    std::vector<std::vector<LayerCollision>> thread_collisions(n_threads);
+
+    #pragma omp parallel num_threads(n_threads)
+    {
+        int thread = 0;
+#ifdef _OPENMP
+        thread = omp_get_thread_num();
+#endif
+        std::vector<LayerCollision>& local = thread_collisions[thread];
+        local.clear();
 
-                    break;
+        TriangleBatch batch;
+
+        #pragma omp for schedule(static)
+        for (size_t c = 0; c < n_checks; ++c)
+        {
+            size_t i = checks ? (size_t)(*checks)[c] : c;
+            int f = context.faces_to_check[i];
+
+            const pmp::Point& p1 = top_points[fv[3 * f]];
+            const pmp::Point& q1 = top_points[fv[3 * f + 1]];
+            const pmp::Point& r1 = top_points[fv[3 * f + 2]];
+
+            // Test against the bottom layer faces around f, in batches
+            bool collides = false;
+            int k = context.neighbor_offsets[i];
+            while (!collides && k < context.neighbor_offsets[i + 1])
+            {
+                batch.clear();
+                for (; k < context.neighbor_offsets[i + 1] && !batch.full(); ++k)
+                {
+                    int fi = context.neighbor_faces[k];
+                    batch.push_back(bottom_points[fv[3 * fi]], bottom_points[fv[3 * fi + 1]],
+                                    bottom_points[fv[3 * fi + 2]]);
                 }
+                collides = tri_tri_intersect_batch(p1, q1, r1, batch) != 0;
+            }
+
+            if (collides)
+            {
+                const pmp::Point& p2 = bottom_points[fv[3 * f]];
+                const pmp::Point& q2 = bottom_points[fv[3 * f + 1]];
+                const pmp::Point& r2 = bottom_points[fv[3 * f + 2]];
+                Eigen::Vector3f n_bottom = Eigen::Vector3f(p2[0] - r2[0], p2[1] - r2[1], p2[2] - r2[2])
+                                               .cross(Eigen::Vector3f(q2[0] - r2[0], q2[1] - r2[1], q2[2] - r2[2]))
+                                               .normalized();
+                local.push_back({f, pmp::dvec3(n_bottom[0], n_bottom[1], n_bottom[2])});
             }
         }
+    }
 
-        if (n_collisions == 0)
+    out_collisions.clear();
+    for (const auto& local : thread_collisions)
+    {
+        out_collisions.insert(out_collisions.end(), local.begin(), local.end());
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+// checks: optional region, sorted positions in faces_to_check. It grows by the
+// faces around the vertices that move, which can collide afterwards. Without a
+// region all faces are checked once and the colliding ones become the region.
+static bool resolve_layer_intersections(pmp::SurfaceMesh& top_layer,
+                                        pmp::SurfaceMesh& bottom_layer,
+                                        const CollisionContext& context,
+                                        std::vector<int>* checks,
+                                        int max_iter = 30)
+{
+    if (context.n_vertices != top_layer.vertices_size() || context.n_faces != top_layer.faces_size() ||
+        context.n_vertices != bottom_layer.vertices_size())
+    {
+        printf("[ERROR] resolve_layer_intersections(): Collision context does not match the layers\n");
+        return false;
+    }
+    int iter = 0;
+
+    const std::vector<int>& sim_idx = context.sim_idx;
+    const std::vector<int>& fv = context.face_vertices;
+    int num_sim_vertices = context.num_sim_vertices;
+
+    ShapeOp::Matrix3X points;
+    std::vector<LayerCollision> collisions_found;
+    // moving (1: colliding or in the ring around a collision, 2: margin) flag and list of simulated vertices
+    std::vector<unsigned char> moving(num_sim_vertices, 0);
+    std::vector<int> moving_vertices;
+    std::vector<pmp::dvec3> collision_n(num_sim_vertices);
+    // simulated region (moving vertices and margin), simulation index -> index in the region
+    std::vector<int> region_vertices;
+    std::vector<int> region_idx(num_sim_vertices, -1);
+    std::vector<int> region_quads;
+
+
+    // Constraints are stored per type in flat arrays, refilled in every iteration
+    auto closeness = std::make_shared<ShapeOp::ClosenessConstraintSet>();
+    auto collisions = std::make_shared<ShapeOp::PlaneCollisionConstraintSet>();
+    auto bending = std::make_shared<ShapeOp::BendingConstraintSet>();
+    closeness->reserve(num_sim_vertices);
+    collisions->reserve(num_sim_vertices);
+    bending->reserve((int)context.bending_quads.size() / 4);
+
+    ShapeOp::Solver so_solver;
+    so_solver.setGlobalSolver(ShapeOp::Solver::GlobalSolver::LDLTMultiRHS);
+    so_solver.addConstraintSet(closeness);
+    so_solver.addConstraintSet(collisions);
+    so_solver.addConstraintSet(bending);
+
+    auto f_collides = top_layer.face_property<bool>("f:collides", false);
+
+    // region: checked flag per face to check, vertices around the moved ones
+    std::vector<int> collision_checks;
+    std::vector<unsigned char> in_region;
+    std::vector<int> visited;
+    std::vector<int> ring;
+    auto init_region = [&]() {
+        in_region.assign(context.faces_to_check.size(), 0);
+        for (int i : *checks)
         {
+            in_region[i] = 1;
+        }
+        visited.assign(context.n_vertices, 0);
+    };
+    if (checks)
+    {
+        init_region();
+    }
+
+    bool resolved = false;
+    while (iter <= max_iter)
+    {
+        // Reset collision state
+        f_collides.vector().assign(top_layer.n_faces(), false);
+
+        detect_layer_collisions(top_layer, bottom_layer, context, checks, collisions_found);
+
+        if (collisions_found.empty())
+        {
+            resolved = true;
             break;
         }
 
+        // The last detection only tells whether the last iteration resolved everything
+        if (iter == max_iter)
+        {
+            break;
+        }
+
+        // Faces that did not collide can only collide after the vertices around them moved
+        if (!checks)
+        {
+            for (const LayerCollision& c : collisions_found)
+            {
+                collision_checks.push_back(context.check_index[c.face]);
+            }
+            checks = &collision_checks;
+            init_region();
+        }
+
+        // Mark vertices of colliding faces, in face order (the last face wins the normal)
+        moving_vertices.clear();
+        for (const LayerCollision& c : collisions_found)
+        {
+            f_collides[pmp::Face(c.face)] = true;
+
+            for (int j = 0; j < 3; ++j)
+            {
+                int i = sim_idx[fv[3 * c.face + j]];
+                collision_n[i] = c.normal;
+                if (!moving[i])
+                {
+                    moving[i] = 1;
+                    moving_vertices.push_back(i);
+                }
+            }
+        }
+
         // Allow 'n_rings'-ring-neighborhood of moving layer vertices to move also
         {
             int n_rings = 2;
+            size_t ring_begin = 0;
             for (int j = 0; j < n_rings; ++j)
             {
-                std::vector<pmp::Vertex> new_vs;
-                for (pmp::Vertex vi : top_layer.vertices())
+                size_t ring_end = moving_vertices.size();
+                for (size_t r = ring_begin; r < ring_end; ++r)
                 {
-                    if (!non_colliding[sim_idx[vi]])
+                    int i = moving_vertices[r];
+                    for (int k = context.free_neighbor_offsets[i]; k < context.free_neighbor_offsets[i + 1]; ++k)
                     {
-                        for (pmp::Vertex vj : top_layer.vertices(vi))
+                        int nb = context.free_neighbors[k];
+                        if (!moving[nb])
                         {
-                            if (!locked[vj])
-                            {
-                                new_vs.push_back(vj);
-                            }
+                            moving[nb] = 1;
+                            moving_vertices.push_back(nb);
                         }
                     }
                 }
-
-                for (pmp::Vertex v : new_vs)
-                {
-                    non_colliding[sim_idx[v]] = false;
-                }
+                ring_begin = ring_end;
             }
         }
+        std::sort(moving_vertices.begin(), moving_vertices.end());
 
-        // Gather points
+        // Only a margin around the moving vertices is simulated with them, the rest of the layer stays fixed
+        region_vertices = moving_vertices;
         {
-            for (pmp::Vertex v : bottom_layer.vertices())
+            int n_margin_rings = 3;
+            size_t ring_begin = 0;
+            for (int j = 0; j < n_margin_rings; ++j)
             {
-                if (sim_idx[v] != -1)
+                size_t ring_end = region_vertices.size();
+                for (size_t r = ring_begin; r < ring_end; ++r)
                 {
-                    points.col(sim_idx[v]) = (ShapeOp::Vector3)bottom_layer.position(v);
+                    int i = region_vertices[r];
+                    for (int k = context.free_neighbor_offsets[i]; k < context.free_neighbor_offsets[i + 1]; ++k)
+                    {
+                        int nb = context.free_neighbors[k];
+                        if (!moving[nb])
+                        {
+                            moving[nb] = 2;
+                            region_vertices.push_back(nb);
+                        }
+                    }
                 }
+                ring_begin = ring_end;
             }
         }
+        std::sort(region_vertices.begin(), region_vertices.end());
+        int num_region_vertices = (int)region_vertices.size();
+        for (int r = 0; r < num_region_vertices; ++r)
+        {
+            region_idx[region_vertices[r]] = r;
+        }
 
-        ShapeOp::Solver so_solver;
-        so_solver.setPoints(points);
-
-        // Keep almost all vertices fixed
-        std::vector<int> vertex_id(1, -1);
-        for (auto v : top_layer.vertices())
+        // Gather points
+        points.resize(3, num_region_vertices);
+        for (int r = 0; r < num_region_vertices; ++r)
         {
-            if (sim_idx[v] == -1)
-                continue;
+            points.col(r) = (ShapeOp::Vector3)bottom_layer.position(pmp::Vertex(context.sim_vertices[region_vertices[r]]));
+        }
 
-            vertex_id[0] = sim_idx[v];
+        so_solver.setPoints(points);
+        closeness->clear();
+        collisions->clear();
+        bending->clear();
 
-            if (non_colliding[vertex_id[0]])
+        // Keep the margin (almost) fixed
+        for (int r = 0; r < num_region_vertices; ++r)
+        {
+            int i = region_vertices[r];
+            if (moving[i] == 2)
             {
-                double weight = locked[v] ? 100.0 : 1.0;
-
-                auto c = std::make_shared<ShapeOp::ClosenessConstraint>
-                    (vertex_id, weight, so_solver.getPoints());
-
-                so_solver.addConstraint(c);
+                double weight = context.sim_locked[i] ? 100.0 : 1.0;
+                closeness->add(r, weight, points.col(r));
             }
         }
 
-        int n_collision_constraints = 0;
-        for (pmp::Vertex v : top_layer.vertices())
+        for (int i : moving_vertices)
         {
-            if (sim_idx[v] == -1)
-                continue;
+            pmp::Point p_top = top_layer.position(pmp::Vertex(context.sim_vertices[i]));
 
-            vertex_id[0] = sim_idx[v];
+            // Successively add weight and collision_resolve_distance,
+            // if it does not succeed in previous iterations
+            double weight = (iter + 1) * 50.0;
+            double dist_to_move_in_collision_n = 0.0025; // + iter * 0.0005;
 
-            if (!non_colliding[vertex_id[0]])
-            {
-                pmp::Point p_top = top_layer.position(v);
-
-                // Successively add weight and collision_resolve_distance,
-                // if it does not succeed in previous iterations
-                double weight = (iter + 1) * 50.0;
-                double dist_to_move_in_collision_n = 0.0025; // + iter * 0.0005;
-
-                auto c = std::make_shared<ShapeOp::PlaneCollisionConstraint>
-                    (vertex_id, weight, so_solver.getPoints(), p_top, collision_n[v], dist_to_move_in_collision_n);
-
-                so_solver.addConstraint(c);
-                n_collision_constraints++;
-            }
+            collisions->add(region_idx[i], weight, (ShapeOp::Vector3)p_top, collision_n[i], dist_to_move_in_collision_n);
         }
 
-        // Regularize triangle shape of top layer
-        std::vector<int> triangle_pair_ids(4, -1);
-
-        // TODO(swenninger): Speed - we could build a vector of triangle_pair_ids up front,
-        //                   since we always add bending constraings for the same faces.
-        //                   Then the halfedge/to_vertex/next_halfedge topology lookups would be gone.
-        for (pmp::Edge e : bottom_layer.edges())
+        // Regularize triangle shape of top layer (triangle pairs inside the region)
+        region_quads.clear();
+        for (int i : region_vertices)
         {
-            pmp::Halfedge h0 = bottom_layer.halfedge(e, 0);
-            pmp::Halfedge h1 = bottom_layer.halfedge(e, 1);
-
-            pmp::Vertex v0 = bottom_layer.to_vertex(h0);
-            pmp::Vertex v1 = bottom_layer.to_vertex(h1);
-            pmp::Vertex v2 = bottom_layer.to_vertex(bottom_layer.next_halfedge(h0));
-            pmp::Vertex v3 = bottom_layer.to_vertex(bottom_layer.next_halfedge(h1));
-
-            if (locked[v0] || locked[v1] || locked[v2] || locked[v3])
+            region_quads.insert(region_quads.end(), context.vertex_quads.begin() + context.vertex_quad_offsets[i],
+                                context.vertex_quads.begin() + context.vertex_quad_offsets[i + 1]);
+        }
+        std::sort(region_quads.begin(), region_quads.end());
+        region_quads.erase(std::unique(region_quads.begin(), region_quads.end()), region_quads.end());
+        for (int q : region_quads)
+        {
+            int ids[4];
+            bool inside = true;
+            for (int j = 0; j < 4; ++j)
             {
-                continue;
+                ids[j] = region_idx[context.bending_quads[4 * q + j]];
+                inside = inside && ids[j] != -1;
+            }
+            if (inside)
+            {
+                bending->add(ids, 1.0, points, 0.9, 1.1);
             }
-
-            triangle_pair_ids[0] = sim_idx[v0];
-            triangle_pair_ids[1] = sim_idx[v1];
-            triangle_pair_ids[2] = sim_idx[v2];
-            triangle_pair_ids[3] = sim_idx[v3];
-
-            auto c = std::make_shared<ShapeOp::BendingConstraint>
-                (triangle_pair_ids, 1.0, so_solver.getPoints(), 0.9, 1.1);
-
-            so_solver.addConstraint(c);
         }
 
-        if (!so_solver.initialize())
+        // The region follows the collisions, so it usually differs from the last iteration and the
+        // solver is initialized again. The symbolic factorization is only reused for a repeated region.
+        if (!so_solver.refactorize())
         {
             printf("[ERROR] Cannot initialize shape op solver\n");
         }
@@ -347,24 +698,251 @@ bool resolve_layer_intersections_by_bottom_layer(pmp::SurfaceMesh& top_layer,
         }
 
         const ShapeOp::Matrix3X& result_points = so_solver.getPoints();
+        for (int r = 0; r < num_region_vertices; ++r)
+        {
+            bottom_layer.position(pmp::Vertex(context.sim_vertices[region_vertices[r]])) = (pmp::vec3)result_points.col(r);
+        }
+
+        for (int i : region_vertices)
+        {
+            moving[i] = 0;
+            region_idx[i] = -1;
+        }
+
+        // Faces to check that are tested against a bottom face with a moved vertex, their
+        // first vertex (center of the tested 2-ring) is within the 3-ring of the moved vertex
+        if (checks)
         {
-            for (pmp::Vertex v : bottom_layer.vertices())
+            ring.clear();
+            for (int i : region_vertices)
             {
-                if (sim_idx[v] != -1)
+                int v = context.sim_vertices[i];
+                if (!visited[v])
                 {
-                    bottom_layer.position(v) = (pmp::vec3)result_points.col(sim_idx[v]);
+                    visited[v] = 1;
+                    ring.push_back(v);
                 }
             }
+            size_t ring_begin = 0;
+            for (int j = 0; j < 3; ++j)
+            {
+                size_t ring_end = ring.size();
+                for (size_t k = ring_begin; k < ring_end; ++k)
+                {
+                    for (auto vj : top_layer.vertices(pmp::Vertex(ring[k])))
+                    {
+                        if (!visited[vj.idx()])
+                        {
+                            visited[vj.idx()] = 1;
+                            ring.push_back((int)vj.idx());
+                        }
+                    }
+                }
+                ring_begin = ring_end;
+            }
+
+            for (int v : ring)
+            {
+                for (auto f : top_layer.faces(pmp::Vertex(v)))
+                {
+                    int i = context.check_index[f.idx()];
+                    if (i != -1 && !in_region[i])
+                    {
+                        in_region[i] = 1;
+                        checks->push_back(i);
+                    }
+                }
+            }
+            std::sort(checks->begin(), checks->end());
+            for (int v : ring)
+            {
+                visited[v] = 0;
+            }
         }
 
         iter++;
     }
 
     top_layer.remove_face_property(f_collides);
-    top_layer.remove_vertex_property(collision_n);
-    top_layer.remove_vertex_property(sim_idx);
 
-    return false;
+    return resolved;
+}
+
+//-----------------------------------------------------------------------------
+
+bool resolve_layer_intersections_by_bottom_layer(pmp::SurfaceMesh& top_layer,
+                                                 pmp::SurfaceMesh& bottom_layer,
+                                                 const CollisionContext& context)
+{
+    return resolve_layer_intersections(top_layer, bottom_layer, context, nullptr);
+}
+
+//-----------------------------------------------------------------------------
+
+bool resolve_layer_intersections_by_bottom_layer(pmp::SurfaceMesh& top_layer,
+                                                 pmp::SurfaceMesh& bottom_layer,
+                                                 const CollisionContext& context,
+                                                 const std::vector<int>& faces)
+{
+    if (context.check_index.size() != top_layer.faces_size())
+    {
+        printf("[ERROR] resolve_layer_intersections(): Collision context does not match the layers\n");
+        return false;
+    }
+
+    std::vector<int> checks;
+    for (int f : faces)
+    {
+        if (context.check_index[f] != -1)
+        {
+            checks.push_back(context.check_index[f]);
+        }
+    }
+    std::sort(checks.begin(), checks.end());
+    checks.erase(std::unique(checks.begin(), checks.end()), checks.end());
+
+    if (checks.empty())
+    {
+        return true;
+    }
+    return resolve_layer_intersections(top_layer, bottom_layer, context, &checks);
+}
+
+//-----------------------------------------------------------------------------
+
+bool resolve_layer_intersections_by_bottom_layer(pmp::SurfaceMesh& top_layer,
+                                                 pmp::SurfaceMesh& bottom_layer,
+                                                 const CollisionContext& context,
+                                                 const CollisionProxy& proxy)
+{
+    if (proxy.prolongation_vertices.size() != 3 * context.n_vertices ||
+        context.n_vertices != bottom_layer.vertices_size())
+    {
+        printf("[ERROR] resolve_layer_intersections(): Collision proxy does not match the layers\n");
+        return false;
+    }
+
+    // Restriction to the proxy vertices
+    pmp::SurfaceMesh proxy_top = proxy.mesh;
+    pmp::SurfaceMesh proxy_bottom = proxy.mesh;
+    for (size_t i = 0; i < proxy.vertices.size(); ++i)
+    {
+        proxy_top.position(pmp::Vertex(i)) = top_layer.position(pmp::Vertex(proxy.vertices[i]));
+        proxy_bottom.position(pmp::Vertex(i)) = bottom_layer.position(pmp::Vertex(proxy.vertices[i]));
+    }
+
+    // Intersections left on the proxy are resolved at full resolution anyway
+    resolve_layer_intersections(proxy_top, proxy_bottom, proxy.context, nullptr);
+
+    std::vector<pmp::Point> displacement(proxy.vertices.size());
+    for (size_t i = 0; i < proxy.vertices.size(); ++i)
+    {
+        displacement[i] = proxy_bottom.position(pmp::Vertex(i)) - bottom_layer.position(pmp::Vertex(proxy.vertices[i]));
+    }
+
+    // Prolongation
+    #pragma omp parallel for schedule(static)
+    for (int v = 0; v < (int)context.n_vertices; ++v)
+    {
+        pmp::Point d(0.0f);
+        for (int j = 0; j < 3; ++j)
+        {
+            d += proxy.prolongation_weights[3 * v + j] * displacement[proxy.prolongation_vertices[3 * v + j]];
+        }
+        bottom_layer.position(pmp::Vertex(v)) += d;
+    }
+
+    // Only the intersections left after the prolongation are resolved at full resolution,
+    // they are local (details below the proxy resolution) and usually need few iterations
+    std::vector<LayerCollision> residual;
+    detect_layer_collisions(top_layer, bottom_layer, context, nullptr, residual);
+    if (residual.empty())
+    {
+        return true;
+    }
+
+    std::vector<int> checks;
+    for (const LayerCollision& c : residual)
+    {
+        checks.push_back(context.check_index[c.face]);
+    }
+    std::sort(checks.begin(), checks.end());
+    checks.erase(std::unique(checks.begin(), checks.end()), checks.end());
+
+    int max_iter = 3;
+    if (resolve_layer_intersections(top_layer, bottom_layer, context, &checks, max_iter))
+    {
+        return true;
+    }
+
+    // Deep overlaps are left after the first iterations, continue on the region grown so far
+    return resolve_layer_intersections(top_layer, bottom_layer, context, &checks);
+}
+
+//-----------------------------------------------------------------------------
+
+void collect_moved_faces(const pmp::SurfaceMesh& top_layer,
+                         const pmp::SurfaceMesh& bottom_layer,
+                         const CollisionContext& context,
+                         const std::vector<pmp::Point>& top_reference,
+                         const std::vector<pmp::Point>& bottom_reference,
+                         float threshold,
+                         std::vector<int>& out_faces)
+{
+    out_faces.clear();
+    if (context.n_vertices != top_layer.vertices_size() || context.n_vertices != bottom_layer.vertices_size() ||
+        context.n_vertices != top_reference.size() || context.n_vertices != bottom_reference.size())
+    {
+        printf("[ERROR] collect_moved_faces(): Reference positions do not match the layers\n");
+        out_faces = context.faces_to_check;
+        return;
+    }
+
+    const std::vector<int>& fv = context.face_vertices;
+    const std::vector<pmp::Point>& top_points = top_layer.get_vertex_property<pmp::Point>("v:point").vector();
+    const std::vector<pmp::Point>& bottom_points = bottom_layer.get_vertex_property<pmp::Point>("v:point").vector();
+    float sqr_threshold = threshold * threshold;
+
+    std::vector<unsigned char> top_moved(context.n_vertices);
+    std::vector<unsigned char> bottom_moved(context.n_vertices);
+
+    #pragma omp parallel for schedule(static)
+    for (int v = 0; v < (int)context.n_vertices; ++v)
+    {
+        top_moved[v] = pmp::sqrnorm(top_points[v] - top_reference[v]) > sqr_threshold;
+        bottom_moved[v] = pmp::sqrnorm(bottom_points[v] - bottom_reference[v]) > sqr_threshold;
+    }
+
+    std::vector<unsigned char> bottom_face_moved(context.n_faces);
+
+    #pragma omp parallel for schedule(static)
+    for (int f = 0; f < (int)context.n_faces; ++f)
+    {
+        bottom_face_moved[f] = bottom_moved[fv[3 * f]] || bottom_moved[fv[3 * f + 1]] || bottom_moved[fv[3 * f + 2]];
+    }
+
+    // A face to check is tested against the bottom layer faces in its neighborhood
+    std::vector<unsigned char> dirty(context.faces_to_check.size());
+
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < (int)context.faces_to_check.size(); ++i)
+    {
+        int f = context.faces_to_check[i];
+        bool moved = top_moved[fv[3 * f]] || top_moved[fv[3 * f + 1]] || top_moved[fv[3 * f + 2]];
+        for (int k = context.neighbor_offsets[i]; !moved && k < context.neighbor_offsets[i + 1]; ++k)
+        {
+            moved = bottom_face_moved[context.neighbor_faces[k]];
+        }
+        dirty[i] = moved;
+    }
+
+    for (size_t i = 0; i < dirty.size(); ++i)
+    {
+        if (dirty[i])
+        {
+            out_faces.push_back(context.faces_to_check[i]);
+        }
+    }
 }
 
 //-----------------------------------------------------------------------------
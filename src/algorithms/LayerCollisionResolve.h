@@ -2,10 +2,131 @@
 
 #pragma once
 
+#include <vector>
+
 #include <pmp/surface_mesh.h>
 
 //-----------------------------------------------------------------------------
 
+// Everything the collision resolve needs that only depends on topology and the
+// locked vertices. Built once per template and reused for every resolve.
+// Neighborhoods are stored as flat CSR arrays: the entries of i are
+// [offsets[i], offsets[i + 1]).
+struct CollisionContext
+{
+    size_t n_vertices = 0;
+    size_t n_faces = 0;
+
+    // vertex indices of all faces (3 per face)
+    std::vector<int> face_vertices;
+
+    // faces with at least one free vertex
+    std::vector<int> faces_to_check;
+    // face index -> position in faces_to_check (-1 if the face is not checked)
+    std::vector<int> check_index;
+    // faces around the 2-ring of (the first vertex of) each face to check
+    std::vector<int> neighbor_offsets;
+    std::vector<int> neighbor_faces;
+
+    // vertex index -> simulation index (-1 if the vertex is not simulated)
+    std::vector<int> sim_idx;
+    // simulation index -> vertex index
+    std::vector<int> sim_vertices;
+    std::vector<bool> sim_locked;
+    int num_sim_vertices = 0;
+
+    // free one-ring neighbors of each simulated vertex (simulation indices)
+    std::vector<int> free_neighbor_offsets;
+    std::vector<int> free_neighbors;
+
+    // triangle pairs for bending constraints (4 simulation indices each)
+    std::vector<int> bending_quads;
+    // bending quads (index into bending_quads / 4) of each simulated vertex
+    std::vector<int> vertex_quad_offsets;
+    std::vector<int> vertex_quads;
+};
+
+//-----------------------------------------------------------------------------
+
+// Decimated version of the layers (they share their connectivity) for a coarse
+// resolve before the full resolution one. The proxy vertices are a subset of
+// the full vertices. Displacements of the proxy are prolonged to the full
+// layers with the barycentric coordinates of every full vertex in its closest
+// proxy face (zero for locked vertices).
+struct CollisionProxy
+{
+    // decimated template and its collision context
+    pmp::SurfaceMesh mesh;
+    CollisionContext context;
+
+    // proxy vertex -> full vertex
+    std::vector<int> vertices;
+
+    // prolongation: 3 proxy vertices and weights per full vertex
+    std::vector<int> prolongation_vertices;
+    std::vector<float> prolongation_weights;
+};
+
+//-----------------------------------------------------------------------------
+
+bool init_collision_context(const pmp::SurfaceMesh& mesh,
+                            pmp::VertexProperty<bool> locked,
+                            CollisionContext& out_context);
+
+//-----------------------------------------------------------------------------
+
+// mesh: template of the layers, n_vertices: target vertex count of the proxy
+bool init_collision_proxy(const pmp::SurfaceMesh& mesh,
+                          pmp::VertexProperty<bool> locked,
+                          unsigned int n_vertices,
+                          CollisionProxy& out_proxy);
+
+//-----------------------------------------------------------------------------
+
+// Returns true if no intersections are left
+bool resolve_layer_intersections_by_bottom_layer(pmp::SurfaceMesh& top_layer,
+                                                 pmp::SurfaceMesh& bottom_layer,
+                                                 const CollisionContext& context);
+
+//-----------------------------------------------------------------------------
+
+// Only checks the given top layer faces, and the faces around the vertices
+// moved while resolving. For layers that were free of intersections, with the
+// faces that may have become intersecting since then (e.g. from LayerCCD).
+bool resolve_layer_intersections_by_bottom_layer(pmp::SurfaceMesh& top_layer,
+                                                 pmp::SurfaceMesh& bottom_layer,
+                                                 const CollisionContext& context,
+                                                 const std::vector<int>& faces);
+
+//-----------------------------------------------------------------------------
+
+// Resolves the proxy first and prolongs the displacement of its bottom layer,
+// the full resolution resolve then only works on the remaining intersections
+// (a few iterations first, more if they are not enough). For large changes of
+// the layers.
+bool resolve_layer_intersections_by_bottom_layer(pmp::SurfaceMesh& top_layer,
+                                                 pmp::SurfaceMesh& bottom_layer,
+                                                 const CollisionContext& context,
+                                                 const CollisionProxy& proxy);
+
+//-----------------------------------------------------------------------------
+
+// Faces that can intersect now although the layers were free of intersections
+// at top_reference / bottom_reference (vertex positions of a previous resolve):
+// faces to check whose top vertices, or the bottom layer faces they are tested
+// against, moved by more than threshold. Sorted face indices, to be passed to
+// resolve_layer_intersections_by_bottom_layer.
+void collect_moved_faces(const pmp::SurfaceMesh& top_layer,
+                         const pmp::SurfaceMesh& bottom_layer,
+                         const CollisionContext& context,
+                         const std::vector<pmp::Point>& top_reference,
+                         const std::vector<pmp::Point>& bottom_reference,
+                         float threshold,
+                         std::vector<int>& out_faces);
+
+//-----------------------------------------------------------------------------
+
+// Convenience version, builds a temporary context
 bool resolve_layer_intersections_by_bottom_layer(pmp::SurfaceMesh& top_layer,
                                                  pmp::SurfaceMesh& bottom_layer,
                                                  pmp::VertexProperty<bool> locked);
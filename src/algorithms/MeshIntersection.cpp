@@ -1,8 +1,9 @@
 // =====================================================================================================================
 
 #include "MeshIntersection.h"
-#include "algorithms/TriTriIntersect.h"
+#include "algorithms/TriTriBatch.h"
 
+#include <algorithm>
 #include <iostream>
 
 // =====================================================================================================================
@@ -21,83 +22,116 @@ auto MeshIntersection::mesh_to_verts_faces(
 
 // ---------------------------------------------------------------------------------------------------------------------
 
-auto MeshIntersection::mesh_intersection(const pmp::SurfaceMesh *mesh_a, const pmp::SurfaceMesh *mesh_b)
--> bool
+auto MeshIntersection::ignored_faces(const pmp::SurfaceMesh* mesh)
+-> std::vector<bool>
 {
-    // check only for debugging
-    if (!mesh_a->is_triangle_mesh() || !mesh_b->is_triangle_mesh()) {
-        throw std::runtime_error("Mesh intersection is only implemented for triangle meshes.");
+    std::vector<bool> ignored(mesh->faces_size(), false);
+    if (!mesh->has_vertex_property("v:intersection_ignore")) {
+        return ignored;
     }
 
-    // save vertex positions
-    // there might be a possibility to access vertex positions directly
-    // TODO: Ask Timo
-//    std::vector<pmp::Point> mesh_a_points { mesh_a->n_vertices() };
-//    std::vector<pmp::Point> mesh_b_points { mesh_b->n_vertices() };
+    auto intersect_ignore = mesh->get_vertex_property<bool>("v:intersection_ignore");
+    for (auto face : mesh->faces()) {
+        for (auto v : mesh->vertices(face)) {
+            if (intersect_ignore[v]) {
+                ignored[face.idx()] = true;
+            }
+        }
+    }
+    return ignored;
+}
 
-    // helper type definition
-    using PointT = Eigen::RowVector3f;
-    using TriangleT = std::array<PointT, 3>;
+// ---------------------------------------------------------------------------------------------------------------------
 
-    size_t v_index; // vertex index
-    size_t f_index; // face index
-    std::vector<TriangleT> faces_a{mesh_a->n_faces()};
-    std::vector<TriangleT> faces_b{mesh_b->n_faces()};
+// Tests candidate pairs (face_a, face_b) in batches with the vectorized kernel.
+// Returns a flag per candidate, with stop_at_first the remaining batches are skipped after the first intersection.
+static auto intersecting_candidates(const pmp::SurfaceMesh* mesh_a, const TriangleBVH& bvh_a,
+                                    const pmp::SurfaceMesh* mesh_b, const TriangleBVH& bvh_b,
+                                    const std::vector<std::pair<int, int>>& candidates, bool stop_at_first)
+-> std::vector<unsigned char>
+{
+    const std::vector<pmp::Point>& points_a = mesh_a->get_vertex_property<pmp::Point>("v:point").vector();
+    const std::vector<pmp::Point>& points_b = mesh_b->get_vertex_property<pmp::Point>("v:point").vector();
+
+    std::vector<unsigned char> hits(candidates.size(), 0);
+    bool found = false;
+
+    const size_t n_batches = (candidates.size() + TriangleBatch::capacity - 1) / TriangleBatch::capacity;
+
+    #pragma omp parallel
+    {
+        TriangleBatch batch_a;
+        TriangleBatch batch_b;
+
+        #pragma omp for schedule(dynamic, 64)
+        for (size_t k = 0; k < n_batches; ++k) {
+            if (stop_at_first) {
+                bool stop;
+                #pragma omp atomic read
+                stop = found;
+                if (stop) {
+                    continue;
+                }
+            }
 
-    // todo: externalize to function
+            size_t first = k * TriangleBatch::capacity;
+            size_t last = std::min(first + TriangleBatch::capacity, candidates.size());
+            batch_a.clear();
+            batch_b.clear();
+            for (size_t i = first; i < last; ++i) {
+                const auto& face_a = bvh_a.face_vertices(candidates[i].first);
+                const auto& face_b = bvh_b.face_vertices(candidates[i].second);
+                batch_a.push_back(points_a[face_a[0]], points_a[face_a[1]], points_a[face_a[2]]);
+                batch_b.push_back(points_b[face_b[0]], points_b[face_b[1]], points_b[face_b[2]]);
+            }
 
-    // convert to array structure for faster access
-    f_index = 0;
-    for (auto face: mesh_a->faces()) {
-        v_index = 0;
-        TriangleT triangle{PointT{}, PointT{}, PointT{}};
-        for (auto vertex: mesh_a->vertices(face)) {
-            pmp::Point point = mesh_a->position(vertex);
-            triangle[v_index++] = PointT{point[0], point[1], point[2]};
+            uint32_t mask = tri_tri_intersect_pairs(batch_a, batch_b);
+            for (size_t i = first; i < last; ++i) {
+                hits[i] = (mask >> (i - first)) & 1U;
+            }
+            if (mask && stop_at_first) {
+                #pragma omp atomic write
+                found = true;
+            }
         }
-        faces_a[f_index++] = triangle;
     }
 
-    f_index = 0;
-    for (auto face: mesh_b->faces()) {
-        v_index = 0;
-        TriangleT triangle{PointT{}, PointT{}, PointT{}};
-        for (auto vertex: mesh_b->vertices(face)) {
-            pmp::Point point = mesh_b->position(vertex);
-            triangle[v_index++] = PointT{point[0], point[1], point[2]};
-        }
-        faces_b[f_index++] = triangle;
-    }
-
-    // out variables for intersection
-    PointT int_start{};
-    PointT int_end{};
-    bool coplanar;
-
-    // check intersection for every triangle
-    for (size_t index_a = 0; index_a < mesh_a->n_faces(); ++index_a) {
-        TriangleT& tri_a = faces_a[index_a];
-
-        for (size_t index_b = 0; index_b < mesh_b->n_faces(); ++index_b) {
-            TriangleT& tri_b = faces_b[index_b];
-            //std::cout << "triA" << tri_a[0] << " tri_b" << tri_b[0] << std::endl;
-
-            if (igl::tri_tri_intersection_test_3d(
-                tri_a[0], tri_a[1], tri_a[2],
-                tri_b[0], tri_b[1], tri_b[2],
-                coplanar, int_start, int_end)
-            ) {
-                // one intersection is enough
-                std::cout << "Intersection Face_A=" << index_a << " and Face_B=" << index_b << std::endl;
-                return true;
-            }
+    return hits;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto MeshIntersection::mesh_intersection(const pmp::SurfaceMesh *mesh_a, const pmp::SurfaceMesh *mesh_b)
+-> bool
+{
+    // check only for debugging
+    if (!mesh_a->is_triangle_mesh() || !mesh_b->is_triangle_mesh()) {
+        throw std::runtime_error("Mesh intersection is only implemented for triangle meshes.");
+    }
+
+    TriangleBVH bvh_a;
+    TriangleBVH bvh_b;
+    bvh_a.build(*mesh_a);
+    bvh_b.build(*mesh_b);
+
+    // only triangle pairs with overlapping boxes can intersect
+    auto candidates = bvh_a.overlapping_faces(bvh_b);
+
+    // one intersection is enough
+    auto hits = intersecting_candidates(mesh_a, bvh_a, mesh_b, bvh_b, candidates, true);
+    for (size_t i = 0; i < candidates.size(); ++i) {
+        if (hits[i]) {
+            std::cout << "Intersection Face_A=" << candidates[i].first << " and Face_B=" << candidates[i].second
+                      << std::endl;
+            return true;
         }
     }
 
-    // no intersection
     return false;
 }
 
+// ---------------------------------------------------------------------------------------------------------------------
+
 auto mark_intersection(pmp::SurfaceMesh* mesh, pmp::EdgeProperty<bool>& e_feature_prop, pmp::Face face) -> void
 {
     for (auto he : mesh->halfedges(face)) {
@@ -109,56 +143,35 @@ auto mark_intersection(pmp::SurfaceMesh* mesh, pmp::EdgeProperty<bool>& e_featur
 
 auto MeshIntersection::mesh_intersection_tracked(pmp::SurfaceMesh *mesh_a, pmp::SurfaceMesh *mesh_b)
     -> int
+{
+    TriangleBVH bvh_a;
+    TriangleBVH bvh_b;
+    return mesh_intersection_tracked(mesh_a, bvh_a, mesh_b, bvh_b);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto MeshIntersection::mesh_intersection_tracked(pmp::SurfaceMesh* mesh_a, TriangleBVH& bvh_a,
+                                                 pmp::SurfaceMesh* mesh_b, TriangleBVH& bvh_b)
+    -> int
 {
     // check only for debugging
     if (!mesh_a->is_triangle_mesh() || !mesh_b->is_triangle_mesh()) {
         throw std::runtime_error("Mesh intersection is only implemented for triangle meshes.");
     }
 
-    int intersections = 0;
-
-    // save vertex positions
-    // there might be a possibility to access vertex positions directly
-    // TODO: Ask Timo
-    //    std::vector<pmp::Point> mesh_a_points { mesh_a->n_vertices() };
-    //    std::vector<pmp::Point> mesh_b_points { mesh_b->n_vertices() };
-
-    // helper type definition
-    using PointT = Eigen::RowVector3f;
-    using TriangleT = std::array<PointT, 3>;
-    size_t v_index; // vertex index
-
-    std::vector<TriangleT> faces_a; //{mesh_a->n_faces()};
-    std::vector<TriangleT> faces_b; //{mesh_b->n_faces()};
-    faces_a.reserve(mesh_a->n_faces());
-    faces_b.reserve(mesh_b->n_faces());
-
-    // convert to array structure for faster access
-    for (auto face: mesh_a->faces()) {
-        v_index = 0;
-        TriangleT triangle { PointT{}, PointT{}, PointT{} };
-        for (auto vertex: mesh_a->vertices(face)) {
-            pmp::Point point = mesh_a->position(vertex);
-            triangle[v_index++] = PointT{ point[0], point[1], point[2] };
-        }
-        faces_a.emplace_back(triangle);
+    // ignored triangles are not part of the hierarchies
+    if (bvh_a.matches(*mesh_a)) {
+        bvh_a.refit(*mesh_a);
+    } else {
+        bvh_a.build(*mesh_a, ignored_faces(mesh_a));
     }
-
-    for (auto face: mesh_b->faces()) {
-        v_index = 0;
-        TriangleT triangle{ PointT{}, PointT{}, PointT{} };
-        for (auto vertex: mesh_b->vertices(face)) {
-            pmp::Point point = mesh_b->position(vertex);
-            triangle[v_index++] = PointT{ point[0], point[1], point[2] };
-        }
-        faces_b.emplace_back(triangle);
+    if (bvh_b.matches(*mesh_b)) {
+        bvh_b.refit(*mesh_b);
+    } else {
+        bvh_b.build(*mesh_b, ignored_faces(mesh_b));
     }
 
-    // out variables for intersection
-//    PointT int_start{};
-//    PointT int_end{};
-//    bool coplanar;
-
     // reset edge feature
     if (mesh_a->has_edge_property("e:feature")) {
         // convert rvalue to lvalue
@@ -174,61 +187,90 @@ auto MeshIntersection::mesh_intersection_tracked(pmp::SurfaceMesh *mesh_a, pmp::
     auto intersect_a = mesh_a->edge_property<bool>("e:feature", false);
     auto intersect_b = mesh_b->edge_property<bool>("e:feature", false);
 
-    auto intersect_a_ignore = mesh_a->vertex_property<bool>("v:intersection_ignore", false);
-    auto intersect_b_ignore = mesh_b->vertex_property<bool>("v:intersection_ignore", false);
+    // check intersection only for triangle pairs with overlapping boxes
+    auto candidates = bvh_a.overlapping_faces(bvh_b);
 
-    // check intersection for every triangle (= face)
-    #pragma omp parallel for default (none) shared (mesh_a, mesh_b, faces_a, faces_b, intersect_a_ignore, intersect_b_ignore, intersect_a, intersect_b) reduction(+:intersections)
-    for (size_t index_a = 0; index_a < mesh_a->n_faces(); ++index_a) {
-        TriangleT& tri_a = faces_a[index_a];
+    // edge properties are bit vectors, so flag faces first and mark edges afterwards
+    std::vector<unsigned char> hit_a(mesh_a->faces_size(), 0);
+    std::vector<unsigned char> hit_b(mesh_b->faces_size(), 0);
 
-        // ignore triangle (mesh a)?
-        bool skip_tri_a = false;
-        for (auto v : mesh_a->vertices(pmp::Face(index_a))) {
-            if (intersect_a_ignore[v]) {
-                skip_tri_a = true;
-            }
+    auto hits = intersecting_candidates(mesh_a, bvh_a, mesh_b, bvh_b, candidates, false);
+    int intersections = 0;
+    for (size_t i = 0; i < candidates.size(); ++i) {
+        if (hits[i]) {
+            hit_a[candidates[i].first] = 1;
+            hit_b[candidates[i].second] = 1;
+            intersections++;
         }
-        if (skip_tri_a) {
-            continue;
+    }
+
+    for (auto face : mesh_a->faces()) {
+        if (hit_a[face.idx()]) {
+            mark_intersection(mesh_a, intersect_a, face);
         }
+    }
+    for (auto face : mesh_b->faces()) {
+        if (hit_b[face.idx()]) {
+            mark_intersection(mesh_b, intersect_b, face);
+        }
+    }
 
-        for (size_t index_b = 0; index_b < mesh_b->n_faces(); ++index_b) {
-            TriangleT& tri_b = faces_b[index_b];
-            //std::cout << "triA" << tri_a[0] << " tri_b" << tri_b[0] << std::endl;
+    return intersections;
+}
 
-            // ignore triangle (mesh b)?
-            bool skip_tri_b = false;
-            for (auto v : mesh_b->vertices(pmp::Face(index_b))) {
-                if (intersect_b_ignore[v]) {
-                    skip_tri_b = true;
-                }
-            }
-            if (skip_tri_b) {
-                continue;
-            }
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto MeshIntersection::mesh_self_intersection_tracked(pmp::SurfaceMesh* mesh)
+    -> int
+{
+    TriangleBVH bvh;
+    return mesh_self_intersection_tracked(mesh, bvh);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto MeshIntersection::mesh_self_intersection_tracked(pmp::SurfaceMesh* mesh, TriangleBVH& bvh)
+    -> int
+{
+    // check only for debugging
+    if (!mesh->is_triangle_mesh()) {
+        throw std::runtime_error("Mesh intersection is only implemented for triangle meshes.");
+    }
+
+    if (bvh.matches(*mesh)) {
+        bvh.refit(*mesh);
+    } else {
+        bvh.build(*mesh, ignored_faces(mesh));
+    }
+
+    // reset edge feature
+    if (mesh->has_edge_property("e:feature")) {
+        auto mesh_feature = mesh->get_edge_property<bool>("e:feature");
+        mesh->remove_edge_property(mesh_feature);
+    }
+    auto intersect = mesh->edge_property<bool>("e:feature", false);
+
+    // adjacent triangles are culled during the traversal, they always touch
+    auto candidates = bvh.self_overlapping_faces();
+
+    std::vector<unsigned char> hit(mesh->faces_size(), 0);
+
+    auto hits = intersecting_candidates(mesh, bvh, mesh, bvh, candidates, false);
+    int intersections = 0;
+    for (size_t i = 0; i < candidates.size(); ++i) {
+        if (hits[i]) {
+            hit[candidates[i].first] = 1;
+            hit[candidates[i].second] = 1;
+            intersections++;
+        }
+    }
+
+    for (auto face : mesh->faces()) {
+        if (hit[face.idx()]) {
+            mark_intersection(mesh, intersect, face);
+        }
+    }
 
-            // these are dummies, so create for every thread
-            PointT int_start{};
-            PointT int_end{};
-            bool coplanar;
-
-            if (igl::tri_tri_intersection_test_3d(
-                    tri_a[0], tri_a[1], tri_a[2],
-                    tri_b[0], tri_b[1], tri_b[2],
-                    coplanar, int_start, int_end)
-            ) {
-//                intersect_a[mesh_a->edge(mesh_a->halfedge(pmp::Face(index_a)))] = true;
-//                intersect_b[mesh_b->edge(mesh_b->halfedge(pmp::Face(index_b)))] = true;
-                mark_intersection(mesh_a, intersect_a, pmp::Face(index_a));
-                mark_intersection(mesh_b, intersect_b, pmp::Face(index_b));
-
-                intersections++;
-            } // intersection?
-        } // triangles b
-    } // triangles a
-
-    // no intersection
     return intersections;
 }
 
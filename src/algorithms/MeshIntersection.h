@@ -1,8 +1,12 @@
 #ifndef TAILORME_VIEWER_MESHINTERSECTION_H
 #define TAILORME_VIEWER_MESHINTERSECTION_H
 
+#include <vector>
+
 #include <pmp/surface_mesh.h>
 
+#include "algorithms/TriangleBVH.h"
+
 class MeshIntersection {
 public:
 //    auto static mesh_to_verts_faces(const pmp::SurfaceMesh* mesh, Eigen::MatrixXi& vertices, Eigen::MatrixXi& faces) -> void;
@@ -10,6 +14,22 @@ public:
 
     // tracked version, adds a edge property for intersections e:feature
     auto static mesh_intersection_tracked(pmp::SurfaceMesh* mesh_a, pmp::SurfaceMesh* mesh_b) -> int;
+
+    // tracked version with hierarchies kept by the caller (fixed topology, e.g. templates).
+    // the hierarchies are (re)built if they do not match the meshes, otherwise refitted to the current positions.
+    auto static mesh_intersection_tracked(pmp::SurfaceMesh* mesh_a, TriangleBVH& bvh_a,
+                                          pmp::SurfaceMesh* mesh_b, TriangleBVH& bvh_b) -> int;
+
+    // self intersections of one mesh, marked in e:feature like the tracked version. triangles sharing a vertex
+    // (adjacent or in each other's one-ring) are not tested.
+    auto static mesh_self_intersection_tracked(pmp::SurfaceMesh* mesh) -> int;
+
+    // self intersections with the hierarchy kept by the caller, refitted if it matches the mesh
+    // (e.g. after every inference)
+    auto static mesh_self_intersection_tracked(pmp::SurfaceMesh* mesh, TriangleBVH& bvh) -> int;
+
+    // faces with a vertex marked in v:intersection_ignore
+    auto static ignored_faces(const pmp::SurfaceMesh* mesh) -> std::vector<bool>;
 };
 
 
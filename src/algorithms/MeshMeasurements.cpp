@@ -0,0 +1,190 @@
+//======================================================================================================================
+// Copyright (c) the Authors 2024
+//
+// This work is licensed under a
+// Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+//
+// You should have received a copy of the license along with this
+// work. If not, see <http://creativecommons.org/licenses/by-nc-sa/4.0/>.
+//
+//======================================================================================================================
+
+#include "MeshMeasurements.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <numeric>
+
+// =====================================================================================================================
+
+// relative heights of the girths (fraction of body height, measured from the sole)
+#define GIRTH_HEIGHT_CHEST 0.72F
+#define GIRTH_HEIGHT_WAIST 0.63F
+#define GIRTH_HEIGHT_HIP 0.50F
+
+// =====================================================================================================================
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+float get_body_height(const pmp::SurfaceMesh& mesh)
+{
+    float min_y = FLT_MAX;
+    float max_y = -FLT_MAX;
+    for (auto v : mesh.vertices()) {
+        min_y = std::min(min_y, mesh.position(v)[1]);
+        max_y = std::max(max_y, mesh.position(v)[1]);
+    }
+    return mesh.n_vertices() > 0 ? max_y - min_y : 0.0F;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+static float convex_hull_perimeter(std::vector<Eigen::Vector2f>& points)
+{
+    if (points.size() < 3) {
+        return 0.0F;
+    }
+
+    // andrew's monotone chain
+    std::sort(points.begin(), points.end(), [](const Eigen::Vector2f& a, const Eigen::Vector2f& b) {
+        return a[0] < b[0] || (a[0] == b[0] && a[1] < b[1]);
+    });
+
+    auto cross = [](const Eigen::Vector2f& o, const Eigen::Vector2f& a, const Eigen::Vector2f& b) {
+        return (a[0] - o[0]) * (b[1] - o[1]) - (a[1] - o[1]) * (b[0] - o[0]);
+    };
+
+    std::vector<Eigen::Vector2f> hull(2 * points.size());
+    size_t k = 0;
+    for (const auto& p : points) {
+        while (k >= 2 && cross(hull[k - 2], hull[k - 1], p) <= 0.0F) {
+            k--;
+        }
+        hull[k++] = p;
+    }
+    for (size_t i = points.size() - 1, t = k + 1; i > 0; --i) {
+        while (k >= t && cross(hull[k - 2], hull[k - 1], points[i - 1]) <= 0.0F) {
+            k--;
+        }
+        hull[k++] = points[i - 1];
+    }
+
+    // first point is repeated at the end
+    float perimeter = 0.0F;
+    for (size_t i = 1; i < k; ++i) {
+        perimeter += (hull[i] - hull[i - 1]).norm();
+    }
+    return perimeter;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+float get_girth(const pmp::SurfaceMesh& mesh, float relative_height)
+{
+    using namespace pmp;
+
+    float min_y = FLT_MAX;
+    float max_y = -FLT_MAX;
+    for (auto v : mesh.vertices()) {
+        min_y = std::min(min_y, mesh.position(v)[1]);
+        max_y = std::max(max_y, mesh.position(v)[1]);
+    }
+    float height = min_y + relative_height * (max_y - min_y);
+
+    // intersect edges with the plane y = height
+    std::vector<int> edge_point(mesh.edges_size(), -1);
+    std::vector<Eigen::Vector2f> points;
+    for (auto e : mesh.edges()) {
+        const Point& p0 = mesh.position(mesh.vertex(e, 0));
+        const Point& p1 = mesh.position(mesh.vertex(e, 1));
+        if ((p0[1] < height) == (p1[1] < height)) {
+            continue;
+        }
+        float t = (height - p0[1]) / (p1[1] - p0[1]);
+        Point p = p0 + t * (p1 - p0);
+        edge_point[e.idx()] = static_cast<int>(points.size());
+        points.emplace_back(p[0], p[2]);
+    }
+    if (points.empty()) {
+        return 0.0F;
+    }
+
+    // connect points of the same face to loops (union find)
+    std::vector<int> parent(points.size());
+    std::iota(parent.begin(), parent.end(), 0);
+    auto find = [&](int i) {
+        while (parent[i] != i) {
+            parent[i] = parent[parent[i]];
+            i = parent[i];
+        }
+        return i;
+    };
+
+    for (auto f : mesh.faces()) {
+        int first = -1;
+        for (auto h : mesh.halfedges(f)) {
+            int point = edge_point[mesh.edge(h).idx()];
+            if (point < 0) {
+                continue;
+            }
+            if (first < 0) {
+                first = point;
+            } else {
+                parent[find(point)] = find(first);
+            }
+        }
+    }
+
+    // the torso is the largest loop (arms and legs are smaller)
+    std::vector<int> loop_size(points.size(), 0);
+    for (size_t i = 0; i < points.size(); ++i) {
+        loop_size[find(static_cast<int>(i))]++;
+    }
+    int torso = static_cast<int>(std::max_element(loop_size.begin(), loop_size.end()) - loop_size.begin());
+
+    std::vector<Eigen::Vector2f> torso_points;
+    for (size_t i = 0; i < points.size(); ++i) {
+        if (find(static_cast<int>(i)) == torso) {
+            torso_points.push_back(points[i]);
+        }
+    }
+
+    return convex_hull_perimeter(torso_points);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+std::string get_measurement_name(int measurement)
+{
+    switch (measurement) {
+    case MEASUREMENT_HEIGHT:
+        return "Height";
+    case MEASUREMENT_ARM_LENGTH:
+        return "Arm length";
+    case MEASUREMENT_CHEST_GIRTH:
+        return "Chest girth";
+    case MEASUREMENT_WAIST_GIRTH:
+        return "Waist girth";
+    case MEASUREMENT_HIP_GIRTH:
+        return "Hip girth";
+    default:
+        return {};
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+Eigen::VectorXf get_body_measurements(const pmp::SurfaceMesh& mesh)
+{
+    Eigen::VectorXf measurements(MEASUREMENT_COUNT);
+    measurements[MEASUREMENT_HEIGHT] = get_body_height(mesh);
+    measurements[MEASUREMENT_ARM_LENGTH] = get_arm_length_boerner(mesh);
+    measurements[MEASUREMENT_CHEST_GIRTH] = get_girth(mesh, GIRTH_HEIGHT_CHEST);
+    measurements[MEASUREMENT_WAIST_GIRTH] = get_girth(mesh, GIRTH_HEIGHT_WAIST);
+    measurements[MEASUREMENT_HIP_GIRTH] = get_girth(mesh, GIRTH_HEIGHT_HIP);
+    return measurements;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+// =====================================================================================================================
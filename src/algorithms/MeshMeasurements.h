@@ -1,8 +1,12 @@
 #pragma once
 
+#include <string>
+#include <vector>
+
+#include <Eigen/Dense>
 #include <pmp/surface_mesh.h>
 
-static float get_arm_length_boerner(const pmp::SurfaceMesh& mesh)
+static inline float get_arm_length_boerner(const pmp::SurfaceMesh& mesh)
 {
     using namespace pmp;
 
@@ -18,3 +22,26 @@ static float get_arm_length_boerner(const pmp::SurfaceMesh& mesh)
 
     return length_segment1 + length_segment2;
 }
+
+// body height, y is up
+float get_body_height(const pmp::SurfaceMesh& mesh);
+
+// circumference of the torso at a relative height (0.0 = sole, 1.0 = vertex).
+// the largest cross-section loop is measured by its convex hull, just like a tape measure.
+float get_girth(const pmp::SurfaceMesh& mesh, float relative_height);
+
+// === measurement vector used for measurement driven fitting
+
+enum BodyMeasurement {
+    MEASUREMENT_HEIGHT,
+    MEASUREMENT_ARM_LENGTH,
+    MEASUREMENT_CHEST_GIRTH,
+    MEASUREMENT_WAIST_GIRTH,
+    MEASUREMENT_HIP_GIRTH,
+    MEASUREMENT_COUNT
+};
+
+std::string get_measurement_name(int measurement);
+
+// all measurements of a skin mesh in template topology (meters)
+Eigen::VectorXf get_body_measurements(const pmp::SurfaceMesh& mesh);
@@ -3,11 +3,29 @@
 #include "RBF_warp.h"
 
 
+#include <algorithm>
 #include <cfloat>
+#include <cstring>
+#include <fstream>
+#include <numeric>
+#include <thread>
+#include <type_traits>
 
 #include "Constants.h"
+#include "FarthestPointSampling.h"
 #include "utils/io/io_selection.h"
 
+// cluster sizes of the warp operator (rows: points, columns: centers)
+#define RBF_OPERATOR_POINT_CLUSTER 512
+#define RBF_OPERATOR_CENTER_CLUSTER 256
+
+// cache file layout, increase the version with every change of the layout,
+// the center sampling or the operator build
+#define RBF_CACHE_MAGIC "RBFC"
+#define RBF_CACHE_VERSION 2
+// the coefficients start at a multiple of this in the file
+#define RBF_CACHE_ALIGNMENT 64
+
 //-----------------------------------------------------------------------------
 
 bool load_map_full_to_cutoff(RBF_data& out_data)
@@ -17,158 +35,103 @@ bool load_map_full_to_cutoff(RBF_data& out_data)
 
 //-----------------------------------------------------------------------------
 
-bool find_rbf_centers_prioritize_head(pmp::SurfaceMesh &skel_wrap,
-                                      size_t num_additional_centers,
-                                      RBF_data& out_data)
+// Farthest point sampling of skel_wrap vertices, seeded with vertex 0. The
+// vertices of the inner mouth are never centers.
+static bool init_rbf_center_sampling(const pmp::SurfaceMesh &skel_wrap,
+                                     FarthestPointSampling &sampling,
+                                     std::vector<bool> &ignore)
 {
-    using namespace pmp;
-
-    std::vector<dvec3> &cts = out_data.centers;
-    std::vector<int> &ids = out_data.indices;
-
-    int N = skel_wrap.n_vertices();
-
-    std::vector<double>  dist(N, FLT_MAX);
-    std::vector<dvec3> centers(N);
-    std::vector<int> indices(N);
-
     std::vector<int> inner_mouth_ids;
     if (!read_selection(RESOURCE_DATA_DIR + "/mouth.sel", inner_mouth_ids))
     {
         return false;
     }
 
-    auto ignore = skel_wrap.vertex_property<bool>("v:rbf_ignore", false);
+    ignore.assign(skel_wrap.n_vertices(), false);
     for (int idx : inner_mouth_ids)
     {
-        ignore[Vertex(idx)] = true;
+        ignore[idx] = true;
     }
 
-    std::vector<int> head_ids;
-    if (!read_selection(RESOURCE_DATA_DIR + "/bo_head.sel", head_ids))
+    std::vector<pmp::Point> points(skel_wrap.n_vertices());
+    for (auto v : skel_wrap.vertices())
     {
-        return false;
+        points[v.idx()] = skel_wrap.position(v);
     }
+    sampling.build(points);
+    sampling.add_sample(0);
 
-    size_t n_head_vertices = 0;
-    auto is_head = skel_wrap.vertex_property<bool>("v:rbf_is_head", false);
-    for (int idx : head_ids)
-    {
-        Vertex v(idx);
+    return true;
+}
 
-        if (!ignore[v])
-        {
-            is_head[Vertex(idx)] = true;
-            n_head_vertices++;
-        }
-    }
+//-----------------------------------------------------------------------------
 
-    // Half of the head vertices should be RBF centers
-    size_t desired_head_centers = n_head_vertices / 2;
+static void copy_rbf_centers(const FarthestPointSampling &sampling, RBF_data& out_data)
+{
+    const std::vector<int> &samples = sampling.samples();
 
-    for(auto v : skel_wrap.vertices())
+    out_data.centers.resize(samples.size());
+    out_data.indices.resize(samples.size());
+    for (size_t i = 0; i < samples.size(); i++)
     {
-        centers[v.idx()] = dvec3(skel_wrap.position(v));
-        indices[v.idx()] = v.idx();
+        out_data.indices[i] = samples[i];
+        out_data.centers[i] = pmp::dvec3(sampling.points()[samples[i]]);
     }
+    out_data.num_centers = samples.size();
+}
+
+//-----------------------------------------------------------------------------
 
-    // First handle head centers
-    size_t k = 0;
-    while(true)
+bool find_rbf_centers_prioritize_head(pmp::SurfaceMesh &skel_wrap,
+                                      size_t num_additional_centers,
+                                      RBF_data& out_data)
+{
+    FarthestPointSampling sampling;
+    std::vector<bool> ignore;
+    if (!init_rbf_center_sampling(skel_wrap, sampling, ignore))
     {
-        // use next (k-th) center
-        dvec3 p = centers[k];
-        dist[k] = 0.0;
-        if (++k == desired_head_centers) break;
+        return false;
+    }
 
-        int imax = k;
-        double dmax = 0.0;
+    std::vector<int> head_ids;
+    if (!read_selection(RESOURCE_DATA_DIR + "/bo_head.sel", head_ids))
+    {
+        return false;
+    }
 
-        for (int i=k; i<N; ++i)
+    // First handle head centers, only the head vertices are candidates
+    std::vector<int> head_candidates;
+    for (int idx : head_ids)
+    {
+        if (!ignore[idx])
         {
-            // NOTE(swenninger):
-            //   This can be optimized by only looking over head_ids in every iteration
-
-            Vertex v(indices[i]);
-            if (!is_head[v] || ignore[v])
-                continue;
-
-            double d = sqrnorm(p - centers[i]);
-
-            // update dist[i] as shortest dist to selected centers
-            if (d < dist[i])
-            {
-                dist[i] = d;
-            }
-
-            // find farthest center
-            if (dist[i] > dmax)
-            {
-                dmax = dist[i];
-                imax = i;
-            }
+            head_candidates.push_back(idx);
         }
-
-        // move farthest center to array entry k
-        std::swap(centers[k], centers[imax]);
-        std::swap( indices[k],  indices[imax]);
-        std::swap(    dist[k],     dist[imax]);
     }
 
-    size_t num_centers = num_additional_centers + desired_head_centers;
-
-    // Then find the rest of the body rbf centers
-    while(true)
+    // Half of the head vertices should be RBF centers
+    size_t desired_head_centers = head_candidates.size() / 2;
+    if (desired_head_centers > 1)
     {
-        // use next (k-th) center
-        dvec3 p = centers[k];
-        dist[k] = 0.0;
-        if (++k == num_centers) break;
-
-        int imax = k;
-        double dmax = 0.0;
+        sampling.sample(desired_head_centers - 1, head_candidates);
+    }
 
-        for (int i=k; i<N; ++i)
+    // Then find the rest of the body rbf centers, spaced from the head ones
+    std::vector<int> candidates;
+    for (auto v : skel_wrap.vertices())
+    {
+        if (!ignore[v.idx()])
         {
-            if (ignore[Vertex(indices[i])])
-                continue;
-
-            double d = sqrnorm(p - centers[i]);
-
-            // update dist[i] as shortest dist to selected centers
-            if (d < dist[i])
-            {
-                dist[i] = d;
-            }
-
-            // find farthest center
-            if (dist[i] > dmax)
-            {
-                dmax = dist[i];
-                imax = i;
-            }
+            candidates.push_back(v.idx());
         }
-
-        // move farthest center to array entry k
-        std::swap(centers[k], centers[imax]);
-        std::swap( indices[k],  indices[imax]);
-        std::swap(    dist[k],     dist[imax]);
     }
-
-
-    cts.resize(num_centers);
-    ids.resize(num_centers);
-    for(size_t i = 0; i < num_centers; i++)
+    size_t num_centers = num_additional_centers + desired_head_centers;
+    if (num_centers > sampling.samples().size())
     {
-        ids[i] = indices[i];
-        cts[i] = centers[i];
+        sampling.sample(num_centers - sampling.samples().size(), candidates);
     }
 
-    skel_wrap.remove_vertex_property(ignore);
-    skel_wrap.remove_vertex_property(is_head);
-
-    out_data.num_centers = num_centers;
-
+    copy_rbf_centers(sampling, out_data);
 
     return true;
 }
@@ -179,86 +142,27 @@ bool find_rbf_centers(pmp::SurfaceMesh &skel_wrap,
                       size_t num_centers,
                       RBF_data& out_data)
 {
-    using namespace pmp;
-
-    std::vector<dvec3> &cts = out_data.centers;
-    std::vector<int> &ids = out_data.indices;
-
-    int N = skel_wrap.n_vertices();
-
-    std::vector<double>  dist(N, FLT_MAX);
-    std::vector<dvec3> centers(N);
-    std::vector<int> indices(N);
-
-    std::vector<int> inner_mouth_ids;
-    if (!read_selection(RESOURCE_DATA_DIR + "/mouth.sel", inner_mouth_ids))
+    FarthestPointSampling sampling;
+    std::vector<bool> ignore;
+    if (!init_rbf_center_sampling(skel_wrap, sampling, ignore))
     {
         return false;
     }
 
-    auto ignore = skel_wrap.vertex_property<bool>("v:rbf_ignore", false);
-    for (int idx : inner_mouth_ids)
-    {
-        ignore[Vertex(idx)] = true;
-    }
-
-    for(auto v : skel_wrap.vertices())
-    {
-        centers[v.idx()] = dvec3(skel_wrap.position(v));
-        indices[v.idx()] = v.idx();
-    }
-
-    size_t k = 0;
-    while(true)
+    std::vector<int> candidates;
+    for (auto v : skel_wrap.vertices())
     {
-        // use next (k-th) center
-        dvec3 p = centers[k];
-        dist[k] = 0.0;
-        if (++k == num_centers) break;
-
-        int imax = k;
-        double dmax = 0.0;
-
-        for (int i=k; i<N; ++i)
+        if (!ignore[v.idx()])
         {
-            if (ignore[Vertex(indices[i])])
-                continue;
-
-            double d = sqrnorm(p - centers[i]);
-
-            // update dist[i] as shortest dist to selected centers
-            if (d < dist[i])
-            {
-                dist[i] = d;
-            }
-
-            // find farthest center
-            if (dist[i] > dmax)
-            {
-                dmax = dist[i];
-                imax = i;
-            }
+            candidates.push_back(v.idx());
         }
-
-        // move farthest center to array entry k
-        std::swap(centers[k], centers[imax]);
-        std::swap( indices[k],  indices[imax]);
-        std::swap(    dist[k],     dist[imax]);
     }
-
-
-    cts.resize(num_centers);
-    ids.resize(num_centers);
-    for(size_t i = 0; i < num_centers; i++)
+    if (num_centers > 1)
     {
-        ids[i] = indices[i];
-        cts[i] = centers[i];
+        sampling.sample(num_centers - 1, candidates);
     }
 
-    skel_wrap.remove_vertex_property(ignore);
-
-    out_data.num_centers = num_centers;
-
+    copy_rbf_centers(sampling, out_data);
 
     return true;
 }
@@ -335,7 +239,9 @@ bool init_rbf_warp_prioritize_head(pmp::SurfaceMesh& skel_wrap,
 
 //-----------------------------------------------------------------------------
 
-bool apply_rbf_warp(pmp::SurfaceMesh& skel_wrap, pmp::SurfaceMesh& bones, RBF_data& rbf_data)
+// Weights of the warp of the centers to their positions on skel_wrap, one
+// row per coordinate: n center weights followed by the linear polynomial
+static bool solve_rbf_warp(const pmp::SurfaceMesh& skel_wrap, RBF_data& rbf_data, Eigen::MatrixXd& X)
 {
     using namespace pmp;
 
@@ -349,6 +255,12 @@ bool apply_rbf_warp(pmp::SurfaceMesh& skel_wrap, pmp::SurfaceMesh& bones, RBF_da
         std::cerr << "too few centers" << std::endl;
         return false;
     }
+    if(sol.rows() != (Eigen::Index)(n + 4))
+    {
+        // e.g. rbf data loaded from the cache
+        std::cerr << "rbf warp is not factorized" << std::endl;
+        return false;
+    }
 
     // setup right hand side
     Eigen::MatrixXd  B(n+4,3);// B.setZero();
@@ -375,7 +287,7 @@ bool apply_rbf_warp(pmp::SurfaceMesh& skel_wrap, pmp::SurfaceMesh& bones, RBF_da
     }
 
     // solve system
-    Eigen::MatrixXd X(3, n+4);
+    X.resize(3, n+4);
 
     #pragma omp parallel for
     for(int k = 0; k < 3; k++)
@@ -383,32 +295,963 @@ bool apply_rbf_warp(pmp::SurfaceMesh& skel_wrap, pmp::SurfaceMesh& bones, RBF_da
         X.row(k) = (sol.solve(B.col(k))).transpose();
     }
 
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+bool apply_rbf_warp(pmp::SurfaceMesh& skel_wrap, pmp::SurfaceMesh& bones, RBF_data& rbf_data)
+{
+    using namespace pmp;
+
+    std::vector<dvec3> &cts = rbf_data.centers;
+    size_t n = cts.size();
+
+    Eigen::MatrixXd X;
+    if (!solve_rbf_warp(skel_wrap, rbf_data, X)) return false;
+
     SurfaceMesh &apply_m = bones;
 
+    // centers as one array per axis and weights as columns, the kernel sums
+    // vectorize (sqrt included) and end in three dot products per vertex
+    Eigen::ArrayXd cx(n), cy(n), cz(n);
+    for(size_t i = 0; i < n; i++)
+    {
+        cx[i] = cts[i][0];
+        cy[i] = cts[i][1];
+        cz[i] = cts[i][2];
+    }
+    Eigen::MatrixXd W = X.leftCols(n).transpose();
+
     // apply solution
-    #pragma omp parallel for
-    for(size_t vi = 0; vi < apply_m.n_vertices(); vi++)
+    #pragma omp parallel
     {
-        Vertex v(vi);
-        dvec3 p(apply_m.position(v));
-        Eigen::Vector3d f; f.setZero();
+        Eigen::ArrayXd phi(n);
+
+        #pragma omp for
+        for(int vi = 0; vi < (int)apply_m.n_vertices(); vi++)
+        {
+            Vertex v(vi);
+            dvec3 p(apply_m.position(v));
+
+            phi = (cx - p[0]).square() + (cy - p[1]).square() + (cz - p[2]).square();
+            phi *= phi.sqrt();
+            Eigen::Vector3d f = W.transpose() * phi.matrix();
+
+            // linear polynomial
+            f += X.col(n);
+            f += X.col(n + 1)*p[0];
+            f += X.col(n + 2)*p[1];
+            f += X.col(n + 3)*p[2];
+
+            apply_m.position(v) += f;
+        }
+    }
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+// Recursive median splits along the longest axis until a cluster has at most
+// leaf_size points, appends the clusters to order / offsets
+static void split_clusters(const std::vector<pmp::dvec3>& points,
+                           std::vector<int>::iterator first,
+                           std::vector<int>::iterator last,
+                           size_t leaf_size,
+                           std::vector<int>& order,
+                           std::vector<int>& offsets)
+{
+    size_t count = last - first;
+    if (count <= leaf_size)
+    {
+        order.insert(order.end(), first, last);
+        offsets.push_back((int)order.size());
+        return;
+    }
+
+    pmp::dvec3 bb_min(DBL_MAX), bb_max(-DBL_MAX);
+    for (auto it = first; it != last; ++it)
+    {
+        bb_min = pmp::min(bb_min, points[*it]);
+        bb_max = pmp::max(bb_max, points[*it]);
+    }
+    pmp::dvec3 extent = bb_max - bb_min;
+    int axis = 0;
+    if (extent[1] > extent[axis]) axis = 1;
+    if (extent[2] > extent[axis]) axis = 2;
+
+    auto middle = first + count / 2;
+    std::nth_element(first, middle, last, [&points, axis](int a, int b) { return points[a][axis] < points[b][axis]; });
+
+    split_clusters(points, first, middle, leaf_size, order, offsets);
+    split_clusters(points, middle, last, leaf_size, order, offsets);
+}
+
+//-----------------------------------------------------------------------------
+
+static void cluster_points(const std::vector<pmp::dvec3>& points,
+                           size_t leaf_size,
+                           std::vector<int>& order,
+                           std::vector<int>& offsets)
+{
+    std::vector<int> ids(points.size());
+    std::iota(ids.begin(), ids.end(), 0);
+
+    order.clear();
+    order.reserve(points.size());
+    offsets.assign(1, 0);
+    split_clusters(points, ids.begin(), ids.end(), leaf_size, order, offsets);
+}
+
+//-----------------------------------------------------------------------------
+
+// Adaptive cross approximation with full pivoting: rank one updates from the
+// largest residual entry until no entry is larger than tolerance. Falls back
+// to the dense block if the factors would not be smaller. Appends the
+// coefficients to storage.
+static void compress_block(Eigen::MatrixXd& residual,
+                           double tolerance,
+                           RBF_operator_block& out_block,
+                           std::vector<float>& storage)
+{
+    Eigen::Index p = residual.rows();
+    Eigen::Index q = residual.cols();
+    Eigen::Index max_rank = p * q / (p + q);
+
+    Eigen::MatrixXd dense = residual;
+    Eigen::MatrixXd u(p, max_rank);
+    Eigen::MatrixXd v(q, max_rank);
+
+    Eigen::Index rank = 0;
+    while (rank < max_rank)
+    {
+        Eigen::Index i, j;
+        double pivot = residual.cwiseAbs().maxCoeff(&i, &j);
+        if (pivot <= tolerance)
+        {
+            break;
+        }
+
+        u.col(rank) = residual.col(j);
+        v.col(rank) = residual.row(i).transpose() / residual(i, j);
+        residual.noalias() -= u.col(rank) * v.col(rank).transpose();
+        rank++;
+    }
+
+    out_block.offset = storage.size();
+    if (rank == max_rank)
+    {
+        out_block.rank = -1;
+        storage.resize(storage.size() + p * q);
+        Eigen::Map<Eigen::MatrixXf>(storage.data() + out_block.offset, p, q) = dense.cast<float>();
+    }
+    else
+    {
+        out_block.rank = (int)rank;
+        storage.resize(storage.size() + (p + q) * rank);
+        Eigen::Map<Eigen::MatrixXf>(storage.data() + out_block.offset, p, rank) = u.leftCols(rank).cast<float>();
+        Eigen::Map<Eigen::MatrixXf>(storage.data() + out_block.offset + p * rank, q, rank) = v.leftCols(rank).cast<float>();
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+bool init_rbf_operator(const pmp::SurfaceMesh& bones,
+                       const RBF_data& rbf_data,
+                       float tolerance,
+                       RBF_operator& out_operator,
+                       const std::atomic<bool>* cancel)
+{
+    using namespace pmp;
+
+    const std::vector<dvec3> &cts = rbf_data.centers;
+    size_t n = cts.size();
+    if(n < 5)
+    {
+        std::cerr << "too few centers" << std::endl;
+        return false;
+    }
+    if(rbf_data.solver.rows() != (Eigen::Index)(n + 4))
+    {
+        std::cerr << "rbf warp is not factorized" << std::endl;
+        return false;
+    }
+
+    RBF_operator& op = out_operator;
+    op = RBF_operator();
+    op.tolerance = tolerance;
+    op.n_centers = n;
+
+    std::vector<dvec3> points(bones.n_vertices());
+    op.points.resize(bones.n_vertices());
+    for (auto v : bones.vertices())
+    {
+        op.points[v.idx()] = bones.position(v);
+        points[v.idx()] = dvec3(bones.position(v));
+    }
+
+    cluster_points(points, RBF_OPERATOR_POINT_CLUSTER, op.point_order, op.point_offsets);
+    cluster_points(cts, RBF_OPERATOR_CENTER_CLUSTER, op.center_order, op.center_offsets);
+
+    int n_point_clusters = (int)op.point_offsets.size() - 1;
+    int n_center_clusters = (int)op.center_offsets.size() - 1;
+    std::vector<std::vector<RBF_operator_block>> cluster_blocks(n_point_clusters);
+    std::vector<std::vector<float>> cluster_storage(n_point_clusters);
+
+    std::atomic<bool> cancelled{false};
+
+    #pragma omp parallel for schedule(dynamic)
+    for (int c = 0; c < n_point_clusters; ++c)
+    {
+        if (cancelled || (cancel != nullptr && *cancel))
+        {
+            cancelled = true;
+            continue;
+        }
+
+        int first = op.point_offsets[c];
+        int count = op.point_offsets[c + 1] - first;
+
+        // kernel values of the cluster points, the solve gives their rows of W
+        Eigen::MatrixXd K(n + 4, count);
+        for (int k = 0; k < count; ++k)
+        {
+            const dvec3& p = points[op.point_order[first + k]];
+            for (size_t i = 0; i < n; ++i)
+            {
+                double r = distance(p, cts[i]);
+                K(i, k) = r*r*r;
+            }
+            K(n, k) = 1.0;
+            K(n + 1, k) = p[0];
+            K(n + 2, k) = p[1];
+            K(n + 3, k) = p[2];
+        }
+        Eigen::MatrixXd W = rbf_data.solver.solve(K).topRows(n).transpose();
+
+        cluster_blocks[c].resize(n_center_clusters);
+        for (int b = 0; b < n_center_clusters; ++b)
+        {
+            int center_first = op.center_offsets[b];
+            int center_count = op.center_offsets[b + 1] - center_first;
+
+            Eigen::MatrixXd block(count, center_count);
+            for (int k = 0; k < center_count; ++k)
+            {
+                block.col(k) = W.col(op.center_order[center_first + k]);
+            }
+
+            cluster_blocks[c][b].center_cluster = b;
+            compress_block(block, tolerance, cluster_blocks[c][b], cluster_storage[c]);
+        }
+    }
+
+    if (cancelled)
+    {
+        op = RBF_operator();
+        return false;
+    }
+
+    size_t n_coefficients = 0;
+    for (const auto& storage : cluster_storage)
+    {
+        n_coefficients += storage.size();
+    }
+    op.storage.reserve(n_coefficients);
+
+    op.block_offsets.assign(1, 0);
+    for (int c = 0; c < n_point_clusters; ++c)
+    {
+        for (auto& block : cluster_blocks[c])
+        {
+            block.offset += op.storage.size();
+            op.blocks.push_back(block);
+        }
+        op.block_offsets.push_back((int)op.blocks.size());
+
+        op.storage.insert(op.storage.end(), cluster_storage[c].begin(), cluster_storage[c].end());
+        std::vector<float>().swap(cluster_storage[c]);
+    }
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+bool apply_rbf_operator(const pmp::SurfaceMesh& skel_wrap,
+                        pmp::SurfaceMesh& bones,
+                        const RBF_data& rbf_data,
+                        const RBF_operator& rbf_operator)
+{
+    using namespace pmp;
+
+    const RBF_operator& op = rbf_operator;
+    if (op.n_centers != rbf_data.centers.size() || op.points.size() != bones.n_vertices())
+    {
+        std::cerr << "rbf operator does not match" << std::endl;
+        return false;
+    }
+
+    // center displacements in cluster order
+    Eigen::MatrixXf D(op.n_centers, 3);
+    for (size_t k = 0; k < op.n_centers; ++k)
+    {
+        int i = op.center_order[k];
+        dvec3 displ = (dvec3)skel_wrap.position(Vertex(rbf_data.indices[i]));
+        displ -= rbf_data.centers[i];
+        D.row(k) = Eigen::Vector3f((float)displ[0], (float)displ[1], (float)displ[2]);
+    }
+
+    int n_point_clusters = (int)op.point_offsets.size() - 1;
+    const float* coefficients = op.coefficients();
+
+    #pragma omp parallel for schedule(dynamic)
+    for (int c = 0; c < n_point_clusters; ++c)
+    {
+        int first = op.point_offsets[c];
+        int count = op.point_offsets[c + 1] - first;
+
+        Eigen::MatrixXf F = Eigen::MatrixXf::Zero(count, 3);
+        for (int b = op.block_offsets[c]; b < op.block_offsets[c + 1]; ++b)
+        {
+            const RBF_operator_block& block = op.blocks[b];
+            int center_first = op.center_offsets[block.center_cluster];
+            int center_count = op.center_offsets[block.center_cluster + 1] - center_first;
+            auto Dc = D.middleRows(center_first, center_count);
+            const float* x = coefficients + block.offset;
+
+            if (block.rank < 0)
+            {
+                Eigen::Map<const Eigen::MatrixXf> dense(x, count, center_count);
+                F.noalias() += dense * Dc;
+            }
+            else if (block.rank > 0)
+            {
+                Eigen::Map<const Eigen::MatrixXf> u(x, count, block.rank);
+                Eigen::Map<const Eigen::MatrixXf> v(x + (size_t)count * block.rank, center_count, block.rank);
+                Eigen::MatrixXf tmp = v.transpose() * Dc;
+                F.noalias() += u * tmp;
+            }
+        }
+
+        for (int k = 0; k < count; ++k)
+        {
+            int idx = op.point_order[first + k];
+            bones.position(Vertex(idx)) = op.points[idx] + Point(F(k, 0), F(k, 1), F(k, 2));
+        }
+    }
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+// FNV-1a (64 bit), like the fit cache
+static uint64_t hash_bytes(const void* data, size_t size, uint64_t seed = 14695981039346656037ULL)
+{
+    const auto* bytes = static_cast<const unsigned char*>(data);
+    uint64_t hash = seed;
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+//-----------------------------------------------------------------------------
+
+uint64_t rbf_cache_key(const pmp::SurfaceMesh& skel_wrap,
+                       const pmp::SurfaceMesh& bones,
+                       size_t num_additional_centers,
+                       float tolerance)
+{
+    const auto& skel_points = skel_wrap.get_vertex_property<pmp::Point>("v:point").vector();
+    const auto& bone_points = bones.get_vertex_property<pmp::Point>("v:point").vector();
+
+    uint64_t key = hash_bytes(nullptr, 0);
+    key = hash_bytes(skel_points.data(), skel_points.size() * sizeof(pmp::Point), key);
+    key = hash_bytes(bone_points.data(), bone_points.size() * sizeof(pmp::Point), key);
+
+    for (const char* selection : {"/mouth.sel", "/bo_head.sel", "/mapping_full_to_cut.sel"})
+    {
+        std::vector<int> ids;
+        read_selection(RESOURCE_DATA_DIR + selection, ids);
+        key = hash_bytes(ids.data(), ids.size() * sizeof(int), key);
+    }
+
+    uint64_t parameters[] = {num_additional_centers,
+                             RBF_OPERATOR_POINT_CLUSTER,
+                             RBF_OPERATOR_CENTER_CLUSTER,
+                             RBF_CACHE_VERSION};
+    key = hash_bytes(parameters, sizeof(parameters), key);
+    key = hash_bytes(&tolerance, sizeof(tolerance), key);
+
+    return key;
+}
+
+//-----------------------------------------------------------------------------
+
+// Header of the cache file, followed by the arrays in this order: centers,
+// indices, mapping_full_to_cutoff, points, point_order, point_offsets,
+// center_order, center_offsets, blocks, block_offsets and (aligned) the
+// coefficients. Native byte order, the key changes between platforms anyway.
+struct RBF_cache_header
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t key;
+    uint64_t n_centers;
+    uint64_t n_mapping;
+    uint64_t n_points;
+    uint64_t n_point_clusters;
+    uint64_t n_center_clusters;
+    uint64_t n_blocks;
+    uint64_t n_coefficients;
+    uint64_t coefficients_offset;
+    float tolerance;
+    uint32_t padding;
+};
+
+static_assert(std::is_trivially_copyable<RBF_operator_block>::value, "blocks are written as raw bytes");
+
+//-----------------------------------------------------------------------------
+
+// number of coefficients of a block
+static size_t block_size(const RBF_operator& op, int point_cluster, const RBF_operator_block& block)
+{
+    size_t count = op.point_offsets[point_cluster + 1] - op.point_offsets[point_cluster];
+    size_t center_count = op.center_offsets[block.center_cluster + 1] - op.center_offsets[block.center_cluster];
+    return block.rank < 0 ? count * center_count : (count + center_count) * block.rank;
+}
+
+//-----------------------------------------------------------------------------
+
+// coefficients used by the blocks (the storage of mapped operators is not known)
+static size_t n_operator_coefficients(const RBF_operator& op)
+{
+    size_t n_coefficients = 0;
+    for (size_t c = 0; c + 1 < op.block_offsets.size(); ++c)
+    {
+        for (int b = op.block_offsets[c]; b < op.block_offsets[c + 1]; ++b)
+        {
+            n_coefficients = std::max(n_coefficients, op.blocks[b].offset + block_size(op, (int)c, op.blocks[b]));
+        }
+    }
+    return n_coefficients;
+}
+
+//-----------------------------------------------------------------------------
+
+template <typename T>
+static void write_array(std::ofstream& out, const std::vector<T>& array)
+{
+    out.write(reinterpret_cast<const char*>(array.data()), (std::streamsize)(array.size() * sizeof(T)));
+}
+
+//-----------------------------------------------------------------------------
+
+bool save_rbf_cache(const std::filesystem::path& filename,
+                    uint64_t key,
+                    const RBF_data& rbf_data,
+                    const RBF_operator& rbf_operator)
+{
+    const RBF_operator& op = rbf_operator;
+    if (op.points.empty() || rbf_data.centers.size() != op.n_centers)
+    {
+        std::cerr << "[ERROR] rbf cache: operator is not initialized" << std::endl;
+        return false;
+    }
 
-        for(size_t i = 0; i < n; i++)
+    RBF_cache_header header{};
+    std::memcpy(header.magic, RBF_CACHE_MAGIC, sizeof(header.magic));
+    header.version = RBF_CACHE_VERSION;
+    header.key = key;
+    header.n_centers = rbf_data.centers.size();
+    header.n_mapping = rbf_data.mapping_full_to_cutoff.size();
+    header.n_points = op.points.size();
+    header.n_point_clusters = op.point_offsets.size() - 1;
+    header.n_center_clusters = op.center_offsets.size() - 1;
+    header.n_blocks = op.blocks.size();
+    header.n_coefficients = n_operator_coefficients(op);
+    header.tolerance = op.tolerance;
+
+    size_t offset = sizeof(header)
+                    + header.n_centers * (sizeof(pmp::dvec3) + 2 * sizeof(int))
+                    + header.n_mapping * sizeof(int)
+                    + header.n_points * (sizeof(pmp::Point) + sizeof(int))
+                    + (header.n_point_clusters + 1 + header.n_center_clusters + 1) * sizeof(int)
+                    + header.n_blocks * sizeof(RBF_operator_block)
+                    + (header.n_point_clusters + 1) * sizeof(int);
+    header.coefficients_offset = (offset + RBF_CACHE_ALIGNMENT - 1) / RBF_CACHE_ALIGNMENT * RBF_CACHE_ALIGNMENT;
+
+    std::error_code error;
+    std::filesystem::create_directories(filename.parent_path(), error);
+
+    // write complete file, then rename
+    std::filesystem::path tmp_filename = filename;
+    tmp_filename += "." + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id())) + ".tmp";
+    {
+        std::ofstream out(tmp_filename, std::ios::binary);
+        if (!out)
         {
-            double r = distance(p, cts[i]);
-            f += X.col(i).transpose()*r*r*r;
+            std::cerr << "[ERROR] rbf cache: cannot write " << tmp_filename << std::endl;
+            return false;
         }
 
-        // linear polynomial
-        f += X.col(n).transpose();
-        f += X.col(n + 1).transpose()*p[0];
-        f += X.col(n + 2).transpose()*p[1];
-        f += X.col(n + 3).transpose()*p[2];
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        write_array(out, rbf_data.centers);
+        write_array(out, rbf_data.indices);
+        write_array(out, rbf_data.mapping_full_to_cutoff);
+        write_array(out, op.points);
+        write_array(out, op.point_order);
+        write_array(out, op.point_offsets);
+        write_array(out, op.center_order);
+        write_array(out, op.center_offsets);
+        write_array(out, op.blocks);
+        write_array(out, op.block_offsets);
+        std::vector<char> padding(header.coefficients_offset - offset, 0);
+        write_array(out, padding);
+        out.write(reinterpret_cast<const char*>(op.coefficients()), (std::streamsize)(header.n_coefficients * sizeof(float)));
+
+        if (!out)
+        {
+            std::cerr << "[ERROR] rbf cache: cannot write " << tmp_filename << std::endl;
+            out.close();
+            std::filesystem::remove(tmp_filename, error);
+            return false;
+        }
+    }
 
-        apply_m.position(v) += f;
+    std::filesystem::rename(tmp_filename, filename, error);
+    if (error)
+    {
+        std::cerr << "[ERROR] rbf cache: " << error.message() << std::endl;
+        std::filesystem::remove(tmp_filename, error);
+        return false;
     }
 
     return true;
 }
 
 //-----------------------------------------------------------------------------
+
+// copies count elements from the file at offset, false if the file is too short
+template <typename T>
+static bool read_array(const MappedFile& file, size_t& offset, size_t count, std::vector<T>& array)
+{
+    if (count > (file.size() - offset) / sizeof(T))
+    {
+        return false;
+    }
+    array.resize(count);
+    std::memcpy(array.data(), file.data() + offset, count * sizeof(T));
+    offset += count * sizeof(T);
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+bool load_rbf_cache(const std::filesystem::path& filename,
+                    uint64_t key,
+                    RBF_data& out_data,
+                    RBF_operator& out_operator)
+{
+    auto file = std::make_shared<MappedFile>();
+    if (!file->open(filename.string()) || file->size() < sizeof(RBF_cache_header))
+    {
+        return false;
+    }
+
+    RBF_cache_header header;
+    std::memcpy(&header, file->data(), sizeof(header));
+    if (std::memcmp(header.magic, RBF_CACHE_MAGIC, sizeof(header.magic)) != 0
+        || header.version != RBF_CACHE_VERSION
+        || header.key != key)
+    {
+        return false;
+    }
+    if (header.n_point_clusters > header.n_points || header.n_center_clusters > header.n_centers)
+    {
+        std::cerr << "[ERROR] rbf cache: " << filename << " is broken" << std::endl;
+        return false;
+    }
+
+    RBF_data data;
+    RBF_operator op;
+    op.tolerance = header.tolerance;
+    op.n_centers = header.n_centers;
+
+    size_t offset = sizeof(header);
+    bool ok = read_array(*file, offset, header.n_centers, data.centers)
+              && read_array(*file, offset, header.n_centers, data.indices)
+              && read_array(*file, offset, header.n_mapping, data.mapping_full_to_cutoff)
+              && read_array(*file, offset, header.n_points, op.points)
+              && read_array(*file, offset, header.n_points, op.point_order)
+              && read_array(*file, offset, header.n_point_clusters + 1, op.point_offsets)
+              && read_array(*file, offset, header.n_centers, op.center_order)
+              && read_array(*file, offset, header.n_center_clusters + 1, op.center_offsets)
+              && read_array(*file, offset, header.n_blocks, op.blocks)
+              && read_array(*file, offset, header.n_point_clusters + 1, op.block_offsets)
+              && offset <= header.coefficients_offset
+              && header.coefficients_offset <= file->size()
+              && header.coefficients_offset % RBF_CACHE_ALIGNMENT == 0
+              && header.n_coefficients <= (file->size() - header.coefficients_offset) / sizeof(float);
+
+    // orders, clusters and blocks must stay inside their arrays (the file may be broken)
+    auto inside = [](const std::vector<int>& array, size_t size) {
+        return std::all_of(array.begin(), array.end(), [size](int i) { return i >= 0 && (size_t)i <= size; });
+    };
+    ok = ok && inside(op.point_order, header.n_points - 1) && inside(op.center_order, header.n_centers - 1)
+         && inside(op.point_offsets, header.n_points) && inside(op.center_offsets, header.n_centers)
+         && inside(op.block_offsets, header.n_blocks)
+         && std::is_sorted(op.point_offsets.begin(), op.point_offsets.end())
+         && std::is_sorted(op.center_offsets.begin(), op.center_offsets.end())
+         && std::is_sorted(op.block_offsets.begin(), op.block_offsets.end());
+
+    for (size_t c = 0; ok && c < header.n_point_clusters; ++c)
+    {
+        for (int b = op.block_offsets[c]; ok && b < op.block_offsets[c + 1]; ++b)
+        {
+            const RBF_operator_block& block = op.blocks[b];
+            ok = block.center_cluster >= 0 && (size_t)block.center_cluster < header.n_center_clusters
+                 && block.offset + block_size(op, (int)c, block) <= header.n_coefficients;
+        }
+    }
+    if (!ok)
+    {
+        std::cerr << "[ERROR] rbf cache: " << filename << " is broken" << std::endl;
+        return false;
+    }
+
+    data.num_centers = (int)header.n_centers;
+    op.mapped_coefficients = reinterpret_cast<const float*>(file->data() + header.coefficients_offset);
+    op.mapping = file;
+
+    out_data = std::move(data);
+    out_operator = std::move(op);
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+// Wendland C2 kernel (positive definite in 3D), r relative to the support
+static inline double wendland(double r)
+{
+    if (r >= 1.0) return 0.0;
+    double s = 1.0 - r;
+    s *= s;
+    return s * s * (4.0 * r + 1.0);
+}
+
+//-----------------------------------------------------------------------------
+
+// grid cell of p, clamped to the grid
+static inline void grid_cell(const RBF_sparse_level& level, const pmp::dvec3& p, int cell[3])
+{
+    for (int k = 0; k < 3; ++k)
+    {
+        int c = (int)std::floor((p[k] - level.grid_origin[k]) / level.support_radius);
+        cell[k] = std::clamp(c, 0, level.grid_size[k] - 1);
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+// calls f(k, phi) for all centers center_order[k] of the level within the
+// support of p
+template <typename F>
+static void for_centers_in_support(const RBF_sparse_data& data, const RBF_sparse_level& level, const pmp::dvec3& p, F f)
+{
+    int cell[3];
+    grid_cell(level, p, cell);
+
+    // the clamped cell is right for points outside the grid as well,
+    // centers of farther cells are out of support anyway
+    for (int z = std::max(cell[2] - 1, 0); z <= std::min(cell[2] + 1, level.grid_size[2] - 1); ++z)
+    {
+        for (int y = std::max(cell[1] - 1, 0); y <= std::min(cell[1] + 1, level.grid_size[1] - 1); ++y)
+        {
+            for (int x = std::max(cell[0] - 1, 0); x <= std::min(cell[0] + 1, level.grid_size[0] - 1); ++x)
+            {
+                int c = (z * level.grid_size[1] + y) * level.grid_size[0] + x;
+                for (int i = level.grid_offsets[c]; i < level.grid_offsets[c + 1]; ++i)
+                {
+                    int k = level.grid_centers[i];
+                    double r = distance(p, data.centers[data.center_order[k]]) / level.support_radius;
+                    if (r < 1.0)
+                    {
+                        f(k, wendland(r));
+                    }
+                }
+            }
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+static bool init_sparse_level(const RBF_sparse_data& data, RBF_sparse_level& level)
+{
+    using namespace pmp;
+
+    int n = level.n_centers;
+    auto center = [&data](int k) -> const dvec3& { return data.centers[data.center_order[k]]; };
+
+    // sort centers into the grid
+    dvec3 bb_min(DBL_MAX), bb_max(-DBL_MAX);
+    for (int k = 0; k < n; ++k)
+    {
+        bb_min = min(bb_min, center(k));
+        bb_max = max(bb_max, center(k));
+    }
+    level.grid_origin = bb_min;
+    for (int k = 0; k < 3; ++k)
+    {
+        level.grid_size[k] = (int)std::floor((bb_max[k] - bb_min[k]) / level.support_radius) + 1;
+    }
+
+    std::vector<int> center_cells(n);
+    level.grid_offsets.assign(level.grid_size[0] * level.grid_size[1] * level.grid_size[2] + 1, 0);
+    for (int k = 0; k < n; ++k)
+    {
+        int cell[3];
+        grid_cell(level, center(k), cell);
+        center_cells[k] = (cell[2] * level.grid_size[1] + cell[1]) * level.grid_size[0] + cell[0];
+        level.grid_offsets[center_cells[k] + 1]++;
+    }
+    std::partial_sum(level.grid_offsets.begin(), level.grid_offsets.end(), level.grid_offsets.begin());
+    level.grid_centers.resize(n);
+    std::vector<int> fill(level.grid_offsets.begin(), level.grid_offsets.end() - 1);
+    for (int k = 0; k < n; ++k)
+    {
+        level.grid_centers[fill[center_cells[k]]++] = k;
+    }
+
+    // kernel matrix, lower triangle
+    using Triplet = Eigen::Triplet<double>;
+    std::vector<std::vector<Triplet>> row_triplets(n);
+
+    #pragma omp parallel for schedule(dynamic, 64)
+    for (int i = 0; i < n; ++i)
+    {
+        for_centers_in_support(data, level, center(i), [&](int j, double phi) {
+            if (j <= i)
+            {
+                row_triplets[i].emplace_back(i, j, phi);
+            }
+        });
+    }
+
+    std::vector<Triplet> triplets;
+    for (auto& row : row_triplets)
+    {
+        triplets.insert(triplets.end(), row.begin(), row.end());
+        std::vector<Triplet>().swap(row);
+    }
+
+    Eigen::SparseMatrix<double> A(n, n);
+    A.setFromTriplets(triplets.begin(), triplets.end());
+
+    level.solver = std::make_unique<Eigen::SimplicialLLT<Eigen::SparseMatrix<double>>>(A);
+    if (level.solver->info() != Eigen::Success)
+    {
+        std::cerr << "sparse rbf matrix is not positive definite" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+bool init_rbf_warp_sparse(pmp::SurfaceMesh& skel_wrap,
+                          size_t num_additional_centers,
+                          size_t num_coarse_centers,
+                          double support_factor,
+                          RBF_sparse_data& out_data)
+{
+    using namespace pmp;
+
+    RBF_data center_data;
+    if (!find_rbf_centers_prioritize_head(skel_wrap, num_additional_centers, center_data)) return false;
+
+    RBF_sparse_data& data = out_data;
+    data = RBF_sparse_data();
+    data.centers = std::move(center_data.centers);
+    data.indices = std::move(center_data.indices);
+    data.num_centers = center_data.num_centers;
+
+    const std::vector<dvec3> &cts = data.centers;
+    int n = (int)cts.size();
+    if (n < 5 || num_coarse_centers < 5 || support_factor <= 0.0)
+    {
+        std::cerr << "too few centers or no support" << std::endl;
+        return false;
+    }
+
+    // farthest point order of the centers (the head priority of the sampling
+    // would make the coarse levels uneven), spacing[k] is the distance of
+    // center k to the ones before, about the fill distance of the prefix
+    std::vector<Point> points(n);
+    for (int i = 0; i < n; ++i)
+    {
+        points[i] = Point(cts[i]);
+    }
+    FarthestPointSampling sampling;
+    sampling.build(points);
+    sampling.sample(n);
+    data.center_order = sampling.samples();
+    std::vector<double> spacing(sampling.spacing().begin(), sampling.spacing().end());
+
+    // affine part
+    Eigen::MatrixXd P(n, 4);
+    for (int i = 0; i < n; ++i)
+    {
+        P(i, 0) = 1.0;
+        P(i, 1) = cts[i][0];
+        P(i, 2) = cts[i][1];
+        P(i, 3) = cts[i][2];
+    }
+    data.affine_projection = (P.transpose() * P).ldlt().solve(P.transpose());
+
+    // coarse to fine with halved support, every level has the centers that
+    // are spaced enough for it (the farthest point spacing only decreases),
+    // the last level has all centers
+    double support_radius = support_factor * spacing[std::min(num_coarse_centers, (size_t)n) - 1];
+    double min_support_radius = 1e-3 * support_radius;
+    for (int n_level = 0; n_level < n; support_radius *= 0.5)
+    {
+        while (n_level < n && spacing[n_level] * support_factor >= support_radius)
+        {
+            n_level++;
+        }
+        // (nearly) duplicate centers
+        if (support_radius < min_support_radius)
+        {
+            n_level = n;
+        }
+        if (!data.levels.empty() && data.levels.back().n_centers == n_level)
+        {
+            continue;
+        }
+
+        RBF_sparse_level level;
+        level.n_centers = n_level;
+        level.support_radius = support_radius;
+        if (!init_sparse_level(data, level)) return false;
+        data.levels.push_back(std::move(level));
+    }
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+bool apply_rbf_warp_sparse(const pmp::SurfaceMesh& skel_wrap,
+                           pmp::SurfaceMesh& bones,
+                           const RBF_sparse_data& rbf_data)
+{
+    using namespace pmp;
+
+    const std::vector<dvec3> &cts = rbf_data.centers;
+    int n = (int)cts.size();
+    if (n < 5 || rbf_data.levels.empty() || rbf_data.levels.back().n_centers != n)
+    {
+        std::cerr << "sparse rbf warp is not initialized" << std::endl;
+        return false;
+    }
+
+    // center displacements
+    Eigen::MatrixXd D(n, 3);
+    for (int i = 0; i < n; ++i)
+    {
+        dvec3 displ = (dvec3)skel_wrap.position(Vertex(rbf_data.indices[i]));
+        displ -= cts[i];
+        D.row(i) = Eigen::Vector3d(displ[0], displ[1], displ[2]);
+    }
+
+    // affine fit, the levels interpolate the rest (residual in center order)
+    Eigen::MatrixXd affine = rbf_data.affine_projection * D;
+    Eigen::MatrixXd residual(n, 3);
+    for (int k = 0; k < n; ++k)
+    {
+        int i = rbf_data.center_order[k];
+        residual.row(k) = D.row(i)
+                          - affine.row(0)
+                          - cts[i][0] * affine.row(1)
+                          - cts[i][1] * affine.row(2)
+                          - cts[i][2] * affine.row(3);
+    }
+
+    std::vector<Eigen::MatrixXd> X(rbf_data.levels.size());
+    for (size_t l = 0; l < rbf_data.levels.size(); ++l)
+    {
+        const RBF_sparse_level& level = rbf_data.levels[l];
+        X[l] = level.solver->solve(residual.topRows(level.n_centers));
+
+        // what is left for the finer levels (all their centers)
+        if (l + 1 < rbf_data.levels.size())
+        {
+            #pragma omp parallel for schedule(dynamic, 256)
+            for (int k = 0; k < n; ++k)
+            {
+                Eigen::RowVector3d f = Eigen::RowVector3d::Zero();
+                for_centers_in_support(rbf_data, level, cts[rbf_data.center_order[k]], [&](int j, double phi) {
+                    f += phi * X[l].row(j);
+                });
+                residual.row(k) -= f;
+            }
+        }
+    }
+
+    #pragma omp parallel for schedule(dynamic, 256)
+    for (int vi = 0; vi < (int)bones.n_vertices(); ++vi)
+    {
+        Vertex v(vi);
+        dvec3 p(bones.position(v));
+
+        Eigen::RowVector3d f = affine.row(0)
+                               + p[0] * affine.row(1)
+                               + p[1] * affine.row(2)
+                               + p[2] * affine.row(3);
+        for (size_t l = 0; l < rbf_data.levels.size(); ++l)
+        {
+            for_centers_in_support(rbf_data, rbf_data.levels[l], p, [&](int j, double phi) {
+                f += phi * X[l].row(j);
+            });
+        }
+
+        bones.position(v) += Point(f[0], f[1], f[2]);
+    }
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+RBF_warp_error compare_rbf_warps(const pmp::SurfaceMesh& warped,
+                                 const pmp::SurfaceMesh& reference)
+{
+    RBF_warp_error error;
+    if (warped.n_vertices() != reference.n_vertices() || warped.n_vertices() == 0)
+    {
+        return error;
+    }
+
+    for (auto v : warped.vertices())
+    {
+        double d = distance(pmp::dvec3(warped.position(v)), pmp::dvec3(reference.position(v)));
+        error.max = std::max(error.max, d);
+        error.mean += d;
+        error.rms += d * d;
+    }
+    error.mean /= warped.n_vertices();
+    error.rms = std::sqrt(error.rms / warped.n_vertices());
+
+    return error;
+}
+
+//-----------------------------------------------------------------------------
@@ -2,12 +2,19 @@
 
 #pragma once
 
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
 #include <vector>
 
 #include <Eigen/Dense>
+#include <Eigen/Sparse>
 
 #include <pmp/surface_mesh.h>
 
+#include "utils/io/mapped_file.h"
+
 //-----------------------------------------------------------------------------
 
 struct RBF_data
@@ -36,3 +43,183 @@ bool init_rbf_warp_prioritize_head(pmp::SurfaceMesh& skel_wrap,
 bool apply_rbf_warp(pmp::SurfaceMesh& skel_wrap, pmp::SurfaceMesh& bones, RBF_data& rbf_data);
 
 //-----------------------------------------------------------------------------
+
+// Block of the warp operator: points of one point cluster x centers of one
+// center cluster, either dense or low rank (u * v^T). The coefficients are
+// stored column major at offset in RBF_operator::coefficients(), dense
+// (points x centers) or u (points x rank) followed by v (centers x rank).
+struct RBF_operator_block
+{
+    int center_cluster = 0;
+    // -1 for dense blocks
+    int rank = -1;
+    size_t offset = 0;
+};
+
+// For fixed points (the template bones) the warp is a linear map of the
+// center displacements: displacement = W * (center displacements), where row
+// j of W holds the cardinal functions of all centers at point j (polynomial
+// part included). Points and centers are clustered spatially and every block
+// of W is stored as adaptive cross approximation (entries off by at most
+// tolerance) or dense if that is not smaller. Applying it is one small GEMM
+// per block instead of a solve and n kernel evaluations per point.
+struct RBF_operator
+{
+    float tolerance = 0.0f;
+    size_t n_centers = 0;
+
+    // rest positions the operator was built for
+    std::vector<pmp::Point> points;
+
+    // point_order[point_offsets[c], point_offsets[c + 1]) are the points of
+    // cluster c, the same for centers (indices into RBF_data::centers)
+    std::vector<int> point_order;
+    std::vector<int> point_offsets;
+    std::vector<int> center_order;
+    std::vector<int> center_offsets;
+
+    // blocks[block_offsets[c], block_offsets[c + 1]) belong to point cluster c
+    std::vector<RBF_operator_block> blocks;
+    std::vector<int> block_offsets;
+
+    // coefficients of all blocks, either owned or mapped from a cache file
+    std::vector<float> storage;
+    std::shared_ptr<const MappedFile> mapping;
+    const float* mapped_coefficients = nullptr;
+
+    const float* coefficients() const
+    {
+        return mapping ? mapped_coefficients : storage.data();
+    }
+};
+
+//-----------------------------------------------------------------------------
+
+// Needs one solve per point with the factorization of rbf_data, expensive for
+// many points (seconds to minutes), but parallel and cancelable between
+// point clusters (returns false if cancelled).
+bool init_rbf_operator(const pmp::SurfaceMesh& bones,
+                       const RBF_data& rbf_data,
+                       float tolerance,
+                       RBF_operator& out_operator,
+                       const std::atomic<bool>* cancel = nullptr);
+
+//-----------------------------------------------------------------------------
+
+// Sets the bones to the warped rest positions of the operator. Every
+// coordinate is off by at most tolerance times the sum of the absolute center
+// displacements in that coordinate (in practice orders of magnitude less).
+bool apply_rbf_operator(const pmp::SurfaceMesh& skel_wrap,
+                        pmp::SurfaceMesh& bones,
+                        const RBF_data& rbf_data,
+                        const RBF_operator& rbf_operator);
+
+//-----------------------------------------------------------------------------
+
+// On-disk cache of the warp setup (centers, indices, mapping to the cutoff
+// wrap and the bone operator), so later starts skip the center sampling, the
+// factorization and the operator build. The factorization itself is not
+// stored: it is larger than the operator (dense (n+4)^2 doubles) and only
+// needed to build the operator, loaded data has an empty solver.
+
+// Key of the cache: template skel wrap and bones, the selections that steer
+// the center sampling, the parameters and the file format version.
+uint64_t rbf_cache_key(const pmp::SurfaceMesh& skel_wrap,
+                       const pmp::SurfaceMesh& bones,
+                       size_t num_additional_centers,
+                       float tolerance);
+
+//-----------------------------------------------------------------------------
+
+// Writes a temporary file and renames it, readers never see partial caches.
+bool save_rbf_cache(const std::filesystem::path& filename,
+                    uint64_t key,
+                    const RBF_data& rbf_data,
+                    const RBF_operator& rbf_operator);
+
+//-----------------------------------------------------------------------------
+
+// Maps the cache file, the operator coefficients stay in the mapping (no
+// copy). Returns false if the file is missing, broken, of another version or
+// was written for another key.
+bool load_rbf_cache(const std::filesystem::path& filename,
+                    uint64_t key,
+                    RBF_data& out_data,
+                    RBF_operator& out_operator);
+
+//-----------------------------------------------------------------------------
+
+// Sparse warp mode: multilevel interpolation with the compactly supported
+// Wendland C2 kernel instead of r^3. The affine part is a least squares fit
+// of the center displacements, every level interpolates what the affine part
+// and the coarser levels leave at its centers. The support halves from level
+// to level, a level has the prefix of a farthest point order of the centers
+// that is spaced at least support / support_factor (the last one has all).
+// Coarse levels keep the deformation smooth deep inside the wrap, fine
+// levels add the detail where the centers are dense (head). Every level
+// matrix only couples centers within its support, is positive definite and
+// factorized by sparse Cholesky, and points only see the centers in the grid
+// cells around them. This allows many more centers than the dense warp.
+struct RBF_sparse_level
+{
+    // number of centers (a prefix of RBF_sparse_data::center_order)
+    int n_centers = 0;
+    double support_radius = 0.0;
+
+    // uniform grid of the centers with cells of the support radius,
+    // grid_centers[grid_offsets[c], grid_offsets[c + 1]) are in cell c
+    pmp::dvec3 grid_origin;
+    int grid_size[3] = {0, 0, 0};
+    std::vector<int> grid_offsets;
+    std::vector<int> grid_centers;
+
+    std::unique_ptr<Eigen::SimplicialLLT<Eigen::SparseMatrix<double>>> solver;
+};
+
+struct RBF_sparse_data
+{
+    std::vector<pmp::dvec3> centers;
+    std::vector<int> indices;
+    int num_centers = 0;
+
+    // farthest point order of the centers, the levels use prefixes of it
+    std::vector<int> center_order;
+
+    // least squares fit of the affine part: (P^T P)^-1 P^T, P = [1 x y z]
+    Eigen::MatrixXd affine_projection;
+
+    // coarse to fine
+    std::vector<RBF_sparse_level> levels;
+};
+
+//-----------------------------------------------------------------------------
+
+// Centers are sampled like init_rbf_warp_prioritize_head, the coarsest level
+// has about num_coarse_centers of them.
+bool init_rbf_warp_sparse(pmp::SurfaceMesh& skel_wrap,
+                          size_t num_additional_centers,
+                          size_t num_coarse_centers,
+                          double support_factor,
+                          RBF_sparse_data& out_data);
+
+//-----------------------------------------------------------------------------
+
+bool apply_rbf_warp_sparse(const pmp::SurfaceMesh& skel_wrap,
+                           pmp::SurfaceMesh& bones,
+                           const RBF_sparse_data& rbf_data);
+
+//-----------------------------------------------------------------------------
+
+// Deviation of two warped versions of the same mesh (e.g. sparse against
+// dense warp), in the units of the mesh
+struct RBF_warp_error
+{
+    double max = 0.0;
+    double mean = 0.0;
+    double rms = 0.0;
+};
+
+RBF_warp_error compare_rbf_warps(const pmp::SurfaceMesh& warped,
+                                 const pmp::SurfaceMesh& reference);
+
+//-----------------------------------------------------------------------------
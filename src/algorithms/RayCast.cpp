@@ -0,0 +1,272 @@
+//======================================================================================================================
+// Copyright (c) the Authors 2024
+//
+// This work is licensed under a
+// Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+//
+// You should have received a copy of the license along with this
+// work. If not, see <http://creativecommons.org/licenses/by-nc-sa/4.0/>.
+//
+//======================================================================================================================
+
+#include "RayCast.h"
+#include "algorithms/SimdFloat.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <numeric>
+
+#include <pmp/algorithms/normals.h>
+
+// hits closer to the origin are ignored (the ray starts on a surface)
+#define RAY_MIN_DISTANCE 1e-6F
+
+// =====================================================================================================================
+
+using S = SimdFloat;
+using Vec = S::type;
+using Mask = S::mask;
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+// Rays of one packet in structure of arrays layout, unused lanes repeat the last ray
+struct RayPacket {
+    alignas(64) float origin[3][S::width]{};
+    alignas(64) float direction[3][S::width]{};
+    alignas(64) float inverse[3][S::width]{};
+    int rays[S::width]{};
+    int size = 0;
+};
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+// spreads the lower 10 bits of x to every third bit
+static inline auto expand_bits(uint32_t x) -> uint32_t
+{
+    x = (x | (x << 16)) & 0x030000FF;
+    x = (x | (x << 8)) & 0x0300F00F;
+    x = (x | (x << 4)) & 0x030C30C3;
+    x = (x | (x << 2)) & 0x09249249;
+    return x;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+// ray indices sorted along a Morton curve of the origins, neighbouring rays end up in the same packet
+static auto morton_order(const std::vector<pmp::Point>& origins) -> std::vector<int>
+{
+    AABB box;
+    for (const auto& p : origins) {
+        box.extend(p);
+    }
+    pmp::Point extent = pmp::max(box.max - box.min, pmp::Point(1e-12F, 1e-12F, 1e-12F));
+
+    std::vector<uint32_t> codes(origins.size());
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < static_cast<int>(origins.size()); ++i) {
+        uint32_t code = 0;
+        for (int c = 0; c < 3; ++c) {
+            auto cell = static_cast<uint32_t>(std::clamp((origins[i][c] - box.min[c]) / extent[c], 0.0F, 1.0F) * 1023.0F);
+            code |= expand_bits(cell) << c;
+        }
+        codes[i] = code;
+    }
+
+    std::vector<int> order(origins.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&codes](int a, int b) { return codes[a] < codes[b]; });
+    return order;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+static auto trace_packet(const TriangleBVH& bvh, const std::vector<pmp::Point>& positions, const RayPacket& packet,
+                         float max_distance, RayHit* hits) -> void
+{
+    const std::vector<TriangleBVH::Node>& nodes = bvh.nodes();
+    const std::vector<int>& faces = bvh.faces();
+
+    Vec origin[3], direction[3], inverse[3];
+    pmp::Point mean_direction(0.0F, 0.0F, 0.0F);
+    for (int c = 0; c < 3; ++c) {
+        origin[c] = S::load(packet.origin[c]);
+        direction[c] = S::load(packet.direction[c]);
+        inverse[c] = S::load(packet.inverse[c]);
+        for (int lane = 0; lane < packet.size; ++lane) {
+            mean_direction[c] += packet.direction[c][lane];
+        }
+    }
+
+    const Vec zero = S::set1(0.0F);
+    const Vec one = S::set1(1.0F);
+    const Vec t_min = S::set1(RAY_MIN_DISTANCE);
+    Vec t_best = S::set1(max_distance);
+    Vec face_best = S::set1(-1.0F);
+    Vec u_best = zero;
+    Vec v_best = zero;
+
+    // reused by all packets of a thread
+    thread_local std::vector<int> stack;
+    stack.assign(1, 0);
+    while (!stack.empty()) {
+        const TriangleBVH::Node& node = nodes[stack.back()];
+        stack.pop_back();
+
+        // slab test of all rays against the box, clipped to the closest hit so far
+        Vec t0 = t_min;
+        Vec t1 = t_best;
+        for (int c = 0; c < 3; ++c) {
+            Vec a = S::mul(S::sub(S::set1(node.box.min[c]), origin[c]), inverse[c]);
+            Vec b = S::mul(S::sub(S::set1(node.box.max[c]), origin[c]), inverse[c]);
+            t0 = S::max(t0, S::min(a, b));
+            t1 = S::min(t1, S::max(a, b));
+        }
+        if (S::bits(S::less_equal(t0, t1)) == 0) {
+            continue;
+        }
+
+        if (node.count == 0) {
+            // child in direction of the packet on top of the stack
+            int near = node.first;
+            int far = node.first + 1;
+            pmp::Point offset = (nodes[far].box.min + nodes[far].box.max) - (nodes[near].box.min + nodes[near].box.max);
+            if (pmp::dot(offset, mean_direction) < 0.0F) {
+                std::swap(near, far);
+            }
+            stack.push_back(far);
+            stack.push_back(near);
+            continue;
+        }
+
+        // Moeller-Trumbore, one face against all rays
+        for (int i = node.first; i < node.first + node.count; ++i) {
+            int f = faces[i];
+            const auto& fv = bvh.face_vertices(f);
+            const pmp::Point& p0 = positions[fv[0]];
+            pmp::Point e1 = positions[fv[1]] - p0;
+            pmp::Point e2 = positions[fv[2]] - p0;
+
+            Vec edge1[3], edge2[3], tvec[3], pvec[3], qvec[3];
+            for (int c = 0; c < 3; ++c) {
+                edge1[c] = S::set1(e1[c]);
+                edge2[c] = S::set1(e2[c]);
+                tvec[c] = S::sub(origin[c], S::set1(p0[c]));
+            }
+
+            pvec[0] = S::sub(S::mul(direction[1], edge2[2]), S::mul(direction[2], edge2[1]));
+            pvec[1] = S::sub(S::mul(direction[2], edge2[0]), S::mul(direction[0], edge2[2]));
+            pvec[2] = S::sub(S::mul(direction[0], edge2[1]), S::mul(direction[1], edge2[0]));
+            Vec det = S::add(S::add(S::mul(edge1[0], pvec[0]), S::mul(edge1[1], pvec[1])), S::mul(edge1[2], pvec[2]));
+            // parallel rays give inf / NaN, which fail the ordered comparisons below
+            Vec inv_det = S::div(one, det);
+
+            Vec u = S::add(S::add(S::mul(tvec[0], pvec[0]), S::mul(tvec[1], pvec[1])), S::mul(tvec[2], pvec[2]));
+            u = S::mul(u, inv_det);
+
+            qvec[0] = S::sub(S::mul(tvec[1], edge1[2]), S::mul(tvec[2], edge1[1]));
+            qvec[1] = S::sub(S::mul(tvec[2], edge1[0]), S::mul(tvec[0], edge1[2]));
+            qvec[2] = S::sub(S::mul(tvec[0], edge1[1]), S::mul(tvec[1], edge1[0]));
+
+            Vec v = S::add(S::add(S::mul(direction[0], qvec[0]), S::mul(direction[1], qvec[1])),
+                           S::mul(direction[2], qvec[2]));
+            v = S::mul(v, inv_det);
+            Vec t = S::add(S::add(S::mul(edge2[0], qvec[0]), S::mul(edge2[1], qvec[1])), S::mul(edge2[2], qvec[2]));
+            t = S::mul(t, inv_det);
+
+            Mask hit = S::land(S::less_equal(zero, u), S::less_equal(zero, v));
+            hit = S::land(hit, S::less_equal(S::add(u, v), one));
+            hit = S::land(hit, S::land(S::less(t_min, t), S::less(t, t_best)));
+            if (S::bits(hit) == 0) {
+                continue;
+            }
+
+            t_best = S::select(hit, t, t_best);
+            face_best = S::select(hit, S::set1(static_cast<float>(f)), face_best);
+            u_best = S::select(hit, u, u_best);
+            v_best = S::select(hit, v, v_best);
+        }
+    }
+
+    alignas(64) float t_out[S::width];
+    alignas(64) float face_out[S::width];
+    alignas(64) float u_out[S::width];
+    alignas(64) float v_out[S::width];
+    S::store(t_out, t_best);
+    S::store(face_out, face_best);
+    S::store(u_out, u_best);
+    S::store(v_out, v_best);
+
+    for (int lane = 0; lane < packet.size; ++lane) {
+        RayHit& hit = hits[packet.rays[lane]];
+        hit = RayHit();
+        if (face_out[lane] >= 0.0F) {
+            hit.face = static_cast<int>(face_out[lane]);
+            hit.distance = t_out[lane];
+            hit.u = u_out[lane];
+            hit.v = v_out[lane];
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto cast_rays(const TriangleBVH& bvh, const std::vector<pmp::Point>& positions, const std::vector<pmp::Point>& origins,
+               const std::vector<pmp::Point>& directions, std::vector<RayHit>& hits, float max_distance) -> void
+{
+    hits.assign(origins.size(), RayHit());
+    if (bvh.empty() || origins.empty() || directions.size() != origins.size()) {
+        return;
+    }
+
+    std::vector<int> order = morton_order(origins);
+    int n_packets = (static_cast<int>(order.size()) + S::width - 1) / S::width;
+
+    #pragma omp parallel for schedule(dynamic, 16)
+    for (int packet_index = 0; packet_index < n_packets; ++packet_index) {
+        RayPacket packet;
+        int first = packet_index * S::width;
+        packet.size = std::min(S::width, static_cast<int>(order.size()) - first);
+        for (int lane = 0; lane < S::width; ++lane) {
+            int ray = order[first + std::min(lane, packet.size - 1)];
+            packet.rays[lane] = ray;
+            for (int c = 0; c < 3; ++c) {
+                packet.origin[c][lane] = origins[ray][c];
+                packet.direction[c][lane] = directions[ray][c];
+                packet.inverse[c][lane] = 1.0F / directions[ray][c];
+            }
+        }
+
+        trace_packet(bvh, positions, packet, max_distance, hits.data());
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto ray_thickness(pmp::SurfaceMesh& mesh, const pmp::SurfaceMesh& target, TriangleBVH& target_bvh,
+                   float max_thickness, const std::string& property_name) -> void
+{
+    if (target_bvh.matches(target)) {
+        target_bvh.refit(target);
+    } else {
+        target_bvh.build(target);
+    }
+
+    const std::vector<pmp::Point>& origins = mesh.get_vertex_property<pmp::Point>("v:point").vector();
+    std::vector<pmp::Point> directions(mesh.vertices_size());
+
+    #pragma omp parallel for schedule(static)
+    for (int v = 0; v < static_cast<int>(mesh.vertices_size()); ++v) {
+        directions[v] = -pmp::vertex_normal(mesh, pmp::Vertex(v));
+    }
+
+    std::vector<RayHit> hits;
+    cast_rays(target_bvh, target.get_vertex_property<pmp::Point>("v:point").vector(), origins, directions, hits,
+              max_thickness);
+
+    auto thickness = mesh.vertex_property<float>(property_name);
+    for (auto v : mesh.vertices()) {
+        thickness[v] = hits[v.idx()].face == -1 ? max_thickness : hits[v.idx()].distance;
+    }
+}
+
+// =====================================================================================================================
@@ -0,0 +1,52 @@
+//======================================================================================================================
+// Copyright (c) the Authors 2024
+//
+// This work is licensed under a
+// Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+//
+// You should have received a copy of the license along with this
+// work. If not, see <http://creativecommons.org/licenses/by-nc-sa/4.0/>.
+//
+//======================================================================================================================
+
+#ifndef TAILORME_VIEWER_RAYCAST_H
+#define TAILORME_VIEWER_RAYCAST_H
+
+#include <cfloat>
+#include <string>
+#include <vector>
+
+#include <pmp/surface_mesh.h>
+
+#include "algorithms/TriangleBVH.h"
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+// First hit of a ray, the hit point has the weights (1 - u - v, u, v) of the face vertices
+// (order of TriangleBVH::face_vertices)
+struct RayHit {
+    int face = -1;
+    float distance = FLT_MAX;
+    float u = 0.0F;
+    float v = 0.0F;
+};
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+// Casts rays (origins, unit directions) against the faces of the hierarchy (positions of the mesh it was fitted to)
+// and reports the first hit within (0, max_distance] per ray, both sides of the faces count.
+// Rays are sorted along a Morton curve of their origins and traced in packets of the SIMD width (Moeller-Trumbore
+// against a whole packet per face, slab tests of a whole packet per node), packets run in parallel.
+auto cast_rays(const TriangleBVH& bvh, const std::vector<pmp::Point>& positions, const std::vector<pmp::Point>& origins,
+               const std::vector<pmp::Point>& directions, std::vector<RayHit>& hits,
+               float max_distance = FLT_MAX) -> void;
+
+// Thickness of the layer below mesh (e.g. soft tissue between skin and skel wrap or bones): distance from every vertex
+// along its inverted normal to the first face of target, max_thickness if there is none that close.
+// Stored as float vertex property of mesh. target_bvh is rebuilt if it does not match target and refitted otherwise.
+auto ray_thickness(pmp::SurfaceMesh& mesh, const pmp::SurfaceMesh& target, TriangleBVH& target_bvh,
+                   float max_thickness, const std::string& property_name = "v:ray_thickness") -> void;
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+#endif // TAILORME_VIEWER_RAYCAST_H
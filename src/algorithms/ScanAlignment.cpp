@@ -0,0 +1,182 @@
+//======================================================================================================================
+// Copyright (c) the Authors 2024
+//
+// This work is licensed under a
+// Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+//
+// You should have received a copy of the license along with this
+// work. If not, see <http://creativecommons.org/licenses/by-nc-sa/4.0/>.
+//
+//======================================================================================================================
+
+#include "ScanAlignment.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+// =====================================================================================================================
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto SimilarityTransform::apply(const pmp::Point& point) const -> pmp::Point
+{
+    Eigen::Vector3f result = scale * (rotation * Eigen::Vector3f(point[0], point[1], point[2])) + translation;
+    return pmp::Point(result[0], result[1], result[2]);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto SimilarityTransform::apply_inverse(const pmp::Point& point) const -> pmp::Point
+{
+    Eigen::Vector3f result =
+        rotation.transpose() * (Eigen::Vector3f(point[0], point[1], point[2]) - translation) / scale;
+    return pmp::Point(result[0], result[1], result[2]);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto estimate_similarity_transform(const std::vector<pmp::Point>& source,
+                                   const std::vector<pmp::Point>& target,
+                                   const std::vector<float>& weights,
+                                   bool with_scale) -> SimilarityTransform
+{
+    SimilarityTransform result{};
+
+    // weighted centroids (double for the sums, scans can be large)
+    double weight_sum = 0.0;
+    Eigen::Vector3d mean_source = Eigen::Vector3d::Zero();
+    Eigen::Vector3d mean_target = Eigen::Vector3d::Zero();
+    for (size_t i = 0; i < source.size(); ++i) {
+        if (weights[i] <= 0.0F) {
+            continue;
+        }
+        weight_sum += weights[i];
+        mean_source += weights[i] * Eigen::Vector3d(source[i][0], source[i][1], source[i][2]);
+        mean_target += weights[i] * Eigen::Vector3d(target[i][0], target[i][1], target[i][2]);
+    }
+    if (weight_sum <= 0.0) {
+        return result;
+    }
+    mean_source /= weight_sum;
+    mean_target /= weight_sum;
+
+    // cross covariance and source variance
+    Eigen::Matrix3d covariance = Eigen::Matrix3d::Zero();
+    double source_variance = 0.0;
+    for (size_t i = 0; i < source.size(); ++i) {
+        if (weights[i] <= 0.0F) {
+            continue;
+        }
+        Eigen::Vector3d s = Eigen::Vector3d(source[i][0], source[i][1], source[i][2]) - mean_source;
+        Eigen::Vector3d t = Eigen::Vector3d(target[i][0], target[i][1], target[i][2]) - mean_target;
+        covariance += weights[i] * t * s.transpose();
+        source_variance += weights[i] * s.squaredNorm();
+    }
+    covariance /= weight_sum;
+    source_variance /= weight_sum;
+
+    Eigen::JacobiSVD<Eigen::Matrix3d> svd(covariance, Eigen::ComputeFullU | Eigen::ComputeFullV);
+    Eigen::Vector3d reflection = Eigen::Vector3d::Ones();
+    if (svd.matrixU().determinant() * svd.matrixV().determinant() < 0.0) {
+        reflection[2] = -1.0;
+    }
+
+    Eigen::Matrix3d rotation = svd.matrixU() * reflection.asDiagonal() * svd.matrixV().transpose();
+    double scale = 1.0;
+    if (with_scale && source_variance > 0.0) {
+        scale = svd.singularValues().dot(reflection) / source_variance;
+    }
+
+    result.rotation = rotation.cast<float>();
+    result.scale = static_cast<float>(scale);
+    result.translation = (mean_target - scale * rotation * mean_source).cast<float>();
+    return result;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto initial_similarity_transform(const std::vector<pmp::Point>& source,
+                                  const std::vector<pmp::Point>& target) -> SimilarityTransform
+{
+    SimilarityTransform result{};
+    if (source.empty() || target.empty()) {
+        return result;
+    }
+
+    auto centroid_and_height = [](const std::vector<pmp::Point>& points, Eigen::Vector3f& centroid) -> float {
+        Eigen::Vector3d sum = Eigen::Vector3d::Zero();
+        float min_y = FLT_MAX;
+        float max_y = -FLT_MAX;
+        for (const auto& p : points) {
+            sum += Eigen::Vector3d(p[0], p[1], p[2]);
+            min_y = std::min(min_y, p[1]);
+            max_y = std::max(max_y, p[1]);
+        }
+        centroid = (sum / static_cast<double>(points.size())).cast<float>();
+        return max_y - min_y;
+    };
+
+    Eigen::Vector3f centroid_source;
+    Eigen::Vector3f centroid_target;
+    float height_source = centroid_and_height(source, centroid_source);
+    float height_target = centroid_and_height(target, centroid_target);
+
+    // scans might come in millimeters
+    if (height_source > 0.0F && height_target > 0.0F) {
+        result.scale = height_target / height_source;
+    }
+    result.translation = centroid_target - result.scale * centroid_source;
+    return result;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto reject_correspondence_outliers(const std::vector<int>& indices,
+                                    const std::vector<float>& sqr_distances,
+                                    std::vector<float>& weights,
+                                    float mad_factor,
+                                    float min_distance) -> int
+{
+    weights.assign(indices.size(), 0.0F);
+
+    std::vector<float> distances;
+    distances.reserve(indices.size());
+    for (size_t i = 0; i < indices.size(); ++i) {
+        if (indices[i] >= 0) {
+            distances.push_back(std::sqrt(sqr_distances[i]));
+        }
+    }
+    if (distances.empty()) {
+        return 0;
+    }
+
+    // median and median absolute deviation
+    auto median = [](std::vector<float>& values) -> float {
+        auto mid = values.begin() + static_cast<long>(values.size() / 2);
+        std::nth_element(values.begin(), mid, values.end());
+        return *mid;
+    };
+    float median_distance = median(distances);
+    for (auto& d : distances) {
+        d = std::abs(d - median_distance);
+    }
+    float mad = median(distances);
+
+    // 1.4826 * MAD estimates the standard deviation for normally distributed residuals
+    float threshold = std::max(min_distance, median_distance + mad_factor * 1.4826F * mad);
+    float sqr_threshold = threshold * threshold;
+
+    int inliers = 0;
+    for (size_t i = 0; i < indices.size(); ++i) {
+        if (indices[i] >= 0 && sqr_distances[i] <= sqr_threshold) {
+            weights[i] = 1.0F;
+            inliers++;
+        }
+    }
+    return inliers;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+// =====================================================================================================================
@@ -0,0 +1,56 @@
+//======================================================================================================================
+// Copyright (c) the Authors 2024
+//
+// This work is licensed under a
+// Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+//
+// You should have received a copy of the license along with this
+// work. If not, see <http://creativecommons.org/licenses/by-nc-sa/4.0/>.
+//
+//======================================================================================================================
+
+#ifndef TAILORME_VIEWER_SCANALIGNMENT_H
+#define TAILORME_VIEWER_SCANALIGNMENT_H
+
+#include <vector>
+
+#include <Eigen/Dense>
+#include <pmp/surface_mesh.h>
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+// x -> scale * rotation * x + translation
+struct SimilarityTransform {
+    Eigen::Matrix3f rotation = Eigen::Matrix3f::Identity();
+    Eigen::Vector3f translation = Eigen::Vector3f::Zero();
+    float scale = 1.0F;
+
+    [[nodiscard]]
+    auto apply(const pmp::Point& point) const -> pmp::Point;
+    [[nodiscard]]
+    auto apply_inverse(const pmp::Point& point) const -> pmp::Point;
+};
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+// weighted least squares similarity (Umeyama) mapping source onto target, zero weights are ignored
+auto estimate_similarity_transform(const std::vector<pmp::Point>& source,
+                                   const std::vector<pmp::Point>& target,
+                                   const std::vector<float>& weights,
+                                   bool with_scale) -> SimilarityTransform;
+
+// initial guess from centroids and bounding box heights (y is up)
+auto initial_similarity_transform(const std::vector<pmp::Point>& source,
+                                  const std::vector<pmp::Point>& target) -> SimilarityTransform;
+
+// robust outlier rejection of correspondences by their distances (median + factor * MAD).
+// sets weights to 0.0 for rejected and invalid (-1) correspondences, returns number of inliers.
+auto reject_correspondence_outliers(const std::vector<int>& indices,
+                                    const std::vector<float>& sqr_distances,
+                                    std::vector<float>& weights,
+                                    float mad_factor = 3.0F,
+                                    float min_distance = 0.005F) -> int;
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+#endif // TAILORME_VIEWER_SCANALIGNMENT_H
@@ -0,0 +1,145 @@
+//======================================================================================================================
+// Copyright (c) the Authors 2024
+//
+// This work is licensed under a
+// Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+//
+// You should have received a copy of the license along with this
+// work. If not, see <http://creativecommons.org/licenses/by-nc-sa/4.0/>.
+//
+//======================================================================================================================
+
+#ifndef TAILORME_VIEWER_SIMDFLOAT_H
+#define TAILORME_VIEWER_SIMDFLOAT_H
+
+#include <cstdint>
+
+#if defined(__AVX__) || defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+// =====================================================================================================================
+
+// Minimal vector types for the batched predicates, the widest one the compiler targets is used
+// (build with USE_NATIVE_ARCH to get AVX2/AVX-512). Masks hold one lane flag each.
+// Only meant for translation units of the batched kernels (TriTriBatch, RayCast, FarthestPointSampling).
+
+#if defined(__AVX512F__)
+
+struct SimdFloat {
+    static constexpr int width = 16;
+    using type = __m512;
+    using mask = __mmask16;
+    static auto load(const float* x) -> type { return _mm512_load_ps(x); }
+    static auto store(float* x, type a) -> void { _mm512_store_ps(x, a); }
+    static auto set1(float x) -> type { return _mm512_set1_ps(x); }
+    static auto add(type a, type b) -> type { return _mm512_add_ps(a, b); }
+    static auto sub(type a, type b) -> type { return _mm512_sub_ps(a, b); }
+    static auto mul(type a, type b) -> type { return _mm512_mul_ps(a, b); }
+    static auto div(type a, type b) -> type { return _mm512_div_ps(a, b); }
+    static auto min(type a, type b) -> type { return _mm512_min_ps(a, b); }
+    static auto max(type a, type b) -> type { return _mm512_max_ps(a, b); }
+    static auto positive(type a) -> mask { return _mm512_cmp_ps_mask(a, _mm512_setzero_ps(), _CMP_GT_OQ); }
+    static auto negative(type a) -> mask { return _mm512_cmp_ps_mask(a, _mm512_setzero_ps(), _CMP_LT_OQ); }
+    // neither positive nor negative (also NaN, like the branches of the scalar test)
+    static auto zero(type a) -> mask { return _mm512_cmp_ps_mask(a, _mm512_setzero_ps(), _CMP_EQ_UQ); }
+    // ordered comparisons, false for NaN
+    static auto less(type a, type b) -> mask { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+    static auto less_equal(type a, type b) -> mask { return _mm512_cmp_ps_mask(a, b, _CMP_LE_OQ); }
+    static auto land(mask a, mask b) -> mask { return a & b; }
+    static auto lor(mask a, mask b) -> mask { return a | b; }
+    static auto landnot(mask a, mask b) -> mask { return a & static_cast<mask>(~b); }
+    static auto select(mask m, type a, type b) -> type { return _mm512_mask_blend_ps(m, b, a); }
+    static auto bits(mask m) -> uint32_t { return m; }
+};
+
+#elif defined(__AVX__)
+
+struct SimdFloat {
+    static constexpr int width = 8;
+    using type = __m256;
+    using mask = __m256;
+    static auto load(const float* x) -> type { return _mm256_load_ps(x); }
+    static auto store(float* x, type a) -> void { _mm256_store_ps(x, a); }
+    static auto set1(float x) -> type { return _mm256_set1_ps(x); }
+    static auto add(type a, type b) -> type { return _mm256_add_ps(a, b); }
+    static auto sub(type a, type b) -> type { return _mm256_sub_ps(a, b); }
+    static auto mul(type a, type b) -> type { return _mm256_mul_ps(a, b); }
+    static auto div(type a, type b) -> type { return _mm256_div_ps(a, b); }
+    static auto min(type a, type b) -> type { return _mm256_min_ps(a, b); }
+    static auto max(type a, type b) -> type { return _mm256_max_ps(a, b); }
+    static auto positive(type a) -> mask { return _mm256_cmp_ps(a, _mm256_setzero_ps(), _CMP_GT_OQ); }
+    static auto negative(type a) -> mask { return _mm256_cmp_ps(a, _mm256_setzero_ps(), _CMP_LT_OQ); }
+    static auto zero(type a) -> mask { return _mm256_cmp_ps(a, _mm256_setzero_ps(), _CMP_EQ_UQ); }
+    static auto less(type a, type b) -> mask { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    static auto less_equal(type a, type b) -> mask { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+    static auto land(mask a, mask b) -> mask { return _mm256_and_ps(a, b); }
+    static auto lor(mask a, mask b) -> mask { return _mm256_or_ps(a, b); }
+    static auto landnot(mask a, mask b) -> mask { return _mm256_andnot_ps(b, a); }
+    static auto select(mask m, type a, type b) -> type { return _mm256_blendv_ps(b, a, m); }
+    static auto bits(mask m) -> uint32_t { return _mm256_movemask_ps(m); }
+};
+
+#elif defined(__SSE2__) || defined(_M_X64)
+
+struct SimdFloat {
+    static constexpr int width = 4;
+    using type = __m128;
+    using mask = __m128;
+    static auto load(const float* x) -> type { return _mm_load_ps(x); }
+    static auto store(float* x, type a) -> void { _mm_store_ps(x, a); }
+    static auto set1(float x) -> type { return _mm_set1_ps(x); }
+    static auto add(type a, type b) -> type { return _mm_add_ps(a, b); }
+    static auto sub(type a, type b) -> type { return _mm_sub_ps(a, b); }
+    static auto mul(type a, type b) -> type { return _mm_mul_ps(a, b); }
+    static auto div(type a, type b) -> type { return _mm_div_ps(a, b); }
+    static auto min(type a, type b) -> type { return _mm_min_ps(a, b); }
+    static auto max(type a, type b) -> type { return _mm_max_ps(a, b); }
+    static auto positive(type a) -> mask { return _mm_cmpgt_ps(a, _mm_setzero_ps()); }
+    static auto negative(type a) -> mask { return _mm_cmplt_ps(a, _mm_setzero_ps()); }
+    static auto zero(type a) -> mask
+    {
+        return _mm_and_ps(_mm_cmpngt_ps(a, _mm_setzero_ps()), _mm_cmpnlt_ps(a, _mm_setzero_ps()));
+    }
+    static auto less(type a, type b) -> mask { return _mm_cmplt_ps(a, b); }
+    static auto less_equal(type a, type b) -> mask { return _mm_cmple_ps(a, b); }
+    static auto land(mask a, mask b) -> mask { return _mm_and_ps(a, b); }
+    static auto lor(mask a, mask b) -> mask { return _mm_or_ps(a, b); }
+    static auto landnot(mask a, mask b) -> mask { return _mm_andnot_ps(b, a); }
+    static auto select(mask m, type a, type b) -> type { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+    static auto bits(mask m) -> uint32_t { return _mm_movemask_ps(m); }
+};
+
+#else
+
+struct SimdFloat {
+    static constexpr int width = 1;
+    using type = float;
+    using mask = bool;
+    static auto load(const float* x) -> type { return *x; }
+    static auto store(float* x, type a) -> void { *x = a; }
+    static auto set1(float x) -> type { return x; }
+    static auto add(type a, type b) -> type { return a + b; }
+    static auto sub(type a, type b) -> type { return a - b; }
+    static auto mul(type a, type b) -> type { return a * b; }
+    static auto div(type a, type b) -> type { return a / b; }
+    // same NaN behaviour as minps / maxps (second operand)
+    static auto min(type a, type b) -> type { return a < b ? a : b; }
+    static auto max(type a, type b) -> type { return a > b ? a : b; }
+    static auto positive(type a) -> mask { return a > 0.0F; }
+    static auto negative(type a) -> mask { return a < 0.0F; }
+    static auto zero(type a) -> mask { return !(a > 0.0F) && !(a < 0.0F); }
+    static auto less(type a, type b) -> mask { return a < b; }
+    static auto less_equal(type a, type b) -> mask { return a <= b; }
+    static auto land(mask a, mask b) -> mask { return a && b; }
+    static auto lor(mask a, mask b) -> mask { return a || b; }
+    static auto landnot(mask a, mask b) -> mask { return a && !b; }
+    static auto select(mask m, type a, type b) -> type { return m ? a : b; }
+    static auto bits(mask m) -> uint32_t { return m ? 1 : 0; }
+};
+
+#endif
+
+// =====================================================================================================================
+
+#endif // TAILORME_VIEWER_SIMDFLOAT_H
@@ -0,0 +1,269 @@
+//======================================================================================================================
+// Copyright (c) the Authors 2024
+//
+// This work is licensed under a
+// Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+//
+// You should have received a copy of the license along with this
+// work. If not, see <http://creativecommons.org/licenses/by-nc-sa/4.0/>.
+//
+//======================================================================================================================
+
+#include "TriTriBatch.h"
+#include "algorithms/SimdFloat.h"
+#include "algorithms/TriTriIntersect.h"
+
+#include <algorithm>
+#include <cassert>
+
+// =====================================================================================================================
+
+using S = SimdFloat;
+using Vec = S::type;
+using Mask = S::mask;
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+static inline auto sub(const Vec a[3], const Vec b[3], Vec out[3]) -> void
+{
+    for (int c = 0; c < 3; ++c) {
+        out[c] = S::sub(a[c], b[c]);
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+static inline auto cross(const Vec a[3], const Vec b[3], Vec out[3]) -> void
+{
+    out[0] = S::sub(S::mul(a[1], b[2]), S::mul(a[2], b[1]));
+    out[1] = S::sub(S::mul(a[2], b[0]), S::mul(a[0], b[2]));
+    out[2] = S::sub(S::mul(a[0], b[1]), S::mul(a[1], b[0]));
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+// dot(a - b, n), same evaluation order as the scalar test
+static inline auto dot_diff(const Vec a[3], const Vec b[3], const Vec n[3]) -> Vec
+{
+    Vec d = S::mul(S::sub(a[0], b[0]), n[0]);
+    d = S::add(d, S::mul(S::sub(a[1], b[1]), n[1]));
+    return S::add(d, S::mul(S::sub(a[2], b[2]), n[2]));
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+// dot(a - b, (c - b) x (e - b))
+static inline auto orientation(const Vec a[3], const Vec b[3], const Vec c[3], const Vec e[3]) -> Vec
+{
+    Vec u[3], v[3], n[3];
+    sub(c, b, u);
+    sub(e, b, v);
+    cross(u, v, n);
+    return dot_diff(a, b, n);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+// Canonical form of a triangle from the signed distances of its vertices to the other plane (Guigue-Devillers):
+// the vertices are rotated (rot1: q r p, rot2: r p q) so that p is alone on its side, swap is set if the other
+// triangle has to be flipped. The branches of the scalar test as lane masks.
+static inline auto canonical_form(Vec dp, Vec dq, Vec dr, Mask& rot1, Mask& rot2, Mask& swap, Mask& coplanar) -> void
+{
+    Mask pp = S::positive(dp), np = S::negative(dp), zp = S::zero(dp);
+    Mask pq = S::positive(dq), nq = S::negative(dq), zq = S::zero(dq);
+    Mask pr = S::positive(dr), nr = S::negative(dr), zr = S::zero(dr);
+
+    rot2 = S::lor(S::lor(S::land(pp, pq), S::land(np, nq)), S::land(zp, zq));
+    rot1 = S::lor(S::lor(S::land(S::landnot(pp, pq), pr), S::land(S::landnot(np, nq), nr)),
+                  S::land(zp, S::lor(S::landnot(nq, nr), S::landnot(pq, pr))));
+    swap = S::lor(S::lor(S::land(pp, S::lor(pq, pr)), S::landnot(S::landnot(np, nq), nr)),
+                  S::land(zp, S::lor(S::lor(S::land(zq, nr), S::landnot(nq, nr)), S::land(pq, pr))));
+    coplanar = S::land(S::land(zp, zq), zr);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+static inline auto rotate(Vec p[3], Vec q[3], Vec r[3], Mask rot1, Mask rot2) -> void
+{
+    for (int c = 0; c < 3; ++c) {
+        Vec a = S::select(rot2, r[c], S::select(rot1, q[c], p[c]));
+        Vec b = S::select(rot2, p[c], S::select(rot1, r[c], q[c]));
+        Vec e = S::select(rot2, q[c], S::select(rot1, p[c], r[c]));
+        p[c] = a;
+        q[c] = b;
+        r[c] = e;
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+static inline auto swap_if(Vec a[3], Vec b[3], Mask m) -> void
+{
+    for (int c = 0; c < 3; ++c) {
+        Vec t = S::select(m, b[c], a[c]);
+        b[c] = S::select(m, a[c], b[c]);
+        a[c] = t;
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+// Intersection test of S::width triangle pairs (the decision of igl::tri_tri_intersection_test_3d).
+// Lanes not in active are ignored, coplanar pairs are not decided here but reported in out_coplanar.
+static auto intersect_block(Vec p1[3], Vec q1[3], Vec r1[3], Vec p2[3], Vec q2[3], Vec r2[3],
+                            uint32_t active, uint32_t& out_coplanar) -> uint32_t
+{
+    out_coplanar = 0;
+
+    // triangle 1 against the plane of triangle 2
+    Vec e1[3], e2[3], n1[3], n2[3];
+    sub(p2, r2, e1);
+    sub(q2, r2, e2);
+    cross(e1, e2, n2);
+    Vec dp1 = dot_diff(p1, r2, n2);
+    Vec dq1 = dot_diff(q1, r2, n2);
+    Vec dr1 = dot_diff(r1, r2, n2);
+    uint32_t separated = S::bits(S::positive(S::mul(dp1, dq1))) & S::bits(S::positive(S::mul(dp1, dr1)));
+    active &= ~separated;
+    if (active == 0) {
+        return 0;
+    }
+
+    // triangle 2 against the plane of triangle 1
+    sub(q1, p1, e1);
+    sub(r1, p1, e2);
+    cross(e1, e2, n1);
+    Vec dp2 = dot_diff(p2, r1, n1);
+    Vec dq2 = dot_diff(q2, r1, n1);
+    Vec dr2 = dot_diff(r2, r1, n1);
+    separated = S::bits(S::positive(S::mul(dp2, dq2))) & S::bits(S::positive(S::mul(dp2, dr2)));
+    active &= ~separated;
+    if (active == 0) {
+        return 0;
+    }
+
+    // permute both triangles into canonical form
+    Mask rot1, rot2, swap, coplanar1, coplanar2;
+    canonical_form(dp1, dq1, dr1, rot1, rot2, swap, coplanar1);
+    rotate(p1, q1, r1, rot1, rot2);
+    swap_if(q2, r2, swap);
+    Vec dq2_swapped = S::select(swap, dr2, dq2);
+    Vec dr2_swapped = S::select(swap, dq2, dr2);
+
+    canonical_form(dp2, dq2_swapped, dr2_swapped, rot1, rot2, swap, coplanar2);
+    rotate(p2, q2, r2, rot1, rot2);
+    swap_if(q1, r1, swap);
+
+    uint32_t coplanar = S::bits(S::lor(coplanar1, coplanar2)) & active;
+    out_coplanar = coplanar;
+    active &= ~coplanar;
+
+    // the two orientation tests that decide the intersection (see _IGL_CONSTRUCT_INTERSECTION)
+    uint32_t a = S::bits(S::positive(orientation(p2, p1, q1, r2)));
+    uint32_t b = S::bits(S::positive(orientation(p2, p1, r1, r2)));
+    uint32_t c = S::bits(S::negative(orientation(p2, p1, q1, q2)));
+
+    return active & ((a & ~b) | (~a & ~c));
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+// Scalar test for the coplanar pairs, and for the segments if requested
+static auto finish_scalar(const float t1[3][3], const float t2[3][3], TriTriSegment* segment) -> bool
+{
+    using PointT = Eigen::RowVector3f;
+    const PointT p1{t1[0][0], t1[0][1], t1[0][2]};
+    const PointT q1{t1[1][0], t1[1][1], t1[1][2]};
+    const PointT r1{t1[2][0], t1[2][1], t1[2][2]};
+    const PointT p2{t2[0][0], t2[0][1], t2[0][2]};
+    const PointT q2{t2[1][0], t2[1][1], t2[1][2]};
+    const PointT r2{t2[2][0], t2[2][1], t2[2][2]};
+    TriTriSegment unused;
+    TriTriSegment& out = segment ? *segment : unused;
+    return igl::tri_tri_intersection_test_3d(p1, q1, r1, p2, q2, r2, out.coplanar, out.source, out.target);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+// lane i of the batch as [vertex][coordinate]
+static auto triangle(const TriangleBatch& batch, int i, float out[3][3]) -> void
+{
+    for (int k = 0; k < 3; ++k) {
+        for (int c = 0; c < 3; ++c) {
+            out[k][c] = batch.v[k][c][i];
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+// first == nullptr: triangle t1 against every triangle of second, otherwise lane by lane
+static auto intersect(const float t1[3][3], const TriangleBatch* first, const TriangleBatch& second,
+                      TriTriSegment* segments) -> uint32_t
+{
+    uint32_t hits = 0;
+    uint32_t coplanar = 0;
+    for (int i = 0; i < second.size; i += S::width) {
+        Vec p1[3], q1[3], r1[3], p2[3], q2[3], r2[3];
+        for (int c = 0; c < 3; ++c) {
+            if (first) {
+                p1[c] = S::load(&first->v[0][c][i]);
+                q1[c] = S::load(&first->v[1][c][i]);
+                r1[c] = S::load(&first->v[2][c][i]);
+            } else {
+                p1[c] = S::set1(t1[0][c]);
+                q1[c] = S::set1(t1[1][c]);
+                r1[c] = S::set1(t1[2][c]);
+            }
+            p2[c] = S::load(&second.v[0][c][i]);
+            q2[c] = S::load(&second.v[1][c][i]);
+            r2[c] = S::load(&second.v[2][c][i]);
+        }
+
+        int lanes = std::min(S::width, second.size - i);
+        uint32_t active = (1U << lanes) - 1;
+        uint32_t block_coplanar = 0;
+        hits |= intersect_block(p1, q1, r1, p2, q2, r2, active, block_coplanar) << i;
+        coplanar |= block_coplanar << i;
+    }
+
+    // coplanar pairs (rare) and segments go through the scalar test
+    uint32_t scalar = segments ? (hits | coplanar) : coplanar;
+    for (int i = 0; scalar != 0 && i < second.size; ++i) {
+        if (!(scalar & (1U << i))) {
+            continue;
+        }
+        float a[3][3], b[3][3];
+        if (first) {
+            triangle(*first, i, a);
+        }
+        triangle(second, i, b);
+        bool hit = finish_scalar(first ? a : t1, b, segments ? &segments[i] : nullptr);
+        if (coplanar & (1U << i)) {
+            hits |= hit ? (1U << i) : 0U;
+        }
+    }
+    return hits;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto tri_tri_intersect_batch(const pmp::Point& p, const pmp::Point& q, const pmp::Point& r,
+                             const TriangleBatch& batch, TriTriSegment* segments) -> uint32_t
+{
+    const float t1[3][3] = {{p[0], p[1], p[2]}, {q[0], q[1], q[2]}, {r[0], r[1], r[2]}};
+    return intersect(t1, nullptr, batch, segments);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto tri_tri_intersect_pairs(const TriangleBatch& first, const TriangleBatch& second, TriTriSegment* segments)
+-> uint32_t
+{
+    assert(first.size == second.size);
+    return intersect(nullptr, &first, second, segments);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+// =====================================================================================================================
@@ -0,0 +1,69 @@
+//======================================================================================================================
+// Copyright (c) the Authors 2024
+//
+// This work is licensed under a
+// Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+//
+// You should have received a copy of the license along with this
+// work. If not, see <http://creativecommons.org/licenses/by-nc-sa/4.0/>.
+//
+//======================================================================================================================
+
+#ifndef TAILORME_VIEWER_TRITRIBATCH_H
+#define TAILORME_VIEWER_TRITRIBATCH_H
+
+#include <cstdint>
+
+#include <Eigen/Core>
+#include <pmp/surface_mesh.h>
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+// Up to 16 triangles in structure of arrays layout, tested against one triangle at once.
+struct TriangleBatch {
+    static constexpr int capacity = 16;
+
+    // coordinate c of vertex k (p, q, r) of triangle i is v[k][c][i]
+    alignas(64) float v[3][3][capacity]{};
+    int size = 0;
+
+    auto clear() -> void { size = 0; }
+
+    [[nodiscard]]
+    auto full() const -> bool { return size == capacity; }
+
+    auto push_back(const pmp::Point& p, const pmp::Point& q, const pmp::Point& r) -> void
+    {
+        for (int c = 0; c < 3; ++c) {
+            v[0][c][size] = p[c];
+            v[1][c][size] = q[c];
+            v[2][c][size] = r[c];
+        }
+        size++;
+    }
+};
+
+// Segment of intersection as computed by igl::tri_tri_intersection_test_3d
+struct TriTriSegment {
+    Eigen::RowVector3f source{};
+    Eigen::RowVector3f target{};
+    bool coplanar = false;
+};
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+// Batched versions of igl::tri_tri_intersection_test_3d (same predicates and decisions, Guigue-Devillers).
+// The orientation predicates and early-outs run in AVX-512, AVX2 or SSE registers, whatever the build targets,
+// with a scalar fallback. Coplanar pairs, and the segments if requested (one per lane), use the scalar test.
+
+// Tests triangle (p, q, r) against all triangles of the batch, bit i of the result is set if triangle i intersects.
+auto tri_tri_intersect_batch(const pmp::Point& p, const pmp::Point& q, const pmp::Point& r,
+                             const TriangleBatch& batch, TriTriSegment* segments = nullptr) -> uint32_t;
+
+// Tests triangle i of first against triangle i of second (same size), bit i of the result is set if they intersect.
+auto tri_tri_intersect_pairs(const TriangleBatch& first, const TriangleBatch& second,
+                             TriTriSegment* segments = nullptr) -> uint32_t;
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+#endif // TAILORME_VIEWER_TRITRIBATCH_H
@@ -0,0 +1,605 @@
+//======================================================================================================================
+// Copyright (c) the Authors 2024
+//
+// This work is licensed under a
+// Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+//
+// You should have received a copy of the license along with this
+// work. If not, see <http://creativecommons.org/licenses/by-nc-sa/4.0/>.
+//
+//======================================================================================================================
+
+#include "TriangleBVH.h"
+
+#include <algorithm>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// =====================================================================================================================
+
+// leaves with at most this many faces are never split
+#define BVH_MIN_LEAF_SIZE 2
+// leaves with more faces are always split
+#define BVH_MAX_LEAF_SIZE 8
+#define BVH_SAH_BINS 16
+// ranges larger than this are built in a separate task
+#define BVH_TASK_SIZE 4096
+// node pairs per thread before the parallel traversal starts
+#define BVH_FRONT_PER_THREAD 64
+
+// =====================================================================================================================
+
+auto closest_point_on_triangle(const pmp::dvec3& p, const pmp::dvec3& a, const pmp::dvec3& b, const pmp::dvec3& c,
+                               TriangleRegion& region) -> pmp::dvec3
+{
+    pmp::dvec3 ab = b - a;
+    pmp::dvec3 ac = c - a;
+    pmp::dvec3 ap = p - a;
+    double d1 = pmp::dot(ab, ap);
+    double d2 = pmp::dot(ac, ap);
+    if (d1 <= 0.0 && d2 <= 0.0) {
+        region = REGION_VERTEX_A;
+        return a;
+    }
+
+    pmp::dvec3 bp = p - b;
+    double d3 = pmp::dot(ab, bp);
+    double d4 = pmp::dot(ac, bp);
+    if (d3 >= 0.0 && d4 <= d3) {
+        region = REGION_VERTEX_B;
+        return b;
+    }
+
+    double vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0 && d1 >= 0.0 && d3 <= 0.0) {
+        region = REGION_EDGE_AB;
+        return a + (d1 / (d1 - d3)) * ab;
+    }
+
+    pmp::dvec3 cp = p - c;
+    double d5 = pmp::dot(ab, cp);
+    double d6 = pmp::dot(ac, cp);
+    if (d6 >= 0.0 && d5 <= d6) {
+        region = REGION_VERTEX_C;
+        return c;
+    }
+
+    double vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0 && d2 >= 0.0 && d6 <= 0.0) {
+        region = REGION_EDGE_CA;
+        return a + (d2 / (d2 - d6)) * ac;
+    }
+
+    double va = d3 * d6 - d5 * d4;
+    if (va <= 0.0 && (d4 - d3) >= 0.0 && (d5 - d6) >= 0.0) {
+        region = REGION_EDGE_BC;
+        return b + ((d4 - d3) / ((d4 - d3) + (d5 - d6))) * (c - b);
+    }
+
+    double denominator = 1.0 / (va + vb + vc);
+    region = REGION_FACE;
+    return a + (vb * denominator) * ab + (vc * denominator) * ac;
+}
+
+// =====================================================================================================================
+
+auto TriangleBVH::build(const pmp::SurfaceMesh& mesh, const std::vector<bool>& ignored_faces) -> void
+{
+    build_swept(mesh, {}, ignored_faces);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto TriangleBVH::build_swept(const pmp::SurfaceMesh& mesh, const std::vector<pmp::Point>& previous,
+                              const std::vector<bool>& ignored_faces) -> void
+{
+    if (!mesh.is_triangle_mesh()) {
+        throw std::runtime_error("Bounding volume hierarchy is only implemented for triangle meshes.");
+    }
+
+    _face_vertices.assign(mesh.faces_size(), {0, 0, 0});
+    _faces.clear();
+    _faces.reserve(mesh.n_faces());
+    for (auto f : mesh.faces()) {
+        int i = 0;
+        for (auto v : mesh.vertices(f)) {
+            _face_vertices[f.idx()][i++] = static_cast<int>(v.idx());
+        }
+        if (ignored_faces.empty() || !ignored_faces[f.idx()]) {
+            _faces.push_back(static_cast<int>(f.idx()));
+        }
+    }
+
+    _update_face_boxes(mesh.get_vertex_property<pmp::Point>("v:point").vector(),
+                       previous.empty() ? nullptr : &previous);
+
+    _nodes.clear();
+    if (_faces.empty()) {
+        return;
+    }
+
+    std::vector<pmp::Point> centroids(_face_vertices.size());
+    for (int f : _faces) {
+        centroids[f] = 0.5F * (_face_boxes[f].min + _face_boxes[f].max);
+    }
+
+    // a binary tree with n leaves has at most 2n - 1 nodes
+    _nodes.resize(2 * _faces.size() - 1);
+    std::atomic<int> node_count{1};
+
+    #pragma omp parallel
+    #pragma omp single nowait
+    _build(0, 0, static_cast<int>(_faces.size()), centroids, node_count);
+
+    _nodes.resize(node_count);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto TriangleBVH::_build(int node, int first, int count, const std::vector<pmp::Point>& centroids,
+                         std::atomic<int>& node_count) -> void
+{
+    AABB box;
+    AABB centroid_box;
+    for (int i = first; i < first + count; ++i) {
+        box.extend(_face_boxes[_faces[i]]);
+        centroid_box.extend(centroids[_faces[i]]);
+    }
+    _nodes[node].box = box;
+    _nodes[node].first = first;
+    _nodes[node].count = count;
+
+    if (count <= BVH_MIN_LEAF_SIZE) {
+        return;
+    }
+
+    // split along largest centroid extent
+    pmp::Point extent = centroid_box.max - centroid_box.min;
+    int axis = 0;
+    if (extent[1] > extent[axis]) axis = 1;
+    if (extent[2] > extent[axis]) axis = 2;
+
+    int mid = first + count / 2;
+    if (extent[axis] > 0.0F) {
+        // binned surface area heuristic
+        struct Bin {
+            AABB box{};
+            int count = 0;
+        };
+        std::array<Bin, BVH_SAH_BINS> bins{};
+        float scale = BVH_SAH_BINS / extent[axis];
+        auto bin_index = [&](int face) {
+            int b = static_cast<int>((centroids[face][axis] - centroid_box.min[axis]) * scale);
+            return std::min(b, BVH_SAH_BINS - 1);
+        };
+        for (int i = first; i < first + count; ++i) {
+            Bin& bin = bins[bin_index(_faces[i])];
+            bin.box.extend(_face_boxes[_faces[i]]);
+            bin.count++;
+        }
+
+        // sweep from the right, then evaluate split costs from the left
+        std::array<float, BVH_SAH_BINS> right_cost{};
+        AABB right_box;
+        int right_count = 0;
+        for (int b = BVH_SAH_BINS - 1; b > 0; --b) {
+            right_box.extend(bins[b].box);
+            right_count += bins[b].count;
+            right_cost[b] = right_count > 0 ? right_box.half_area() * static_cast<float>(right_count) : 0.0F;
+        }
+
+        float best_cost = FLT_MAX;
+        int best_split = -1;
+        AABB left_box;
+        int left_count = 0;
+        for (int b = 0; b < BVH_SAH_BINS - 1; ++b) {
+            left_box.extend(bins[b].box);
+            left_count += bins[b].count;
+            if (left_count == 0 || left_count == count) {
+                continue;
+            }
+            float cost = left_box.half_area() * static_cast<float>(left_count) + right_cost[b + 1];
+            if (cost < best_cost) {
+                best_cost = cost;
+                best_split = b;
+            }
+        }
+
+        // keep small leaves if splitting does not pay off
+        if (count <= BVH_MAX_LEAF_SIZE && best_cost >= box.half_area() * static_cast<float>(count)) {
+            return;
+        }
+
+        if (best_split >= 0) {
+            auto it = std::partition(_faces.begin() + first, _faces.begin() + first + count,
+                                     [&](int face) { return bin_index(face) <= best_split; });
+            mid = static_cast<int>(it - _faces.begin());
+        }
+    }
+
+    // degenerate distribution, split at the median
+    if (mid == first || mid == first + count) {
+        mid = first + count / 2;
+        std::nth_element(_faces.begin() + first, _faces.begin() + mid, _faces.begin() + first + count,
+                         [&](int a, int b) { return centroids[a][axis] < centroids[b][axis]; });
+    }
+
+    int left = node_count.fetch_add(2);
+    _nodes[node].first = left;
+    _nodes[node].count = 0;
+
+    if (count > BVH_TASK_SIZE) {
+        #pragma omp task default(none) firstprivate(left, first, mid) shared(centroids, node_count)
+        _build(left, first, mid - first, centroids, node_count);
+        #pragma omp task default(none) firstprivate(left, first, mid, count) shared(centroids, node_count)
+        _build(left + 1, mid, first + count - mid, centroids, node_count);
+        #pragma omp taskwait
+    } else {
+        _build(left, first, mid - first, centroids, node_count);
+        _build(left + 1, mid, first + count - mid, centroids, node_count);
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto TriangleBVH::_update_face_boxes(const std::vector<pmp::Point>& positions,
+                                     const std::vector<pmp::Point>* previous) -> void
+{
+    _face_boxes.resize(_face_vertices.size());
+
+    #pragma omp parallel for schedule(static)
+    for (size_t f = 0; f < _face_vertices.size(); ++f) {
+        AABB box;
+        for (int v : _face_vertices[f]) {
+            box.extend(positions[v]);
+            if (previous) {
+                box.extend((*previous)[v]);
+            }
+        }
+        _face_boxes[f] = box;
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto TriangleBVH::refit(const pmp::SurfaceMesh& mesh) -> void
+{
+    _update_face_boxes(mesh.get_vertex_property<pmp::Point>("v:point").vector());
+    _refit_nodes();
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto TriangleBVH::refit_swept(const pmp::SurfaceMesh& mesh, const std::vector<pmp::Point>& previous) -> void
+{
+    _update_face_boxes(mesh.get_vertex_property<pmp::Point>("v:point").vector(), &previous);
+    _refit_nodes();
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto TriangleBVH::_refit_nodes() -> void
+{
+    // leaves in parallel, inner nodes bottom up (children always follow their parent)
+    #pragma omp parallel for schedule(static)
+    for (size_t n = 0; n < _nodes.size(); ++n) {
+        Node& node = _nodes[n];
+        if (node.count > 0) {
+            AABB box;
+            for (int i = node.first; i < node.first + node.count; ++i) {
+                box.extend(_face_boxes[_faces[i]]);
+            }
+            node.box = box;
+        }
+    }
+
+    for (size_t n = _nodes.size(); n-- > 0;) {
+        Node& node = _nodes[n];
+        if (node.count == 0) {
+            node.box = _nodes[node.first].box;
+            node.box.extend(_nodes[node.first + 1].box);
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto TriangleBVH::matches(const pmp::SurfaceMesh& mesh) const -> bool
+{
+    if (_face_vertices.size() != mesh.faces_size()) {
+        return false;
+    }
+    for (auto f : mesh.faces()) {
+        auto h = mesh.halfedge(f);
+        if (static_cast<int>(mesh.to_vertex(h).idx()) != _face_vertices[f.idx()][0]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+// descend into the node with more faces (or the only inner one)
+static auto descend_a(const TriangleBVH::Node& a, const TriangleBVH::Node& b) -> bool
+{
+    if (b.count > 0) {
+        return true;
+    }
+    if (a.count > 0) {
+        return false;
+    }
+    return a.box.half_area() > b.box.half_area();
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto TriangleBVH::overlapping_faces(const TriangleBVH& other) const -> std::vector<std::pair<int, int>>
+{
+    std::vector<std::pair<int, int>> result;
+    if (empty() || other.empty()) {
+        return result;
+    }
+
+    // expand the root pair breadth first until every thread has enough independent work
+    int threads = 1;
+#ifdef _OPENMP
+    threads = omp_get_max_threads();
+#endif
+    std::vector<std::pair<int, int>> front{{0, 0}};
+    std::vector<std::pair<int, int>> next;
+    while (front.size() < static_cast<size_t>(threads * BVH_FRONT_PER_THREAD)) {
+        bool expanded = false;
+        next.clear();
+        for (const auto& [a, b] : front) {
+            const Node& node_a = _nodes[a];
+            const Node& node_b = other._nodes[b];
+            if (!node_a.box.overlaps(node_b.box)) {
+                continue;
+            }
+            if (node_a.count > 0 && node_b.count > 0) {
+                next.emplace_back(a, b);
+            } else if (descend_a(node_a, node_b)) {
+                next.emplace_back(node_a.first, b);
+                next.emplace_back(node_a.first + 1, b);
+                expanded = true;
+            } else {
+                next.emplace_back(a, node_b.first);
+                next.emplace_back(a, node_b.first + 1);
+                expanded = true;
+            }
+        }
+        std::swap(front, next);
+        if (!expanded) {
+            break;
+        }
+    }
+
+    #pragma omp parallel
+    {
+        std::vector<std::pair<int, int>> local;
+        std::vector<std::pair<int, int>> stack;
+
+        #pragma omp for schedule(dynamic, 1) nowait
+        for (size_t i = 0; i < front.size(); ++i) {
+            stack.push_back(front[i]);
+            while (!stack.empty()) {
+                auto [a, b] = stack.back();
+                stack.pop_back();
+
+                const Node& node_a = _nodes[a];
+                const Node& node_b = other._nodes[b];
+                if (!node_a.box.overlaps(node_b.box)) {
+                    continue;
+                }
+
+                if (node_a.count > 0 && node_b.count > 0) {
+                    for (int fa = node_a.first; fa < node_a.first + node_a.count; ++fa) {
+                        const AABB& box_a = _face_boxes[_faces[fa]];
+                        for (int fb = node_b.first; fb < node_b.first + node_b.count; ++fb) {
+                            if (box_a.overlaps(other._face_boxes[other._faces[fb]])) {
+                                local.emplace_back(_faces[fa], other._faces[fb]);
+                            }
+                        }
+                    }
+                } else if (descend_a(node_a, node_b)) {
+                    stack.emplace_back(node_a.first, b);
+                    stack.emplace_back(node_a.first + 1, b);
+                } else {
+                    stack.emplace_back(a, node_b.first);
+                    stack.emplace_back(a, node_b.first + 1);
+                }
+            }
+        }
+
+        #pragma omp critical
+        result.insert(result.end(), local.begin(), local.end());
+    }
+
+    return result;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto TriangleBVH::self_overlapping_faces() const -> std::vector<std::pair<int, int>>
+{
+    std::vector<std::pair<int, int>> result;
+    if (empty()) {
+        return result;
+    }
+
+    // child pairs of a node pair, false for two leaves. a node paired with itself gives its children paired with
+    // themselves and with each other
+    auto expand = [this](int a, int b, std::vector<std::pair<int, int>>& pairs) -> bool {
+        const Node& node_a = _nodes[a];
+        const Node& node_b = _nodes[b];
+        if (a == b) {
+            if (node_a.count > 0) {
+                return false;
+            }
+            pairs.emplace_back(node_a.first, node_a.first);
+            pairs.emplace_back(node_a.first + 1, node_a.first + 1);
+            pairs.emplace_back(node_a.first, node_a.first + 1);
+        } else if (node_a.count > 0 && node_b.count > 0) {
+            return false;
+        } else if (descend_a(node_a, node_b)) {
+            pairs.emplace_back(node_a.first, b);
+            pairs.emplace_back(node_a.first + 1, b);
+        } else {
+            pairs.emplace_back(a, node_b.first);
+            pairs.emplace_back(a, node_b.first + 1);
+        }
+        return true;
+    };
+
+    auto overlaps = [this](int a, int b) { return a == b || _nodes[a].box.overlaps(_nodes[b].box); };
+
+    // faces of two leaves (or of one leaf) with overlapping boxes and without a common vertex
+    auto leaf_pairs = [this](int a, int b, std::vector<std::pair<int, int>>& pairs) {
+        const Node& node_a = _nodes[a];
+        const Node& node_b = _nodes[b];
+        for (int i = node_a.first; i < node_a.first + node_a.count; ++i) {
+            int fa = _faces[i];
+            const std::array<int, 3>& va = _face_vertices[fa];
+            for (int j = a == b ? i + 1 : node_b.first; j < node_b.first + node_b.count; ++j) {
+                int fb = _faces[j];
+                if (!_face_boxes[fa].overlaps(_face_boxes[fb])) {
+                    continue;
+                }
+                const std::array<int, 3>& vb = _face_vertices[fb];
+                bool adjacent = false;
+                for (int k = 0; k < 3 && !adjacent; ++k) {
+                    adjacent = va[k] == vb[0] || va[k] == vb[1] || va[k] == vb[2];
+                }
+                if (!adjacent) {
+                    pairs.emplace_back(std::min(fa, fb), std::max(fa, fb));
+                }
+            }
+        }
+    };
+
+    // same parallelization as overlapping_faces
+    int threads = 1;
+#ifdef _OPENMP
+    threads = omp_get_max_threads();
+#endif
+    std::vector<std::pair<int, int>> front{{0, 0}};
+    std::vector<std::pair<int, int>> next;
+    while (front.size() < static_cast<size_t>(threads * BVH_FRONT_PER_THREAD)) {
+        bool expanded = false;
+        next.clear();
+        for (const auto& [a, b] : front) {
+            if (!overlaps(a, b)) {
+                continue;
+            }
+            if (expand(a, b, next)) {
+                expanded = true;
+            } else {
+                next.emplace_back(a, b);
+            }
+        }
+        std::swap(front, next);
+        if (!expanded) {
+            break;
+        }
+    }
+
+    #pragma omp parallel
+    {
+        std::vector<std::pair<int, int>> local;
+        std::vector<std::pair<int, int>> stack;
+
+        #pragma omp for schedule(dynamic, 1) nowait
+        for (size_t i = 0; i < front.size(); ++i) {
+            stack.push_back(front[i]);
+            while (!stack.empty()) {
+                auto [a, b] = stack.back();
+                stack.pop_back();
+
+                if (overlaps(a, b) && !expand(a, b, stack)) {
+                    leaf_pairs(a, b, local);
+                }
+            }
+        }
+
+        #pragma omp critical
+        result.insert(result.end(), local.begin(), local.end());
+    }
+
+    return result;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto TriangleBVH::closest_point(const std::vector<pmp::Point>& positions, const pmp::Point& p, pmp::dvec3& closest,
+                                TriangleRegion& region, float max_distance, int hint) const -> int
+{
+    int best_face = -1;
+    double best = static_cast<double>(max_distance) * max_distance;
+    if (empty()) {
+        return best_face;
+    }
+
+    pmp::dvec3 query(p);
+
+    // the hint bounds the search before the traversal starts
+    if (hint >= 0) {
+        const auto& fv = _face_vertices[hint];
+        TriangleRegion hint_region;
+        pmp::dvec3 c = closest_point_on_triangle(query, pmp::dvec3(positions[fv[0]]), pmp::dvec3(positions[fv[1]]),
+                                                 pmp::dvec3(positions[fv[2]]), hint_region);
+        double d = pmp::sqrnorm(query - c);
+        if (d < best) {
+            best = d;
+            best_face = hint;
+            closest = c;
+            region = hint_region;
+        }
+    }
+
+    // reused by all queries of a thread
+    thread_local std::vector<int> stack;
+    stack.assign(1, 0);
+    while (!stack.empty()) {
+        const Node& node = _nodes[stack.back()];
+        stack.pop_back();
+        if (node.box.sqr_distance(p) >= best) {
+            continue;
+        }
+
+        if (node.count > 0) {
+            for (int i = node.first; i < node.first + node.count; ++i) {
+                int f = _faces[i];
+                const auto& fv = _face_vertices[f];
+                TriangleRegion face_region;
+                pmp::dvec3 c = closest_point_on_triangle(query, pmp::dvec3(positions[fv[0]]),
+                                                         pmp::dvec3(positions[fv[1]]), pmp::dvec3(positions[fv[2]]),
+                                                         face_region);
+                double d = pmp::sqrnorm(query - c);
+                if (d < best) {
+                    best = d;
+                    best_face = f;
+                    closest = c;
+                    region = face_region;
+                }
+            }
+        } else {
+            // nearer child on top of the stack
+            int near = node.first;
+            int far = node.first + 1;
+            if (_nodes[far].box.sqr_distance(p) < _nodes[near].box.sqr_distance(p)) {
+                std::swap(near, far);
+            }
+            stack.push_back(far);
+            stack.push_back(near);
+        }
+    }
+
+    return best_face;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+// =====================================================================================================================
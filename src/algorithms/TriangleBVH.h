@@ -0,0 +1,160 @@
+//======================================================================================================================
+// Copyright (c) the Authors 2024
+//
+// This work is licensed under a
+// Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+//
+// You should have received a copy of the license along with this
+// work. If not, see <http://creativecommons.org/licenses/by-nc-sa/4.0/>.
+//
+//======================================================================================================================
+
+#ifndef TAILORME_VIEWER_TRIANGLEBVH_H
+#define TAILORME_VIEWER_TRIANGLEBVH_H
+
+#include <array>
+#include <atomic>
+#include <cfloat>
+#include <utility>
+#include <vector>
+
+#include <pmp/surface_mesh.h>
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+struct AABB {
+    pmp::Point min = pmp::Point(FLT_MAX, FLT_MAX, FLT_MAX);
+    pmp::Point max = pmp::Point(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+
+    auto extend(const pmp::Point& p) -> void
+    {
+        min = pmp::min(min, p);
+        max = pmp::max(max, p);
+    }
+
+    auto extend(const AABB& box) -> void
+    {
+        min = pmp::min(min, box.min);
+        max = pmp::max(max, box.max);
+    }
+
+    [[nodiscard]]
+    auto overlaps(const AABB& box) const -> bool
+    {
+        return min[0] <= box.max[0] && box.min[0] <= max[0]
+               && min[1] <= box.max[1] && box.min[1] <= max[1]
+               && min[2] <= box.max[2] && box.min[2] <= max[2];
+    }
+
+    // squared distance of p to the box (0 inside)
+    [[nodiscard]]
+    auto sqr_distance(const pmp::Point& p) const -> float
+    {
+        pmp::Point d = pmp::max(pmp::max(min - p, p - max), pmp::Point(0.0F, 0.0F, 0.0F));
+        return pmp::sqrnorm(d);
+    }
+
+    // half surface area (SAH cost)
+    [[nodiscard]]
+    auto half_area() const -> float
+    {
+        pmp::Point extent = max - min;
+        return extent[0] * extent[1] + extent[1] * extent[2] + extent[2] * extent[0];
+    }
+};
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+// Closest feature of a triangle (a, b, c), edges are named by their first vertex
+enum TriangleRegion {
+    REGION_FACE,
+    REGION_VERTEX_A,
+    REGION_VERTEX_B,
+    REGION_VERTEX_C,
+    REGION_EDGE_AB,
+    REGION_EDGE_BC,
+    REGION_EDGE_CA,
+};
+
+// Closest point on the triangle (a, b, c) to p and its feature (Ericson, Real-Time Collision Detection 5.1.5)
+auto closest_point_on_triangle(const pmp::dvec3& p, const pmp::dvec3& a, const pmp::dvec3& b, const pmp::dvec3& c,
+                               TriangleRegion& region) -> pmp::dvec3;
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+// Bounding volume hierarchy over the faces of a triangle mesh (AABBs, binned SAH build).
+// The tree is built once per topology, when only vertices move it is refitted in place.
+// Faces can be excluded at build time (e.g. vertices marked v:intersection_ignore), they are never reported.
+class TriangleBVH {
+  public:
+    struct Node {
+        AABB box{};
+        // first face (leaf) or first of the two children (inner node)
+        int first = 0;
+        // number of faces, 0 for inner nodes
+        int count = 0;
+    };
+
+  protected:
+    // flat node array, children are stored after their parent (refit runs backwards)
+    std::vector<Node> _nodes{};
+    // faces in tree order, leaves reference ranges of this array
+    std::vector<int> _faces{};
+    // vertex indices and bounding box per face (indexed by face index)
+    std::vector<std::array<int, 3>> _face_vertices{};
+    std::vector<AABB> _face_boxes{};
+
+    // previous: optional second set of positions, the boxes then enclose the linear motion between both
+    auto _update_face_boxes(const std::vector<pmp::Point>& positions,
+                            const std::vector<pmp::Point>* previous = nullptr) -> void;
+    auto _refit_nodes() -> void;
+    auto _build(int node, int first, int count, const std::vector<pmp::Point>& centroids,
+                std::atomic<int>& node_count) -> void;
+
+  public:
+    TriangleBVH() = default;
+
+    // ignored_faces: optional mask (per face), masked faces are not inserted
+    auto build(const pmp::SurfaceMesh& mesh, const std::vector<bool>& ignored_faces = {}) -> void;
+    // update boxes to new vertex positions (same topology as at build time)
+    auto refit(const pmp::SurfaceMesh& mesh) -> void;
+
+    // swept versions for continuous collision detection, the face boxes enclose the motion of every face from
+    // the previous positions (per vertex) to the current positions of the mesh
+    auto build_swept(const pmp::SurfaceMesh& mesh, const std::vector<pmp::Point>& previous,
+                     const std::vector<bool>& ignored_faces = {}) -> void;
+    auto refit_swept(const pmp::SurfaceMesh& mesh, const std::vector<pmp::Point>& previous) -> void;
+
+    [[nodiscard]]
+    auto empty() const -> bool { return _faces.empty(); }
+    [[nodiscard]]
+    auto n_faces() const -> size_t { return _face_vertices.size(); }
+    [[nodiscard]]
+    auto nodes() const -> const std::vector<Node>& { return _nodes; }
+    // faces in tree order, a leaf covers faces()[first, first + count)
+    [[nodiscard]]
+    auto faces() const -> const std::vector<int>& { return _faces; }
+    [[nodiscard]]
+    auto face_box(int face) const -> const AABB& { return _face_boxes[face]; }
+    [[nodiscard]]
+    auto face_vertices(int face) const -> const std::array<int, 3>& { return _face_vertices[face]; }
+
+    // true if the hierarchy was built for a mesh with this topology
+    [[nodiscard]]
+    auto matches(const pmp::SurfaceMesh& mesh) const -> bool;
+
+    // pairs of faces (this, other) with overlapping boxes, parallel dual tree traversal
+    auto overlapping_faces(const TriangleBVH& other) const -> std::vector<std::pair<int, int>>;
+    // pairs of faces (f < g) of this hierarchy with overlapping boxes, without pairs sharing a vertex
+    auto self_overlapping_faces() const -> std::vector<std::pair<int, int>>;
+
+    // closest point to p on the faces (positions of the mesh the boxes were fitted to), only searched within
+    // max_distance. returns the face, or -1 if there is none that close.
+    // hint: optional face tested first (e.g. the result of the last query), its distance bounds the traversal
+    auto closest_point(const std::vector<pmp::Point>& positions, const pmp::Point& p, pmp::dvec3& closest,
+                       TriangleRegion& region, float max_distance = FLT_MAX, int hint = -1) const -> int;
+};
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+#endif // TAILORME_VIEWER_TRIANGLEBVH_H
@@ -141,4 +141,35 @@ auto BaseMesh::update_layer_points(ArrayXf& point_data, MeshLayer layer) -> void
 
 // ---------------------------------------------------------------------------------------------------------------------
 
+auto BaseMesh::show_tissue_thickness(bool show, MeshLayer layer) -> void
+{
+    (void) show;
+    (void) layer;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto BaseMesh::save_tissue_thickness(const std::string& filename) -> bool
+{
+    (void) filename;
+    std::cerr << "Save tissue thickness not overwritten.\n";
+    return false;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto BaseMesh::set_sparse_bone_warp(bool sparse) -> void
+{
+    (void) sparse;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto BaseMesh::compare_bone_warps() -> void
+{
+    std::cerr << "Compare bone warps not overwritten.\n";
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
 //======================================================================================================================
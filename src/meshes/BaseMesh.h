@@ -83,6 +83,18 @@ public:
 
     //! run optimizers
     virtual auto optimize_meshes() -> void;
+
+    //! soft tissue thickness of the skin to the given layer as texture ("Texture" draw mode),
+    //! updated by every optimization while shown
+    virtual auto show_tissue_thickness(bool show, MeshLayer layer) -> void;
+    //! export the thickness (one value per skin vertex)
+    virtual auto save_tissue_thickness(const std::string& filename) -> bool;
+
+    //! warp the bones with the sparse (multilevel compactly supported) rbf instead of the dense one,
+    //! used by the next optimization
+    virtual auto set_sparse_bone_warp(bool sparse) -> void;
+    //! print the deviation of the sparse from the dense bone warp for the current skel wrap
+    virtual auto compare_bone_warps() -> void;
 };
 
 
@@ -10,6 +10,7 @@
 #include "pmp/stop_watch.h"
 
 #include "Constants.h"
+#include "Globals.h"
 #include "utils/io/io_selection.h"
 #include "utils/io/io_vertexweighting.h"
 
@@ -125,6 +126,18 @@ BodyMesh::BodyMesh(BodyType gender)
 
 // ---------------------------------------------------------------------------------------------------------------------
 
+BodyMesh::~BodyMesh()
+{
+    // stop the operator build at the next point cluster, it uses the members until it returns
+    _rbf_operator_cancel = true;
+    if (_rbf_operator_job.valid())
+    {
+        _rbf_operator_job.wait();
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
 auto BodyMesh::get_bone() -> SurfaceMesh* {
     return &_bones;
 }
@@ -140,6 +153,33 @@ auto BodyMesh::_get_foot_point() -> pmp::Point {
 
 // ---------------------------------------------------------------------------------------------------------------------
 
+auto BodyMesh::_get_full_skel_wrap() -> SurfaceMesh
+{
+    SurfaceMesh full_skel_wrap = _skin;
+    for (auto v : full_skel_wrap.vertices())
+    {
+        int mapped_idx = _rbf_data.mapping_full_to_cutoff[v.idx()];
+        if (mapped_idx != -1)
+        {
+            auto mapped_v = pmp::Vertex(mapped_idx);
+            full_skel_wrap.position(v) = _skel_wrap.position(mapped_v);
+        }
+    }
+    // Push the wrap a few millimeters inside at head, hands and feet
+    pmp::vertex_normals(full_skel_wrap);
+    auto shrink_prop = _skin.get_vertex_property<float>("v:rbf_warp_shrink_wrap");
+    auto vnormal = full_skel_wrap.vertex_property<pmp::Normal>("v:normal");
+
+    for (auto v : full_skel_wrap.vertices())
+    {
+        full_skel_wrap.position(v) -= shrink_prop[v] * vnormal[v];
+    }
+
+    return full_skel_wrap;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
 auto BodyMesh::get_skel() -> SurfaceMesh* {
     return &_skel_wrap;
 }
@@ -154,6 +194,7 @@ auto BodyMesh::get_skin() -> SurfaceMesh* {
 
 auto BodyMesh::set_skel(SurfaceMesh& mesh) -> void
 { _skel_wrap = SurfaceMesh { mesh };
+    _layer_ccd.invalidate();
 }
 
 // ---------------------------------------------------------------------------------------------------------------------
@@ -180,6 +221,7 @@ auto BodyMesh::set_skin(SurfaceMesh& mesh) -> void
     }
 
     _skin = SurfaceMesh { mesh };
+    _layer_ccd.invalidate();
 }
 
 // ---------------------------------------------------------------------------------------------------------------------
@@ -258,6 +300,13 @@ void BodyMesh::update_mesh_points(VectorXf &point_data) {
         };
         offset += 3;
     }
+
+    // Continuous check of the motion since the last frame, flags the crossed faces for the next resolve
+    if (_layer_ccd.tracking())
+    {
+        _layer_ccd.advance(_skin, _get_full_skel_wrap());
+    }
+
     update_meshes();
 }
 
@@ -270,37 +319,95 @@ auto BodyMesh::optimize_meshes() -> void
 
     if (_rbf_data.num_centers == 0)
     {
-        // Need to initialize and prefactorize RBF warp
-        std::cout << "Prefatorizing rbf warp\n";
-        init_rbf_warp_prioritize_head(_template_skel, 4800, _rbf_data);
+        // Centers and bone operator only depend on the templates, later starts map them from the cache
+        auto cache_filename = std::filesystem::path(globals::model_dir) / "rbf_cache" / (_gender == MALE ? "male.rbf" : "female.rbf");
+        uint64_t cache_key = rbf_cache_key(_template_skel, _template_bones, RBF_ADDITIONAL_CENTERS, RBF_OPERATOR_TOLERANCE);
+
+        if (load_rbf_cache(cache_filename, cache_key, _rbf_data, _rbf_operator))
+        {
+            std::cout << "Loaded rbf warp from " << cache_filename << "\n";
+        }
+        else
+        {
+            // Need to initialize and prefactorize RBF warp
+            std::cout << "Prefatorizing rbf warp\n";
+            init_rbf_warp_prioritize_head(_template_skel, RBF_ADDITIONAL_CENTERS, _rbf_data);
+
+            // The bone operator needs one solve per bone vertex, the rbf data is not changed afterwards
+            _rbf_operator_job = std::async(std::launch::async, [this, cache_filename, cache_key]() {
+                RBF_operator rbf_operator;
+                if (init_rbf_operator(_template_bones, _rbf_data, RBF_OPERATOR_TOLERANCE, rbf_operator, &_rbf_operator_cancel))
+                {
+                    save_rbf_cache(cache_filename, cache_key, _rbf_data, rbf_operator);
+                }
+                return rbf_operator;
+            });
+        }
     }
 
     // Reset bone mesh to template
     _bones = _template_bones;
 
     // Get full skel mesh (setting cut off vertices to skin)
-    pmp::SurfaceMesh full_skel_wrap = _skin;
-    for (auto v : full_skel_wrap.vertices())
+    pmp::SurfaceMesh full_skel_wrap = _get_full_skel_wrap();
+
+    if (_collision_context.n_vertices != _skin.vertices_size())
     {
-        int mapped_idx = _rbf_data.mapping_full_to_cutoff[v.idx()];
-        if (mapped_idx != -1)
-        {
-            auto mapped_v = pmp::Vertex(mapped_idx);
-            full_skel_wrap.position(v) = _skel_wrap.position(mapped_v);
-        }
+        // Topology and locked vertices are fixed, build collision neighborhoods once
+        auto locked_prop = _skin.get_vertex_property<bool>("v:collision_resolve_locked");
+        init_collision_context(_skin, locked_prop, _collision_context);
+        init_collision_proxy(_skin, locked_prop, 6000, _collision_proxy);
+        _layer_ccd.invalidate();
+        _resolved_skin_points.clear();
+        _resolved_wrap_points.clear();
     }
-    // Push the wrap a few millimeters inside at head, hands and feet
-    pmp::vertex_normals(full_skel_wrap);
-    auto shrink_prop = _skin.get_vertex_property<float>("v:rbf_warp_shrink_wrap");
-    auto vnormal = full_skel_wrap.vertex_property<pmp::Normal>("v:normal");
 
-    for (auto v : full_skel_wrap.vertices())
+    // Since the last resolve, the layers only intersect where they crossed between frames (tracked) or at least
+    // where they moved (skin or skel replaced in between). After large changes, the proxy is resolved first.
+    std::vector<int> moved_faces;
+    if (!_layer_ccd.tracking() && !_resolved_skin_points.empty())
     {
-        full_skel_wrap.position(v) -= shrink_prop[v] * vnormal[v];
+        collect_moved_faces(_skin, full_skel_wrap, _collision_context, _resolved_skin_points, _resolved_wrap_points,
+                            1e-5F, moved_faces);
+    }
+
+    bool resolved;
+    if (_layer_ccd.tracking())
+    {
+        resolved = resolve_layer_intersections_by_bottom_layer(_skin, full_skel_wrap, _collision_context,
+                                                               _layer_ccd.crossed_faces());
+    }
+    else if (!_resolved_skin_points.empty() && 2 * moved_faces.size() < _collision_context.faces_to_check.size())
+    {
+        resolved = resolve_layer_intersections_by_bottom_layer(_skin, full_skel_wrap, _collision_context, moved_faces);
+    }
+    else if (!_collision_proxy.vertices.empty())
+    {
+        resolved = resolve_layer_intersections_by_bottom_layer(_skin, full_skel_wrap, _collision_context,
+                                                               _collision_proxy);
+    }
+    else
+    {
+        resolved = resolve_layer_intersections_by_bottom_layer(_skin, full_skel_wrap, _collision_context);
     }
 
-    auto locked_prop = _skin.get_vertex_property<bool>("v:collision_resolve_locked");
-    resolve_layer_intersections_by_bottom_layer(_skin, full_skel_wrap, locked_prop);
+    if (resolved)
+    {
+        std::vector<bool> ignored_faces(_skin.faces_size(), true);
+        for (int f : _collision_context.faces_to_check)
+        {
+            ignored_faces[f] = false;
+        }
+        _layer_ccd.reset(_skin, full_skel_wrap, ignored_faces);
+        _resolved_skin_points = _skin.get_vertex_property<pmp::Point>("v:point").vector();
+        _resolved_wrap_points = full_skel_wrap.get_vertex_property<pmp::Point>("v:point").vector();
+    }
+    else
+    {
+        _layer_ccd.invalidate();
+        _resolved_skin_points.clear();
+        _resolved_wrap_points.clear();
+    }
 
     // Remap from full to reduced skel
     for (auto v : full_skel_wrap.vertices())
@@ -314,7 +421,26 @@ auto BodyMesh::optimize_meshes() -> void
     }
 
     // Warp bones into skel wrap
-    apply_rbf_warp(full_skel_wrap, _bones, _rbf_data);
+    _warp_bones(full_skel_wrap, _bones, _sparse_bone_warp);
+
+    // The warp does not keep the bones inside, project vertices that poke through back (within the time budget)
+    if (_bone_collision_context.n_vertices != _template_bones.vertices_size())
+    {
+        init_bone_collision_context(_template_bones, _bone_collision_context);
+    }
+    if (_bone_collision_context.solver)
+    {
+        int n_outside = resolve_bones_outside_wrap(_bones, full_skel_wrap, _bone_collision_context);
+        if (n_outside > 0)
+        {
+            std::cout << n_outside << " bone vertices left outside the skel wrap\n";
+        }
+    }
+
+    if (_show_thickness)
+    {
+        _update_tissue_thickness(full_skel_wrap);
+    }
 
     _skel_renderer.update_opengl_buffers();
     _bone_renderer.update_opengl_buffers();
@@ -336,8 +462,137 @@ auto BodyMesh::update_layer_points(ArrayXf& point_data, MeshLayer layer) -> void
         if (point_data.size() == static_cast<long> (_skin.n_vertices() * 3)) {
             std::cout << "[DEBUG] Updated skin points\n";
             std::memcpy(_skin.position(pmp::Vertex(0)).data(), point_data.data(), point_data.size() * sizeof (float));
+            _layer_ccd.invalidate();
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto BodyMesh::_update_tissue_thickness(const SurfaceMesh& full_skel_wrap) -> void
+{
+    // rebuilds the hierarchy when switching between wrap and bones
+    const SurfaceMesh& target = _thickness_layer == LayerBone ? _bones : full_skel_wrap;
+    ray_thickness(_skin, target, _thickness_bvh, TISSUE_THICKNESS_MAX);
+
+    auto thickness = _skin.get_vertex_property<float>("v:ray_thickness");
+    VectorXf values = Eigen::Map<VectorXf>(thickness.vector().data(), static_cast<long>(thickness.vector().size()));
+    error_to_texture(_skin, values);
+
+    _skin_renderer.use_cold_warm_texture();
+    _skin_renderer.update_opengl_buffers();
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto BodyMesh::show_tissue_thickness(bool show, MeshLayer layer) -> void
+{
+    _show_thickness = show;
+    _thickness_layer = layer;
+
+    if (!show)
+    {
+        auto skin_matcap_filename = std::filesystem::path(RESOURCE_DATA_DIR) / MATCAP_SKIN;
+        if (std::filesystem::exists(skin_matcap_filename))
+        {
+            _skin_renderer.load_matcap(skin_matcap_filename.string().c_str());
         }
+        return;
+    }
+
+    // The full skel wrap needs the mapping of the rbf warp and the bones are placed by the optimizer
+    if (_rbf_data.num_centers == 0)
+    {
+        std::cout << "Tissue thickness is shown after the next optimization\n";
+        return;
+    }
+
+    _update_tissue_thickness(_get_full_skel_wrap());
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto BodyMesh::_init_sparse_bone_warp() -> bool
+{
+    if (!_rbf_sparse_data.levels.empty())
+    {
+        return true;
     }
+
+    std::cout << "Initializing sparse rbf warp\n";
+    return init_rbf_warp_sparse(_template_skel, RBF_SPARSE_ADDITIONAL_CENTERS, RBF_SPARSE_COARSE_CENTERS,
+                                RBF_SPARSE_SUPPORT_FACTOR, _rbf_sparse_data);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto BodyMesh::_warp_bones(pmp::SurfaceMesh& full_skel_wrap, pmp::SurfaceMesh& bones, bool sparse) -> bool
+{
+    if (sparse)
+    {
+        return _init_sparse_bone_warp() && apply_rbf_warp_sparse(full_skel_wrap, bones, _rbf_sparse_data);
+    }
+
+    if (_rbf_operator_job.valid() && _rbf_operator_job.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+    {
+        _rbf_operator = _rbf_operator_job.get();
+    }
+    if (!_rbf_operator.points.empty())
+    {
+        return apply_rbf_operator(full_skel_wrap, bones, _rbf_data, _rbf_operator);
+    }
+    return apply_rbf_warp(full_skel_wrap, bones, _rbf_data);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto BodyMesh::compare_bone_warps() -> void
+{
+    // The full skel wrap needs the mapping of the rbf warp
+    if (_rbf_data.num_centers == 0)
+    {
+        std::cout << "Bone warps can be compared after the first optimization\n";
+        return;
+    }
+
+    pmp::SurfaceMesh full_skel_wrap = _get_full_skel_wrap();
+    pmp::SurfaceMesh dense_bones = _template_bones;
+    pmp::SurfaceMesh sparse_bones = _template_bones;
+
+    if (!_init_sparse_bone_warp())
+    {
+        std::cerr << "[ERROR] Sparse rbf warp cannot be initialized\n";
+        return;
+    }
+
+    pmp::StopWatch timer;
+    timer.start();
+    bool dense_ok = _warp_bones(full_skel_wrap, dense_bones, false);
+    timer.stop();
+    double dense_time = timer.elapsed();
+
+    timer.start();
+    bool sparse_ok = _warp_bones(full_skel_wrap, sparse_bones, true);
+    timer.stop();
+    double sparse_time = timer.elapsed();
+
+    if (!dense_ok || !sparse_ok)
+    {
+        std::cerr << "[ERROR] Bone warps cannot be compared\n";
+        return;
+    }
+
+    RBF_warp_error error = compare_rbf_warps(sparse_bones, dense_bones);
+    std::cout << "Sparse bone warp (" << _rbf_sparse_data.num_centers << " centers, " << sparse_time << " ms) against dense ("
+              << _rbf_data.num_centers << " centers, " << dense_time << " ms): max " << error.max * 1000.0 << " mm, mean "
+              << error.mean * 1000.0 << " mm, rms " << error.rms * 1000.0 << " mm\n";
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto BodyMesh::save_tissue_thickness(const std::string& filename) -> bool
+{
+    return save_vertexweighting(filename, _skin, "v:ray_thickness");
 }
 
 // ---------------------------------------------------------------------------------------------------------------------
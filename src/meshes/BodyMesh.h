@@ -5,10 +5,17 @@
 #ifndef MUTLILINEAR_BODYMESH_H
 #define MUTLILINEAR_BODYMESH_H
 
+#include <atomic>
+#include <future>
+
 #include <pmp/visualization/renderer.h>
 
 #include "BaseMesh.h"
 
+#include "algorithms/BoneCollisionResolve.h"
+#include "algorithms/LayerCCD.h"
+#include "algorithms/LayerCollisionResolve.h"
+#include "algorithms/RayCast.h"
 #include "algorithms/RBF_warp.h"
 
 enum BodyType {
@@ -30,13 +37,43 @@ protected:
     pmp::Renderer _bone_renderer;
 
     RBF_data _rbf_data{};
+    // bone warp as precomputed operator, built in the background (direct warp until it is ready)
+    RBF_operator _rbf_operator{};
+    std::atomic<bool> _rbf_operator_cancel{false};
+    std::future<RBF_operator> _rbf_operator_job{};
+    // alternative bone warp, initialized when first used
+    RBF_sparse_data _rbf_sparse_data{};
+    bool _sparse_bone_warp = false;
+    CollisionContext _collision_context{};
+    // decimated skin / full skel wrap, for resolves after large changes of the layers
+    CollisionProxy _collision_proxy{};
+    // tracks skin and full skel wrap between resolves, only crossed faces are resolved again
+    LayerCCD _layer_ccd{};
+    // skin and full skel wrap after the last successful resolve, only faces that moved since are checked again
+    std::vector<pmp::Point> _resolved_skin_points{};
+    std::vector<pmp::Point> _resolved_wrap_points{};
+    // keeps the warped bones inside the full skel wrap, factorized once for the template bones
+    BoneCollisionContext _bone_collision_context{};
+    // tissue thickness map of the skin along the inverted normals (v:ray_thickness), shown as texture
+    TriangleBVH _thickness_bvh{};
+    bool _show_thickness = false;
+    MeshLayer _thickness_layer = LayerSkel;
 
     BodyType _gender;
 
     auto _get_foot_point() -> pmp::Point;
+    // skin topology, skel wrap where available, shrunk skin at the cut off parts
+    auto _get_full_skel_wrap() -> pmp::SurfaceMesh;
+    // casts the thickness map against the full skel wrap or the bones and maps it to the skin texture
+    auto _update_tissue_thickness(const pmp::SurfaceMesh& full_skel_wrap) -> void;
+    // sparse bone warp is set up on first use
+    auto _init_sparse_bone_warp() -> bool;
+    // warps the template bones into the full skel wrap (sparse or dense warp)
+    auto _warp_bones(pmp::SurfaceMesh& full_skel_wrap, pmp::SurfaceMesh& bones, bool sparse) -> bool;
 
 public:
     explicit BodyMesh(BodyType gender);
+    ~BodyMesh() override;
 
     void draw(const pmp::mat4 &projection_matrix,
               const pmp::mat4 &modelview_matrix,
@@ -61,6 +98,12 @@ public:
 
     // optimize meshes
     auto optimize_meshes() -> void override;
+
+    auto show_tissue_thickness(bool show, MeshLayer layer) -> void override;
+    auto save_tissue_thickness(const std::string& filename) -> bool override;
+
+    auto set_sparse_bone_warp(bool sparse) -> void override { _sparse_bone_warp = sparse; }
+    auto compare_bone_warps() -> void override;
 };
 
 
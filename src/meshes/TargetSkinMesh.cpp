@@ -12,6 +12,7 @@
 #include "TargetSkinMesh.h"
 #include "Constants.h"
 #include "pmp/io/io.h"
+#include "utils/io/pmp_io.h"
 
 // =====================================================================================================================
 
@@ -77,7 +78,11 @@ auto TargetSkinMesh::open_file(const std::string& filename) -> void
     }
 
     _mesh = new pmp::SurfaceMesh();
-    pmp::read(*_mesh, filename);
+    if (std::filesystem::path(filename).extension() == ".xyz") {
+        read_xyz(*_mesh, filename);
+    } else {
+        pmp::read(*_mesh, filename);
+    }
     _renderer = new pmp::Renderer(*_mesh);
 
     // render settings
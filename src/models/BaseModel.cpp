@@ -57,6 +57,26 @@ auto BaseModel::inference(const ArrayXf &weights) -> ArrayXf
 
 // ---------------------------------------------------------------------------------------------------------------------
 
+auto BaseModel::inference_batch(const MatrixXf& weights) -> MatrixXf
+{
+    InferenceMode old_mode = _inference_mode;
+    _inference_mode = NORMAL;
+
+    MatrixXf result{};
+    for (long sample = 0; sample < weights.cols(); ++sample) {
+        ArrayXf points = inference(weights.col(sample));
+        if (sample == 0) {
+            result.resize(points.size(), weights.cols());
+        }
+        result.col(sample) = points.matrix();
+    }
+
+    _inference_mode = old_mode;
+    return result;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
 auto BaseModel::inference_available() const -> bool
 {
     std::cerr << "Overwrite inference_available in your model.\n";
@@ -116,6 +136,13 @@ auto BaseModel::set_mesh_type(MeshType mesh_type) -> void
 
 // ---------------------------------------------------------------------------------------------------------------------
 
+auto BaseModel::get_model_filename() -> std::string
+{
+    return {};
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
 auto BaseModel::get_mean_skel() -> SurfaceMesh
 {
     return {};
@@ -143,6 +170,60 @@ auto BaseModel::fit_target() -> void
 
 // ---------------------------------------------------------------------------------------------------------------------
 
+auto BaseModel::fit_target_scan(const ArrayXf& scan_points) -> void
+{
+    (void) scan_points;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto BaseModel::fit_latent(const ArrayXf& target_skin, FitMonitor* monitor) -> ArrayXf
+{
+    (void) target_skin; (void) monitor;
+    return ArrayXf{};
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto BaseModel::fit_scan_latent(const ArrayXf& scan_points, ArrayXf& registered_skin, FitMonitor* monitor) -> ArrayXf
+{
+    (void) scan_points; (void) monitor;
+    registered_skin = ArrayXf{};
+    return ArrayXf{};
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto BaseModel::set_latent_fit(const ArrayXf& latent) -> void
+{
+    (void) latent;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto BaseModel::set_latent_fit(const ArrayXf& latent, const ArrayXf& target_skin_fit) -> void
+{
+    (void) target_skin_fit;
+    set_latent_fit(latent);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto BaseModel::get_target_skin_fit() -> ArrayXf
+{
+    return ArrayXf{};
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto BaseModel::fit_settings(bool scan_fitting) -> std::string
+{
+    (void) scan_fitting;
+    return {};
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
 auto BaseModel::get_latent_fit() -> ArrayXf
 {
     return ArrayXf{};
@@ -150,6 +231,13 @@ auto BaseModel::get_latent_fit() -> ArrayXf
 
 // ---------------------------------------------------------------------------------------------------------------------
 
+auto BaseModel::get_target_skin() -> ArrayXf
+{
+    return ArrayXf{};
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
 auto BaseModel::set_inference_mode(InferenceMode mode) -> void
 {
     _inference_mode = mode;
@@ -18,6 +18,7 @@
 #include "libzippp.h"
 
 #include "meshes/BaseMesh.h"
+#include "models/FitMonitor.h"
 
 // namespaces
 //using namespace Eigen;
@@ -76,6 +77,9 @@ class BaseModel {
 
     // inference a model by weights
     virtual auto inference(const ArrayXf& weights) -> ArrayXf;
+    // inference many samples at once (one latent vector per column, one mesh per column)
+    // always normal inference, the fitting delta is not applied
+    virtual auto inference_batch(const MatrixXf& weights) -> MatrixXf;
 
     // inference available (module loaded)
     [[nodiscard]]
@@ -91,6 +95,9 @@ class BaseModel {
     // set mesh
     virtual auto set_mesh_type(MeshType mesh_type) -> void;
 
+    // file of the trained model (empty if not file based)
+    virtual auto get_model_filename() -> std::string;
+
     // get mesh from trained model
     virtual auto get_mean_skel() -> pmp::SurfaceMesh;
     virtual auto get_mean_skin() -> pmp::SurfaceMesh;
@@ -102,8 +109,26 @@ class BaseModel {
     // this should set the "best fit" skin internally for delta changes
     // setting z
     virtual auto fit_target() -> void;
+    // fit a raw scan (any vertex count or point cloud, xyz format) without known correspondences
+    // sets the registered scan as target skin, so delta inference works afterwards
+    virtual auto fit_target_scan(const ArrayXf& scan_points) -> void;
+    // fitting without changing the model state, safe to run in a background thread next to inference.
+    // the monitor (may be nullptr) is polled for cancellation and receives progress and intermediate latents.
+    // returns an empty array if cancelled.
+    virtual auto fit_latent(const ArrayXf& target_skin, FitMonitor* monitor) -> ArrayXf;
+    virtual auto fit_scan_latent(const ArrayXf& scan_points, ArrayXf& registered_skin, FitMonitor* monitor) -> ArrayXf;
+    // commit fitted latent variables for the target skin (z), computes the base for delta inference
+    virtual auto set_latent_fit(const ArrayXf& latent) -> void;
+    // same with known f(z) (e.g. from the fit cache)
+    virtual auto set_latent_fit(const ArrayXf& latent, const ArrayXf& target_skin_fit) -> void;
+    // f(z) of the committed fit
+    virtual auto get_target_skin_fit() -> ArrayXf;
+    // fitter description for cache keys
+    virtual auto fit_settings(bool scan_fitting) -> std::string;
     // get fitted values for latent variables
     virtual auto get_latent_fit() -> ArrayXf;
+    // get target skin (registered in template topology)
+    virtual auto get_target_skin() -> ArrayXf;
     // set prediction mode normal vs. fitting delta
     auto set_inference_mode(InferenceMode mode) -> void;
 
@@ -0,0 +1,195 @@
+//======================================================================================================================
+// Copyright (c) the Authors 2024
+//
+// This work is licensed under a
+// Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+//
+// You should have received a copy of the license along with this
+// work. If not, see <http://creativecommons.org/licenses/by-nc-sa/4.0/>.
+//
+//======================================================================================================================
+
+#include "FitCache.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include "utils/io/ndarray_io.h"
+
+// =====================================================================================================================
+
+namespace fs = std::filesystem;
+
+// =====================================================================================================================
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+FitCache::FitCache(std::string directory, uintmax_t max_bytes)
+    : _directory(std::move(directory)), _max_bytes(max_bytes)
+{
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto FitCache::hash_bytes(const void* data, size_t size, uint64_t seed) -> uint64_t
+{
+    const auto* bytes = static_cast<const unsigned char*>(data);
+    uint64_t hash = seed;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto FitCache::file_hash(const std::string& filename) -> uint64_t
+{
+    std::error_code error;
+    auto size = fs::file_size(filename, error);
+    if (error) {
+        return 0;
+    }
+    auto time = fs::last_write_time(filename, error).time_since_epoch().count();
+    std::string file_key = fmt::format("{}:{}:{}", filename, size, time);
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _file_hashes.find(file_key);
+    if (it != _file_hashes.end()) {
+        return it->second;
+    }
+
+    // hash in chunks, model files are large
+    std::ifstream in(filename, std::ios::binary);
+    std::vector<char> chunk(1 << 20);
+    uint64_t hash = hash_bytes(nullptr, 0);
+    while (in) {
+        in.read(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+        hash = hash_bytes(chunk.data(), static_cast<size_t>(in.gcount()), hash);
+    }
+
+    _file_hashes[file_key] = hash;
+    return hash;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto FitCache::key(const ArrayXf& target, const std::string& model_filename, const std::string& settings) -> std::string
+{
+    uint64_t target_hash = hash_bytes(target.data(), target.size() * sizeof(float));
+    uint64_t model_hash = file_hash(model_filename);
+    uint64_t settings_hash = hash_bytes(settings.data(), settings.size());
+    return fmt::format("{:016x}{:016x}{:016x}", target_hash, model_hash, settings_hash);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto FitCache::_entry_filename(const std::string& key) const -> std::string
+{
+    return (fs::path(_directory) / (key + ".fit")).string();
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto FitCache::lookup(const std::string& key, FitCacheEntry& entry) -> bool
+{
+    std::string filename = _entry_filename(key);
+    if (_directory.empty() || !fs::exists(filename)) {
+        return false;
+    }
+
+    try {
+        // arrays are stored one after another: latent, f(z), registered skin, [error]
+        std::stringstream buffer;
+        NDArray::read_file_to_buffer(filename, buffer);
+        entry.latent = NDArray::read_vector_f(buffer);
+        entry.target_skin_fit = NDArray::read_vector_f(buffer);
+        entry.registered_skin = NDArray::read_vector_f(buffer);
+        VectorXf meta = NDArray::read_vector_f(buffer);
+        entry.error_mm = meta.size() > 0 ? meta[0] : 0.0F;
+    } catch (std::runtime_error& exception) {
+        std::cerr << "[Error] Fit cache: " << exception.what() << '\n';
+        return false;
+    }
+
+    // least recently used
+    std::error_code error;
+    fs::last_write_time(filename, fs::file_time_type::clock::now(), error);
+    return true;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto FitCache::store(const std::string& key, const FitCacheEntry& entry) -> void
+{
+    if (_directory.empty()) {
+        return;
+    }
+
+    std::error_code error;
+    fs::create_directories(_directory, error);
+
+    std::stringstream file_buffer;
+    std::stringstream array_buffer;
+    VectorXf meta(1);
+    meta[0] = entry.error_mm;
+    for (const ArrayXf& array : { entry.latent, entry.target_skin_fit, entry.registered_skin, ArrayXf(meta) }) {
+        NDArray::write_vector_f(array_buffer, array.matrix());
+        file_buffer << array_buffer.rdbuf();
+    }
+
+    // write complete file, then rename (readers never see partial entries)
+    std::string filename = _entry_filename(key);
+    std::string tmp_filename = fmt::format("{}.{}.tmp", filename, std::hash<std::thread::id>{}(std::this_thread::get_id()));
+    NDArray::write_buffer_to_file(file_buffer, tmp_filename);
+    fs::rename(tmp_filename, filename, error);
+    if (error) {
+        std::cerr << "[Error] Fit cache: " << error.message() << '\n';
+        fs::remove(tmp_filename, error);
+        return;
+    }
+
+    _evict();
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto FitCache::_evict() -> void
+{
+    std::vector<std::pair<fs::file_time_type, fs::path>> entries;
+    uintmax_t total_bytes = 0;
+
+    std::error_code error;
+    for (const auto& file : fs::directory_iterator(_directory, error)) {
+        if (file.path().extension() != ".fit") {
+            continue;
+        }
+        total_bytes += file.file_size(error);
+        entries.emplace_back(file.last_write_time(error), file.path());
+    }
+
+    // oldest first
+    std::sort(entries.begin(), entries.end());
+    for (const auto& [time, path] : entries) {
+        if (total_bytes <= _max_bytes) {
+            break;
+        }
+        uintmax_t size = fs::file_size(path, error);
+        if (fs::remove(path, error)) {
+            total_bytes -= size;
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+// =====================================================================================================================
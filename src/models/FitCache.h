@@ -0,0 +1,76 @@
+//======================================================================================================================
+// Copyright (c) the Authors 2024
+//
+// This work is licensed under a
+// Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+//
+// You should have received a copy of the license along with this
+// work. If not, see <http://creativecommons.org/licenses/by-nc-sa/4.0/>.
+//
+//======================================================================================================================
+
+#ifndef TAILORME_VIEWER_FITCACHE_H
+#define TAILORME_VIEWER_FITCACHE_H
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+
+#include "GlobTypes.h"
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+// default size bound of the cache directory
+#define FIT_CACHE_MAX_BYTES (256UL * 1024UL * 1024UL)
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+struct FitCacheEntry {
+    ArrayXf latent{};
+    // f(z), base for delta inference
+    ArrayXf target_skin_fit{};
+    // scan registered to the template (empty for targets in template topology)
+    ArrayXf registered_skin{};
+    float error_mm = 0.0F;
+};
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+// On-disk memoization of fitting results, one file per (target positions, model file, fitter settings).
+// Entries are written to a temporary file and renamed, hits refresh the modification time,
+// the least recently used entries are removed when the directory exceeds its size bound.
+class FitCache {
+  protected:
+    std::string _directory{};
+    uintmax_t _max_bytes = FIT_CACHE_MAX_BYTES;
+
+    // model file hashes, keyed by path, size and modification time
+    std::mutex _mutex{};
+    std::map<std::string, uint64_t> _file_hashes{};
+
+    auto _entry_filename(const std::string& key) const -> std::string;
+    // remove oldest entries until the size bound holds
+    auto _evict() -> void;
+
+  public:
+    FitCache() = default;
+    explicit FitCache(std::string directory, uintmax_t max_bytes = FIT_CACHE_MAX_BYTES);
+
+    auto set_directory(const std::string& directory) -> void { _directory = directory; }
+
+    // FNV-1a (64 bit)
+    static auto hash_bytes(const void* data, size_t size, uint64_t seed = 14695981039346656037ULL) -> uint64_t;
+    // hash of a file content (memoized)
+    auto file_hash(const std::string& filename) -> uint64_t;
+
+    // cache key of a fit (hex string)
+    auto key(const ArrayXf& target, const std::string& model_filename, const std::string& settings) -> std::string;
+
+    auto lookup(const std::string& key, FitCacheEntry& entry) -> bool;
+    auto store(const std::string& key, const FitCacheEntry& entry) -> void;
+};
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+#endif // TAILORME_VIEWER_FITCACHE_H
@@ -0,0 +1,47 @@
+//======================================================================================================================
+// Copyright (c) the Authors 2024
+//
+// This work is licensed under a
+// Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+//
+// You should have received a copy of the license along with this
+// work. If not, see <http://creativecommons.org/licenses/by-nc-sa/4.0/>.
+//
+//======================================================================================================================
+
+#include "FitMonitor.h"
+
+// =====================================================================================================================
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+FitMonitor::FitMonitor(int publish_interval)
+    : _publish_interval(publish_interval)
+{
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto FitMonitor::publish_latent(const ArrayXf& latent) -> void
+{
+    std::lock_guard<std::mutex> lock(_latent_mutex);
+    _latest_latent = latent;
+    _latent_version++;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto FitMonitor::latest_latent(ArrayXf& latent, int& version) -> bool
+{
+    std::lock_guard<std::mutex> lock(_latent_mutex);
+    if (_latent_version == version) {
+        return false;
+    }
+    latent = _latest_latent;
+    version = _latent_version;
+    return true;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+// =====================================================================================================================
@@ -0,0 +1,61 @@
+//======================================================================================================================
+// Copyright (c) the Authors 2024
+//
+// This work is licensed under a
+// Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+//
+// You should have received a copy of the license along with this
+// work. If not, see <http://creativecommons.org/licenses/by-nc-sa/4.0/>.
+//
+//======================================================================================================================
+
+#ifndef TAILORME_VIEWER_FITMONITOR_H
+#define TAILORME_VIEWER_FITMONITOR_H
+
+#include <atomic>
+#include <mutex>
+
+#include "GlobTypes.h"
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+// Shared between a (background) fitting and its observer:
+// cancellation token, progress fraction and the latest intermediate latent code.
+class FitMonitor {
+  protected:
+    std::atomic<bool> _cancelled{false};
+    std::atomic<float> _progress{0.0F};
+
+    // publish every n-th optimizer step
+    int _publish_interval = 5;
+
+    std::mutex _latent_mutex{};
+    ArrayXf _latest_latent{};
+    int _latent_version = 0;
+
+  public:
+    FitMonitor() = default;
+    explicit FitMonitor(int publish_interval);
+
+    // cancellation token, checked by the fitting between steps
+    auto cancel() -> void { _cancelled = true; }
+    [[nodiscard]]
+    auto cancelled() const -> bool { return _cancelled; }
+
+    // progress in [0, 1]
+    auto set_progress(float progress) -> void { _progress = progress; }
+    [[nodiscard]]
+    auto progress() const -> float { return _progress; }
+
+    // fitting side: should step publish its latent?
+    [[nodiscard]]
+    auto publish_step(int step) const -> bool { return _publish_interval > 0 && step % _publish_interval == 0; }
+    auto publish_latent(const ArrayXf& latent) -> void;
+
+    // observer side: copy latent if newer than version (version is updated), false if nothing new
+    auto latest_latent(ArrayXf& latent, int& version) -> bool;
+};
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+#endif // TAILORME_VIEWER_FITMONITOR_H
@@ -0,0 +1,81 @@
+//======================================================================================================================
+// Copyright (c) the Authors 2024
+//
+// This work is licensed under a
+// Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+//
+// You should have received a copy of the license along with this
+// work. If not, see <http://creativecommons.org/licenses/by-nc-sa/4.0/>.
+//
+//======================================================================================================================
+
+#include "FittingJob.h"
+
+#include <iostream>
+
+// =====================================================================================================================
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+FittingJob::~FittingJob()
+{
+    cancel();
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto FittingJob::start(FitFunction fit, int publish_interval) -> void
+{
+    cancel();
+
+    _monitor = std::make_shared<FitMonitor>(publish_interval);
+    _finished = false;
+    _result = ArrayXf{};
+
+    // the thread holds its own reference to the monitor
+    std::shared_ptr<FitMonitor> monitor = _monitor;
+    _thread = std::thread([this, monitor, fit = std::move(fit)]() {
+        ArrayXf result{};
+        try {
+            result = fit(*monitor);
+        } catch (std::exception& exception) {
+            std::cerr << "[Error] Fitting job: " << exception.what() << '\n';
+        }
+        monitor->set_progress(1.0F);
+
+        // joined before read, no lock needed
+        _result = result;
+        _finished = true;
+    });
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto FittingJob::cancel() -> void
+{
+    if (_thread.joinable()) {
+        _monitor->cancel();
+        _thread.join();
+    }
+    _monitor.reset();
+    _finished = false;
+    _result = ArrayXf{};
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto FittingJob::take_result() -> ArrayXf
+{
+    if (_thread.joinable()) {
+        _thread.join();
+    }
+    ArrayXf result = std::move(_result);
+    _result = ArrayXf{};
+    _monitor.reset();
+    _finished = false;
+    return result;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+// =====================================================================================================================
@@ -0,0 +1,65 @@
+//======================================================================================================================
+// Copyright (c) the Authors 2024
+//
+// This work is licensed under a
+// Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+//
+// You should have received a copy of the license along with this
+// work. If not, see <http://creativecommons.org/licenses/by-nc-sa/4.0/>.
+//
+//======================================================================================================================
+
+#ifndef TAILORME_VIEWER_FITTINGJOB_H
+#define TAILORME_VIEWER_FITTINGJOB_H
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <thread>
+
+#include "GlobTypes.h"
+#include "models/FitMonitor.h"
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+// Runs one fitting in a background thread. Starting a new job cancels (and joins) the running one.
+// The result is fetched on the ui thread once finished() is true.
+class FittingJob {
+  public:
+    // fitting function, returns the latent code (empty if cancelled or failed)
+    using FitFunction = std::function<ArrayXf(FitMonitor&)>;
+
+  protected:
+    std::thread _thread{};
+    std::shared_ptr<FitMonitor> _monitor{};
+    std::atomic<bool> _finished{false};
+    ArrayXf _result{};
+
+  public:
+    FittingJob() = default;
+    ~FittingJob();
+
+    FittingJob(const FittingJob&) = delete;
+    auto operator=(const FittingJob&) -> FittingJob& = delete;
+
+    auto start(FitFunction fit, int publish_interval) -> void;
+    // request cancellation and wait for the thread, the result is dropped
+    auto cancel() -> void;
+
+    // started and result not taken yet
+    [[nodiscard]]
+    auto active() const -> bool { return _thread.joinable(); }
+    // finished, result can be taken
+    [[nodiscard]]
+    auto finished() const -> bool { return _thread.joinable() && _finished; }
+    // join and move result out (job becomes inactive)
+    auto take_result() -> ArrayXf;
+
+    // monitor of the current job (nullptr if none)
+    [[nodiscard]]
+    auto monitor() const -> FitMonitor* { return _monitor.get(); }
+};
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+#endif // TAILORME_VIEWER_FITTINGJOB_H
@@ -0,0 +1,258 @@
+//======================================================================================================================
+// Copyright (c) the Authors 2024
+//
+// This work is licensed under a
+// Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+//
+// You should have received a copy of the license along with this
+// work. If not, see <http://creativecommons.org/licenses/by-nc-sa/4.0/>.
+//
+//======================================================================================================================
+
+#include "MeasurementSolver.h"
+
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <random>
+#include <sstream>
+
+#include <pmp/stop_watch.h>
+
+#include "algorithms/MeshMeasurements.h"
+#include "utils/io/filesystem_utils.h"
+#include "utils/io/ndarray_io.h"
+
+// =====================================================================================================================
+
+// regressor training (random latent samples, same spread as the "Random" button)
+#define MEASUREMENT_TRAINING_SAMPLES 1024
+#define MEASUREMENT_TRAINING_STD 0.5
+#define MEASUREMENT_BATCH_SIZE 64
+#define MEASUREMENT_RIDGE 1.0e-4F
+
+// refinement
+#define MEASUREMENT_MAX_ITERATIONS 4
+#define MEASUREMENT_TIME_BUDGET_MS 500.0
+#define MEASUREMENT_FD_STEP 1.0e-2F
+#define MEASUREMENT_DAMPING 1.0e-4F
+#define MEASUREMENT_PRIOR 1.0e-5F
+#define MEASUREMENT_TOLERANCE 1.0e-3F // relative
+
+// =====================================================================================================================
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto MeasurementSolver::regressor_filename(BaseModel& model) -> std::string
+{
+    std::filesystem::path filename = model.get_model_filename();
+    if (filename.empty()) {
+        return {};
+    }
+    filename.replace_filename(filename.stem().string() + "_measurements.dat");
+    return filename.string();
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto MeasurementSolver::reset() -> void
+{
+    _regressor.resize(0, 0);
+    _measurement_mean.resize(0);
+    _skin = pmp::SurfaceMesh();
+    _solved_measurements.resize(0);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto MeasurementSolver::init(BaseModel& model) -> bool
+{
+    reset();
+    if (!model.inference_available()) {
+        return false;
+    }
+
+    _skin = model.get_mean_skin();
+    _skin_offset = static_cast<long>(model.get_mean_skel().n_vertices()) * 3;
+
+    // regressor stored next to the model? arrays are stored one after another: regressor, mean measurements
+    std::string filename = regressor_filename(model);
+    if (!filename.empty() && FilesystemUtils::file_exists(filename)) {
+        try {
+            std::stringstream buffer;
+            NDArray::read_file_to_buffer(filename, buffer);
+            _regressor = NDArray::read_matrix_f(buffer);
+            _measurement_mean = NDArray::read_vector_f(buffer);
+        } catch (std::runtime_error& exception) {
+            std::cerr << exception.what() << '\n';
+            _regressor.resize(0, 0);
+            _measurement_mean.resize(0);
+        }
+
+        if (_regressor.rows() == model.latent_channels_sum() && _regressor.cols() == MEASUREMENT_COUNT + 1
+            && _measurement_mean.size() == MEASUREMENT_COUNT)
+        {
+            std::cout << "Measurement regressor loaded from " << filename << '\n';
+            return true;
+        }
+        std::cout << "Measurement regressor does not match the model, learning a new one.\n";
+    }
+
+    if (!_train(model)) {
+        reset();
+        return false;
+    }
+
+    if (!filename.empty()) {
+        try {
+            std::stringstream file_buffer;
+            std::stringstream array_buffer;
+            NDArray::write_matrix_f(array_buffer, _regressor);
+            file_buffer << array_buffer.rdbuf();
+            NDArray::write_vector_f(array_buffer, _measurement_mean);
+            file_buffer << array_buffer.rdbuf();
+            NDArray::write_buffer_to_file(file_buffer, filename);
+        } catch (std::runtime_error& exception) {
+            std::cerr << exception.what() << '\n';
+        }
+    }
+    return true;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto MeasurementSolver::_measure(const MatrixXf& points) -> MatrixXf
+{
+    MatrixXf measurements(MEASUREMENT_COUNT, points.cols());
+    for (long sample = 0; sample < points.cols(); ++sample) {
+        std::memcpy(_skin.positions().data()->data(), points.col(sample).data() + _skin_offset,
+                    _skin.n_vertices() * 3 * sizeof(float));
+        measurements.col(sample) = get_body_measurements(_skin);
+    }
+    return measurements;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto MeasurementSolver::_train(BaseModel& model) -> bool
+{
+    pmp::StopWatch stop_watch;
+    stop_watch.start();
+
+    int latent_size = model.latent_channels_sum();
+    std::mt19937 random_gen{42};
+    std::normal_distribution normal_dist{0.0, MEASUREMENT_TRAINING_STD};
+
+    MatrixXf latents(latent_size, MEASUREMENT_TRAINING_SAMPLES);
+    for (long i = 0; i < latents.size(); ++i) {
+        latents.data()[i] = static_cast<float>(normal_dist(random_gen));
+    }
+
+    // decode in batches, augmented measurements [m, 1]
+    MatrixXf measurements = MatrixXf::Ones(MEASUREMENT_COUNT + 1, MEASUREMENT_TRAINING_SAMPLES);
+    for (long first = 0; first < MEASUREMENT_TRAINING_SAMPLES; first += MEASUREMENT_BATCH_SIZE) {
+        long count = std::min<long>(MEASUREMENT_BATCH_SIZE, MEASUREMENT_TRAINING_SAMPLES - first);
+        MatrixXf points = model.inference_batch(latents.middleCols(first, count));
+        if (points.rows() < _skin_offset + static_cast<long>(_skin.n_vertices()) * 3) {
+            std::cerr << "[Error] Measurement regressor: Unexpected model output.\n";
+            return false;
+        }
+        measurements.block(0, first, MEASUREMENT_COUNT, count) = _measure(points);
+    }
+
+    // ridge regression latent = R [m, 1]
+    // R = Z M^T (M M^T + lambda I)^-1
+    Eigen::MatrixXd m = measurements.cast<double>();
+    Eigen::MatrixXd mmt = m * m.transpose();
+    mmt.diagonal().head(MEASUREMENT_COUNT).array() += MEASUREMENT_RIDGE * MEASUREMENT_TRAINING_SAMPLES;
+    Eigen::MatrixXd zmt = latents.cast<double>() * m.transpose();
+    _regressor = mmt.ldlt().solve(zmt.transpose()).transpose().cast<float>();
+    _measurement_mean = measurements.topRows(MEASUREMENT_COUNT).rowwise().mean();
+
+    stop_watch.stop();
+    std::cout << "Measurement regressor learned from " << MEASUREMENT_TRAINING_SAMPLES << " samples: "
+              << stop_watch.elapsed() << " ms\n";
+    return true;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto MeasurementSolver::solve(BaseModel& model, const VectorXf& measurements, const VectorXf& weights) -> ArrayXf
+{
+    if (!initialized() || measurements.size() != MEASUREMENT_COUNT || weights.size() != MEASUREMENT_COUNT) {
+        return {};
+    }
+
+    pmp::StopWatch stop_watch;
+    stop_watch.start();
+    auto start_time = std::chrono::steady_clock::now();
+
+    int latent_size = static_cast<int>(_regressor.rows());
+
+    // initial guess by regression. The regressor only saw real measurements, ignored ones (0) are replaced by the
+    // training mean, the refinement would hardly correct the latent directions they leave unconstrained.
+    VectorXf augmented = VectorXf::Ones(MEASUREMENT_COUNT + 1);
+    for (int i = 0; i < MEASUREMENT_COUNT; ++i) {
+        augmented[i] = weights[i] > 0.0F ? measurements[i] : _measurement_mean[i];
+    }
+    VectorXf latent = _regressor * augmented;
+
+    // residuals are relative to the requested measurement
+    VectorXf scale = VectorXf::Zero(MEASUREMENT_COUNT);
+    for (int i = 0; i < MEASUREMENT_COUNT; ++i) {
+        if (weights[i] > 0.0F && measurements[i] > 0.0F) {
+            scale[i] = std::sqrt(weights[i]) / measurements[i];
+        }
+    }
+
+    // refine with finite difference jacobian, the current latent and all steps are decoded in one batch
+    MatrixXf batch(latent_size, latent_size + 1);
+    for (int iteration = 0; iteration < MEASUREMENT_MAX_ITERATIONS; ++iteration) {
+        batch = latent.replicate(1, latent_size + 1);
+        batch.rightCols(latent_size).diagonal().array() += MEASUREMENT_FD_STEP;
+
+        MatrixXf points = model.inference_batch(batch);
+        if (points.cols() != batch.cols()) {
+            std::cerr << "[Error] Measurement solver: Batch inference failed.\n";
+            break;
+        }
+        MatrixXf values = _measure(points);
+        _solved_measurements = values.col(0);
+
+        VectorXf residual = scale.asDiagonal() * (values.col(0) - measurements);
+        std::cout << "Measurement solver " << iteration << " max. relative error: "
+                  << residual.cwiseAbs().maxCoeff() << '\n';
+        if (residual.cwiseAbs().maxCoeff() < MEASUREMENT_TOLERANCE
+            || std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count()
+                   > MEASUREMENT_TIME_BUDGET_MS)
+        {
+            break;
+        }
+
+        MatrixXf jacobian = scale.asDiagonal()
+                            * ((values.rightCols(latent_size).colwise() - values.col(0)) / MEASUREMENT_FD_STEP);
+
+        // damped gauss newton, a small prior keeps the latent code plausible
+        MatrixXf lhs = jacobian.transpose() * jacobian;
+        lhs.diagonal().array() += MEASUREMENT_DAMPING + MEASUREMENT_PRIOR;
+        VectorXf rhs = -(jacobian.transpose() * residual + MEASUREMENT_PRIOR * latent);
+        latent += lhs.ldlt().solve(rhs);
+
+        // measure the last step as well
+        if (iteration + 1 == MEASUREMENT_MAX_ITERATIONS) {
+            MatrixXf final_points = model.inference_batch(latent);
+            if (final_points.cols() == 1) {
+                _solved_measurements = _measure(final_points).col(0);
+            }
+        }
+    }
+
+    stop_watch.stop();
+    std::cout << "Measurement solver: " << stop_watch.elapsed() << " ms\n";
+    return latent.array();
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+// =====================================================================================================================
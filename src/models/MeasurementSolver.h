@@ -0,0 +1,67 @@
+//======================================================================================================================
+// Copyright (c) the Authors 2024
+//
+// This work is licensed under a
+// Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+//
+// You should have received a copy of the license along with this
+// work. If not, see <http://creativecommons.org/licenses/by-nc-sa/4.0/>.
+//
+//======================================================================================================================
+
+#ifndef TAILORME_VIEWER_MEASUREMENTSOLVER_H
+#define TAILORME_VIEWER_MEASUREMENTSOLVER_H
+
+#include <string>
+
+#include <pmp/surface_mesh.h>
+
+#include "GlobTypes.h"
+#include "models/BaseModel.h"
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+// Maps body measurements (see MeshMeasurements.h) to latent variables.
+// A linear regressor (learned once from decoded random samples, stored next to the model) gives the initial guess,
+// a few damped Gauss-Newton iterations with a finite difference jacobian refine it on the decoded mesh.
+class MeasurementSolver {
+  protected:
+    // latent = _regressor * [measurements, 1]
+    MatrixXf _regressor{};
+    // mean measurements of the training samples, regressed in place of ignored measurements
+    VectorXf _measurement_mean{};
+    // skin of the model, positions are replaced for measuring
+    pmp::SurfaceMesh _skin{};
+    // first skin entry in the model output (skeleton comes first)
+    long _skin_offset = 0;
+    // measurements of the last solution
+    VectorXf _solved_measurements{};
+
+    // measurements of each decoded sample (one column each)
+    auto _measure(const MatrixXf& points) -> MatrixXf;
+    // learn regressor from random samples
+    auto _train(BaseModel& model) -> bool;
+
+  public:
+    // load regressor and mean measurements (or learn and store them), false if the model is not available
+    auto init(BaseModel& model) -> bool;
+    // forget regressor (model changed)
+    auto reset() -> void;
+
+    [[nodiscard]]
+    auto initialized() const -> bool { return _regressor.size() > 0; }
+
+    // latent variables for measurements (meters), measurements with zero weight are ignored
+    auto solve(BaseModel& model, const VectorXf& measurements, const VectorXf& weights) -> ArrayXf;
+
+    // measurements of the last solution
+    [[nodiscard]]
+    auto get_solved_measurements() const -> const VectorXf& { return _solved_measurements; }
+
+    // regressor file next to the model file, e.g. models/spiral/male_measurements.dat
+    static auto regressor_filename(BaseModel& model) -> std::string;
+};
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+#endif // TAILORME_VIEWER_MEASUREMENTSOLVER_H
@@ -20,6 +20,8 @@
 #include "SpiralNetAEModel.h"
 
 #include "Globals.h"
+#include "algorithms/KdTree.h"
+#include "algorithms/ScanAlignment.h"
 #include "utils/io/filesystem_utils.h"
 #include "utils/io/ndarray_io.h"
 #include "utils/io/pmp_io.h"
@@ -228,7 +230,7 @@ auto SpiralNetAEModel::_inference_torch(const ArrayXf& weights) -> ArrayXf
 
 // ---------------------------------------------------------------------------------------------------------------------
 
-auto SpiralNetAEModel::_fit_skin(ArrayXf& target) -> ArrayXf
+auto SpiralNetAEModel::_fit_skin(const ArrayXf& target, FitMonitor* monitor) -> ArrayXf
 {
     auto latent_variables = ArrayXf { latent_channels_sum() };
     latent_variables.setZero();
@@ -243,10 +245,10 @@ auto SpiralNetAEModel::_fit_skin(ArrayXf& target) -> ArrayXf
     }
 
     // convergence parameters
-    int max_steps = 100;
-    double max_loss_degradation = 10.0e-2; // percentage!
-    double min_loss_improvement = 0.15e-2; // percentage!
-    double learning_rate = 7.5e-2;
+    int max_steps = _fit_max_steps;
+    double max_loss_degradation = _fit_max_loss_degradation; // percentage!
+    double min_loss_improvement = _fit_min_loss_improvement; // percentage!
+    double learning_rate = _fit_learning_rate;
 
     // torch options, with and without gradient
     auto no_grad = torch::TensorOptions().dtype(torch::kFloat32);
@@ -303,6 +305,18 @@ auto SpiralNetAEModel::_fit_skin(ArrayXf& target) -> ArrayXf
     std_dev = std_dev.to(_device);
 
     for (auto step = 0; step < max_steps; ++step) {
+        // background fitting: cancellation, progress and preview
+        if (monitor != nullptr) {
+            if (monitor->cancelled()) {
+                std::cout << "Fitting cancelled.\n";
+                return {};
+            }
+            monitor->set_progress(static_cast<float>(step) / static_cast<float>(max_steps));
+            if (monitor->publish_step(step)) {
+                monitor->publish_latent(_latent_to_array(latent_fit));
+            }
+        }
+
         optimizer.zero_grad();
         current_fit = _model.run_method("decoder", latent_fit).toTensor();
         current_fit = current_fit.reshape({current_fit.size(1) * current_fit.size(2)});
@@ -352,12 +366,184 @@ auto SpiralNetAEModel::_fit_skin(ArrayXf& target) -> ArrayXf
     std::cout << "Loss in mm " << error_mm * 1000.0 << " mm\n";
 
     // convert to final parameters
-    latent_fit = latent_fit.contiguous().to(torch::DeviceType::CPU);
-    std::vector<float> result (latent_fit.data_ptr<float>(), latent_fit.data_ptr<float>() + latent_fit.numel());
+    return _latent_to_array(latent_fit);
+}
 
-    // copy to latent variables
-    std::memcpy(latent_variables.data(), result.data(), latent_variables.size() * sizeof(float));
-    return latent_variables;
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto SpiralNetAEModel::_latent_to_array(const torch::Tensor& latent) -> ArrayXf
+{
+    torch::Tensor latent_cpu = latent.detach().contiguous().to(torch::DeviceType::CPU);
+    return Eigen::Map<ArrayXf> { latent_cpu.data_ptr<float>(), latent_cpu.numel() };
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto SpiralNetAEModel::_fit_scan(const ArrayXf& scan_points, ArrayXf& registered_skin, FitMonitor* monitor) -> ArrayXf
+{
+    auto latent_variables = ArrayXf { latent_channels_sum() };
+    latent_variables.setZero();
+
+    long n_skin_vertices = static_cast<long>(get_mean_skin().n_vertices());
+    if (!_model_loaded || n_skin_vertices == 0 || scan_points.size() < 3) {
+        return latent_variables;
+    }
+
+    // convergence parameters
+    int rigid_iterations = _scan_rigid_iterations;     // alignment of the mean shape only
+    int max_iterations = _scan_max_iterations;         // alternating correspondences / latent updates
+    int latent_steps = _scan_latent_steps;             // adam steps per correspondence update
+    double min_improvement = _scan_min_improvement;    // percentage!
+    double learning_rate = _fit_learning_rate;
+
+    // kd-tree over the scan, built once
+    pmp::StopWatch stop_watch;
+    stop_watch.start();
+    std::vector<pmp::Point> scan(scan_points.size() / 3);
+    std::memcpy(scan.data()->data(), scan_points.data(), scan.size() * 3 * sizeof(float));
+    KdTree scan_tree(scan);
+    stop_watch.stop();
+    std::cout << "Scan kd-tree (" << scan.size() << " points): " << stop_watch.elapsed() << " ms\n";
+
+    // torch options, with and without gradient
+    auto no_grad = torch::TensorOptions().dtype(torch::kFloat32);
+    auto with_grad = torch::TensorOptions().dtype(torch::kFloat32).requires_grad(true).device(_device);
+
+    long n_entries_skel = static_cast<long>(get_mean_skel().n_vertices()) * 3;
+    long n_entries_skin = n_skin_vertices * 3;
+    auto skin_slice = torch::indexing::Slice(n_entries_skel, torch::indexing::None);
+
+    auto std_dev = torch::from_blob(_std.data(), {_std.size()}, no_grad).index({skin_slice}).to(_device);
+    auto mean_skin = torch::from_blob(_mean.data(), {_mean.size()}, no_grad).index({skin_slice}).to(_device);
+
+    auto latent_fit = torch::zeros({1, static_cast<long> (latent_variables.size())}, with_grad);
+    latent_fit = latent_fit.to(_device);
+
+    auto adam_options = torch::optim::AdamOptions(/*lr=*/learning_rate);
+    adam_options = adam_options.betas(std::make_tuple(0.5, 0.5));
+    adam_options = adam_options.weight_decay(_weight_decay);
+    auto optimizer = torch::optim::Adam(std::vector<at::Tensor>{latent_fit}, adam_options);
+
+    // decode the current latent code to skin positions (template space)
+    std::vector<pmp::Point> model_points(n_skin_vertices);
+    auto decode_skin = [&]() -> void {
+        torch::NoGradGuard no_grad_guard;
+        auto decoded = _model.run_method("decoder", latent_fit).toTensor().reshape({-1}).index({skin_slice});
+        decoded = (decoded * std_dev + mean_skin).contiguous().to(torch::kCPU);
+        std::memcpy(model_points.data()->data(), decoded.data_ptr<float>(), n_entries_skin * sizeof(float));
+    };
+
+    decode_skin();
+    SimilarityTransform transform = initial_similarity_transform(model_points, scan);
+
+    std::vector<pmp::Point> queries(n_skin_vertices);
+    std::vector<pmp::Point> matched(n_skin_vertices);
+    std::vector<int> indices{};
+    std::vector<float> sqr_distances{};
+    std::vector<float> weights{};
+
+    ArrayXf target_mc(n_entries_skin);
+    ArrayXf target_weights(n_entries_skin);
+    double best_error = 10e10;
+
+    for (int iteration = 0; iteration < max_iterations; ++iteration) {
+        if (monitor != nullptr) {
+            if (monitor->cancelled()) {
+                std::cout << "Scan fitting cancelled.\n";
+                registered_skin = ArrayXf{};
+                return {};
+            }
+            monitor->set_progress(static_cast<float>(iteration) / static_cast<float>(max_iterations));
+            if (iteration > rigid_iterations && monitor->publish_step(iteration)) {
+                monitor->publish_latent(_latent_to_array(latent_fit));
+            }
+        }
+
+        // closest points on the scan (incremental, previous neighbours bound the search)
+        for (long i = 0; i < n_skin_vertices; ++i) {
+            queries[i] = transform.apply(model_points[i]);
+        }
+        scan_tree.nearest(queries, indices, sqr_distances);
+
+        // robust rejection in template units (scans may come in mm)
+        float sqr_scale = transform.scale * transform.scale;
+        for (auto& sqr_distance : sqr_distances) {
+            sqr_distance /= sqr_scale;
+        }
+        int inliers = reject_correspondence_outliers(indices, sqr_distances, weights);
+        if (inliers < 3) {
+            std::cerr << "[Error] Scan fitting: Not enough correspondences.\n";
+            break;
+        }
+
+        // rigid + scale alignment of the current fit to the scan
+        for (long i = 0; i < n_skin_vertices; ++i) {
+            matched[i] = indices[i] >= 0 ? scan_tree.point(indices[i]) : queries[i];
+        }
+        transform = estimate_similarity_transform(model_points, matched, weights, /*with_scale=*/true);
+
+        // mean inlier distance (template units)
+        double error = 0.0;
+        for (long i = 0; i < n_skin_vertices; ++i) {
+            if (weights[i] > 0.0F) {
+                error += pmp::norm(transform.apply_inverse(matched[i]) - model_points[i]);
+            }
+        }
+        error /= inliers;
+        std::cout << "ICP " << std::setw(2) << iteration << " inliers: " << inliers
+                  << " error: " << error * 1000.0 << " mm, scale: " << transform.scale << '\n';
+
+        // the error of the first latent iteration is still the rigid one, stop only after a latent update
+        double rel_improvement = (best_error - error) / best_error;
+        best_error = std::min(best_error, error);
+        if (iteration > rigid_iterations && rel_improvement < min_improvement) {
+            std::cout << "Stop scan fitting: No improvement.\n";
+            break;
+        }
+
+        // rigid stage only moves the scan
+        if (iteration < rigid_iterations) {
+            continue;
+        }
+
+        // targets in template space (mean centered)
+        for (long i = 0; i < n_skin_vertices; ++i) {
+            pmp::Point target = transform.apply_inverse(matched[i]);
+            for (int j = 0; j < 3; ++j) {
+                target_mc[i * 3 + j] = target[j] - _mean[n_entries_skel + i * 3 + j];
+                target_weights[i * 3 + j] = weights[i];
+            }
+        }
+        auto torch_target = torch::from_blob(target_mc.data(), {n_entries_skin}, no_grad).to(_device);
+        auto torch_weights = torch::from_blob(target_weights.data(), {n_entries_skin}, no_grad).to(_device);
+        auto weight_sum = torch_weights.sum() + 1.0e-8;
+
+        // latent update through the decoder, masked L1 loss
+        for (int step = 0; step < latent_steps; ++step) {
+            optimizer.zero_grad();
+            auto current_fit = _model.run_method("decoder", latent_fit).toTensor().reshape({-1}).index({skin_slice});
+            auto loss = ((current_fit * std_dev - torch_target).abs() * torch_weights).sum() / weight_sum;
+            loss.backward();
+            optimizer.step();
+        }
+
+        decode_skin();
+    }
+
+    // registered scan: matched scan points for inliers, fitted skin everywhere else
+    registered_skin.resize(n_entries_skin);
+    for (long i = 0; i < n_skin_vertices; ++i) {
+        pmp::Point point = model_points[i];
+        if (!weights.empty() && weights[i] > 0.0F) {
+            point = transform.apply_inverse(matched[i]);
+        }
+        registered_skin.segment<3>(i * 3) = Eigen::Vector3f(point[0], point[1], point[2]).array();
+    }
+
+    std::cout << "Scan fit error " << best_error * 1000.0 << " mm\n";
+
+    // convert to final parameters
+    return _latent_to_array(latent_fit);
 }
 
 // ---------------------------------------------------------------------------------------------------------------------
@@ -406,6 +592,42 @@ auto SpiralNetAEModel::inference(const ArrayXf& weights) -> ArrayXf
 
 // ---------------------------------------------------------------------------------------------------------------------
 
+auto SpiralNetAEModel::inference_batch(const MatrixXf& weights) -> MatrixXf
+{
+    if (!_model_loaded || weights.rows() != latent_channels_sum()) {
+        return BaseModel::inference_batch(weights);
+    }
+
+    MatrixXf result{};
+    try {
+        torch::NoGradGuard no_grad_guard;
+
+        // eigen is column major, so every column is one contiguous row of the [batch, latent] tensor
+        auto options = torch::TensorOptions().dtype(torch::kFloat32);
+        torch::Tensor input_t = torch::from_blob((void *) weights.data(), {weights.cols(), weights.rows()}, options);
+        input_t = input_t.to(_device);
+
+        at::Tensor output_tensor = _model.run_method("decoder", input_t).toTensor();
+        output_tensor = output_tensor.reshape({ weights.cols(), -1 }).contiguous().to(at::DeviceType::CPU);
+
+        result = Eigen::Map<MatrixXf> { output_tensor.data_ptr<float>(), output_tensor.size(1), weights.cols() };
+    } catch (c10::Error& error) {
+        std::cerr << error.what() << '\n';
+        return {};
+    }
+
+    if (result.rows() != _mean.size()) {
+        std::cout << "[Error] inference_batch: result.rows=" << result.rows() << ", mean.size=" << _mean.size() << '\n';
+        return {};
+    }
+
+    // add mean and scale by std_dev
+    result = ((result.array().colwise() * _std).colwise() + _mean).matrix();
+    return result;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
 auto SpiralNetAEModel::set_mesh_type(MeshType mesh_type) -> void
 {
     BaseModel::set_mesh_type(mesh_type);
@@ -437,7 +659,46 @@ auto SpiralNetAEModel::set_target_skin(ArrayXf& target_skin) -> void
 
 auto SpiralNetAEModel::fit_target() -> void
 {
-    _target_latent = _fit_skin(_target_skin);
+    set_latent_fit(fit_latent(_target_skin, nullptr));
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto SpiralNetAEModel::fit_target_scan(const ArrayXf& scan_points) -> void
+{
+    ArrayXf registered_skin{};
+    ArrayXf latent = fit_scan_latent(scan_points, registered_skin, nullptr);
+    if (registered_skin.size() == 0) {
+        return;
+    }
+
+    // registered scan becomes the target (x), decoded fit the base for deltas (f(z))
+    _target_skin = registered_skin;
+    set_latent_fit(latent);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto SpiralNetAEModel::fit_latent(const ArrayXf& target_skin, FitMonitor* monitor) -> ArrayXf
+{
+    return _fit_skin(target_skin, monitor);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto SpiralNetAEModel::fit_scan_latent(const ArrayXf& scan_points, ArrayXf& registered_skin, FitMonitor* monitor) -> ArrayXf
+{
+    return _fit_scan(scan_points, registered_skin, monitor);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto SpiralNetAEModel::set_latent_fit(const ArrayXf& latent) -> void
+{
+    _target_latent = latent;
+    if (_target_latent.size() != latent_channels_sum()) {
+        return;
+    }
 
     // perform "base" mesh inference
     InferenceMode _old_mode = _inference_mode;
@@ -449,6 +710,41 @@ auto SpiralNetAEModel::fit_target() -> void
 
 // ---------------------------------------------------------------------------------------------------------------------
 
+auto SpiralNetAEModel::set_latent_fit(const ArrayXf& latent, const ArrayXf& target_skin_fit) -> void
+{
+    // cached f(z) saves the inference
+    if (target_skin_fit.size() != _target_skin.size()) {
+        set_latent_fit(latent);
+        return;
+    }
+    _target_latent = latent;
+    _target_skin_fit = target_skin_fit;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto SpiralNetAEModel::get_target_skin_fit() -> ArrayXf
+{
+    return _target_skin_fit;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto SpiralNetAEModel::fit_settings(bool scan_fitting) -> std::string
+{
+    std::string settings = fmt::format("spiral_ae;v{};steps={};degradation={};improvement={};lr={};decay={}",
+                                       _model_version, _fit_max_steps, _fit_max_loss_degradation,
+                                       _fit_min_loss_improvement, _fit_learning_rate, _weight_decay);
+    if (scan_fitting) {
+        settings += fmt::format(";scan;rigid={};iterations={};latent_steps={};scan_improvement={}",
+                                _scan_rigid_iterations, _scan_max_iterations, _scan_latent_steps,
+                                _scan_min_improvement);
+    }
+    return settings;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
 auto SpiralNetAEModel::get_latent_fit() -> ArrayXf
 {
     return _target_latent;
@@ -456,4 +752,11 @@ auto SpiralNetAEModel::get_latent_fit() -> ArrayXf
 
 // ---------------------------------------------------------------------------------------------------------------------
 
+auto SpiralNetAEModel::get_target_skin() -> ArrayXf
+{
+    return _target_skin;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
 //======================================================================================================================
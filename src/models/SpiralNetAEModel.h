@@ -40,6 +40,16 @@ class SpiralNetAEModel : public BaseModel
     // debugging parameters
     float _weight_decay = 7.5e-5;
 
+    // convergence parameters of the fitting (part of the fit cache key)
+    int _fit_max_steps = 100;
+    double _fit_max_loss_degradation = 10.0e-2; // percentage!
+    double _fit_min_loss_improvement = 0.15e-2; // percentage!
+    double _fit_learning_rate = 7.5e-2;
+    int _scan_rigid_iterations = 10;
+    int _scan_max_iterations = 40;
+    int _scan_latent_steps = 5;
+    double _scan_min_improvement = 0.1e-2; // percentage!
+
     // use at::DeviceType::CPU to be safe
     // Todo: Change to cuda
     torch::Device _device = torch::kCPU;
@@ -48,16 +58,20 @@ class SpiralNetAEModel : public BaseModel
     pmp::SurfaceMesh _skel {};
     pmp::SurfaceMesh _skin {};
 
-    auto get_model_filename() -> std::string;
-
     // load existing model from disk
     auto load_model(const std::string& filename) -> void;
 
     // inference torch model
     auto _inference_torch(const ArrayXf& weights) -> ArrayXf;
 
-    // fit latent variables with given skin
-    auto _fit_skin(ArrayXf& target) -> ArrayXf;
+    // fit latent variables with given skin (monitor is optional)
+    auto _fit_skin(const ArrayXf& target, FitMonitor* monitor) -> ArrayXf;
+
+    // fit latent variables to a raw scan (icp), returns the scan registered to the template topology
+    auto _fit_scan(const ArrayXf& scan_points, ArrayXf& registered_skin, FitMonitor* monitor) -> ArrayXf;
+
+    // copy latent tensor to cpu array
+    auto static _latent_to_array(const torch::Tensor& latent) -> ArrayXf;
 
     // fitting target
     ArrayXf _target_skin{};
@@ -83,9 +97,13 @@ class SpiralNetAEModel : public BaseModel
 
     // calls evaluate internally
     auto inference(const ArrayXf& weights) -> ArrayXf override;
+    // one decoder call for all samples
+    auto inference_batch(const MatrixXf& weights) -> MatrixXf override;
 
     // load model when mesh type is set
     auto set_mesh_type(MeshType mesh_type) -> void override;
+    // zip file of the current mesh type
+    auto get_model_filename() -> std::string override;
 
     // get mean mesh
     auto get_mean_skel() -> pmp::SurfaceMesh override;
@@ -98,8 +116,21 @@ class SpiralNetAEModel : public BaseModel
     // this should set the "best fit" skin internally for delta changes
     // setting z
     auto fit_target() -> void override;
+    // fit raw scan without correspondences
+    auto fit_target_scan(const ArrayXf& scan_points) -> void override;
+    // fitting without changing the model state (background jobs)
+    auto fit_latent(const ArrayXf& target_skin, FitMonitor* monitor) -> ArrayXf override;
+    auto fit_scan_latent(const ArrayXf& scan_points, ArrayXf& registered_skin, FitMonitor* monitor) -> ArrayXf override;
+    // set fitted latent variables for the current target skin
+    auto set_latent_fit(const ArrayXf& latent) -> void override;
+    auto set_latent_fit(const ArrayXf& latent, const ArrayXf& target_skin_fit) -> void override;
+    auto get_target_skin_fit() -> ArrayXf override;
+    // description of the fitter, changes invalidate cached fits
+    auto fit_settings(bool scan_fitting) -> std::string override;
     // get fitted values for latent variables
     auto get_latent_fit() -> ArrayXf override;
+    // get target skin
+    auto get_target_skin() -> ArrayXf override;
 };
 
 // ---------------------------------------------------------------------------------------------------------------------
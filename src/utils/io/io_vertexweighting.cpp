@@ -27,3 +27,27 @@ bool load_vertexweighting(const std::filesystem::path& filename, pmp::SurfaceMes
 
     return true;
 }
+
+bool save_vertexweighting(const std::filesystem::path& filename, const pmp::SurfaceMesh& mesh, const std::string& property_name)
+{
+    auto vw = mesh.get_vertex_property<float>(property_name);
+    if (!vw)
+    {
+        fprintf(stderr, "[ERROR] save_vertexweighting: Mesh has no property %s\n", property_name.c_str());
+        return false;
+    }
+
+    std::ofstream ofs(filename);
+    if (!ofs)
+    {
+        fprintf(stderr, "[ERROR] save_vertexweighting: Cannot open %s\n", filename.c_str());
+        return false;
+    }
+
+    for (auto v : mesh.vertices())
+    {
+        ofs << vw[v] << '\n';
+    }
+
+    return ofs.good();
+}
@@ -6,3 +6,6 @@
 #include <pmp/surface_mesh.h>
 
 bool load_vertexweighting(const std::filesystem::path& filename, pmp::SurfaceMesh& mesh, const std::string& property_name);
+
+// Writes the float vertex property (one value per line), readable by load_vertexweighting
+bool save_vertexweighting(const std::filesystem::path& filename, const pmp::SurfaceMesh& mesh, const std::string& property_name);
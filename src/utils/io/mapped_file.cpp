@@ -0,0 +1,91 @@
+//======================================================================================================================
+// Copyright (c) the Authors 2024
+//
+// This work is licensed under a
+// Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+//
+// You should have received a copy of the license along with this
+// work. If not, see <http://creativecommons.org/licenses/by-nc-sa/4.0/>.
+//
+//======================================================================================================================
+
+#include "mapped_file.h"
+
+#include <fstream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// =====================================================================================================================
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto MappedFile::open(const std::string& filename) -> bool
+{
+    close();
+
+#ifndef _WIN32
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat status {};
+    if (::fstat(fd, &status) != 0 || status.st_size <= 0) {
+        ::close(fd);
+        return false;
+    }
+    void* address = ::mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping keeps its own reference to the file
+    ::close(fd);
+    if (address == MAP_FAILED) {
+        return false;
+    }
+    _data = static_cast<const char*>(address);
+    _size = static_cast<size_t>(status.st_size);
+#else
+    std::ifstream in(filename, std::ios::binary | std::ios::ate);
+    if (!in || in.tellg() <= 0) {
+        return false;
+    }
+    _buffer.resize(static_cast<size_t>(in.tellg()));
+    in.seekg(0);
+    if (!in.read(_buffer.data(), static_cast<std::streamsize>(_buffer.size()))) {
+        _buffer.clear();
+        return false;
+    }
+    _data = _buffer.data();
+    _size = _buffer.size();
+#endif
+
+    return true;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+auto MappedFile::close() -> void
+{
+#ifndef _WIN32
+    if (_data != nullptr) {
+        ::munmap(const_cast<char*>(_data), _size);
+    }
+#endif
+    _buffer.clear();
+    _buffer.shrink_to_fit();
+    _data = nullptr;
+    _size = 0;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+// =====================================================================================================================
@@ -0,0 +1,48 @@
+//======================================================================================================================
+// Copyright (c) the Authors 2024
+//
+// This work is licensed under a
+// Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+//
+// You should have received a copy of the license along with this
+// work. If not, see <http://creativecommons.org/licenses/by-nc-sa/4.0/>.
+//
+//======================================================================================================================
+
+#ifndef TAILORME_VIEWER_MAPPED_FILE_H
+#define TAILORME_VIEWER_MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+// Read-only view of a whole file. Memory mapped on POSIX systems (pages are read on first access, opening large files
+// is cheap), read into memory otherwise. The data stays valid until the file is closed or the object is destroyed.
+class MappedFile {
+  protected:
+    const char* _data = nullptr;
+    size_t _size = 0;
+    // content if the file is not mapped
+    std::vector<char> _buffer{};
+
+  public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    auto operator=(const MappedFile&) -> MappedFile& = delete;
+
+    // false if the file cannot be read or is empty
+    auto open(const std::string& filename) -> bool;
+    auto close() -> void;
+
+    [[nodiscard]] auto is_open() const -> bool { return _data != nullptr; }
+    [[nodiscard]] auto data() const -> const char* { return _data; }
+    [[nodiscard]] auto size() const -> size_t { return _size; }
+};
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+#endif // TAILORME_VIEWER_MAPPED_FILE_H
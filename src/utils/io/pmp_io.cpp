@@ -11,6 +11,7 @@
 
 #include "pmp_io.h"
 
+#include <fstream>
 #include <iostream>
 #include <string>
 
@@ -182,3 +183,28 @@ void read_obj_buffer(SurfaceMesh& mesh, const std::stringstream& buffer)
     }
 
 }
+
+void read_xyz(SurfaceMesh& mesh, const std::string& filename)
+{
+    // point cloud: one "x y z [...]" per line, everything behind the position is ignored
+    mesh.clear();
+
+    std::ifstream input(filename);
+    if (!input)
+    {
+        throw IOException("Failed to open file: " + filename);
+    }
+
+    std::string line;
+    while (std::getline(input, line))
+    {
+        float x, y, z;
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        if (sscanf(line.data(), "%f %f %f", &x, &y, &z) == 3)
+        {
+            mesh.add_vertex(Point(x, y, z));
+        }
+    }
+}
@@ -18,5 +18,8 @@
 
 void read_obj_buffer(pmp::SurfaceMesh& mesh, const std::stringstream& buffer);
 
+// point cloud (raw scans), vertices only
+void read_xyz(pmp::SurfaceMesh& mesh, const std::string& filename);
+
 
 #endif //TAILORME_WRITEOBJ_H